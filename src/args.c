@@ -6,6 +6,7 @@ extern void app_load_labels(const char* file);
     #include <argp.h>
 #endif
 #include <sokol_args.h>
+#include <stdlib.h>
 
 #define BUGS_ADDRESS "https://github.com/X65/emu/issues"
 const char* app_bug_address = BUGS_ADDRESS;
@@ -13,7 +14,7 @@ const char* app_releases_address = "https://github.com/X65/emu/releases";
 #define FULL_NAME "X65 microcomputer emulator"
 const char full_name[] = FULL_NAME;
 
-struct arguments arguments = { NULL, 0, 0, "-" };
+struct arguments arguments = { .output_file = "-" };
 static char args_doc[] = "[ROM.xex]";
 
 #ifdef USE_ARGP
@@ -23,6 +24,19 @@ static struct argp_option options[] = {
     { "silent", 's', 0, OPTION_ALIAS },
     { "output", 'o', "FILE", 0, "Output to FILE instead of standard output" },
     { "labels", 'l', "LABELS_FILE", 0, "Load VICE compatible global labels file" },
+    { "audio-capture", 'a', "FILE", 0, "Capture audio output to WAV FILE (headerless PCM if FILE ends with .raw)" },
+    { "audio-f32", 'F', 0, 0, "Capture audio as 32-bit float samples instead of 16-bit integer" },
+    { "vgm", 'g', "FILE", 0, "Log OPL3 register writes to VGM FILE" },
+    { "fm-thread", 'T', 0, 0, "Run OPL3 synthesis on a separate thread" },
+    { "fs-root", 'd', "DIR", 0, "Serve RIA file API calls from host directory DIR" },
+    { "api-latency", 'L', "US", 0, "Keep RIA API calls busy for US microseconds (default 0)" },
+    { "uart-pty", 'P', 0, 0, "Connect RIA UART to a host pseudo-terminal" },
+    { "uart-socket", 'U', "PATH", 0, "Connect RIA UART to a Unix domain socket listening on PATH" },
+    { "uart-buffer", 'B', "SIZE", 0, "RIA UART FIFO size in bytes (default 128, max 4096)" },
+    { "seed", 'S', "SEED", 0, "Seed the RIA random number generator with SEED for reproducible runs" },
+    { "rewind", 'R', "MB", 0, "Keep MB megabytes of rewind history, hold F10 to rewind (default 0, off)" },
+    { "run-ahead", 'A', "FRAMES", 0, "Show FRAMES frames ahead to hide the input lag of games (default 0, max 4)" },
+    { "huge-pages", 'H', 0, 0, "Allocate guest RAM on 2 MB huge pages if the host provides them" },
     { 0 }
 };
 
@@ -34,6 +48,19 @@ static error_t parse_opt(int key, char* arg, struct argp_state* argp_state) {
         case 's': args->silent = 1; break;
         case 'v': args->verbose = 1; break;
         case 'o': args->output_file = arg; break;
+        case 'a': args->audio_capture_file = arg; break;
+        case 'F': args->audio_capture_f32 = 1; break;
+        case 'g': args->vgm_file = arg; break;
+        case 'T': args->fm_thread = 1; break;
+        case 'd': args->fs_root = arg; break;
+        case 'L': args->api_latency = atoi(arg); break;
+        case 'P': args->uart_pty = 1; break;
+        case 'U': args->uart_socket = arg; break;
+        case 'B': args->uart_buffer = atoi(arg); break;
+        case 'S': args->seed = arg; break;
+        case 'R': args->rewind_mb = atoi(arg); break;
+        case 'A': args->run_ahead = atoi(arg); break;
+        case 'H': args->huge_pages = 1; break;
 
         case 'l': app_load_labels(arg); break;
 
@@ -66,4 +93,43 @@ void args_parse(int argc, char* argv[]) {
     if (sargs_exists("file")) {
         arguments.rom = sargs_value("file");
     }
+    if (sargs_exists("audio-capture")) {
+        arguments.audio_capture_file = sargs_value("audio-capture");
+    }
+    if (sargs_boolean("audio-f32")) {
+        arguments.audio_capture_f32 = 1;
+    }
+    if (sargs_exists("vgm")) {
+        arguments.vgm_file = sargs_value("vgm");
+    }
+    if (sargs_boolean("fm-thread")) {
+        arguments.fm_thread = 1;
+    }
+    if (sargs_exists("fs-root")) {
+        arguments.fs_root = sargs_value("fs-root");
+    }
+    if (sargs_exists("api-latency")) {
+        arguments.api_latency = atoi(sargs_value("api-latency"));
+    }
+    if (sargs_boolean("uart-pty")) {
+        arguments.uart_pty = 1;
+    }
+    if (sargs_exists("uart-socket")) {
+        arguments.uart_socket = sargs_value("uart-socket");
+    }
+    if (sargs_exists("uart-buffer")) {
+        arguments.uart_buffer = atoi(sargs_value("uart-buffer"));
+    }
+    if (sargs_exists("seed")) {
+        arguments.seed = sargs_value("seed");
+    }
+    if (sargs_exists("rewind")) {
+        arguments.rewind_mb = atoi(sargs_value("rewind"));
+    }
+    if (sargs_exists("run-ahead")) {
+        arguments.run_ahead = atoi(sargs_value("run-ahead"));
+    }
+    if (sargs_boolean("huge-pages")) {
+        arguments.huge_pages = 1;
+    }
 }
@@ -11,6 +11,19 @@ extern struct arguments {
     const char* rom;
     int silent, verbose;
     const char* output_file;
+    const char* audio_capture_file;
+    int audio_capture_f32;
+    const char* vgm_file;
+    int fm_thread;
+    const char* fs_root;
+    int api_latency;
+    int uart_pty;
+    const char* uart_socket;
+    int uart_buffer;
+    const char* seed;
+    int rewind_mb;
+    int run_ahead;
+    int huge_pages;
 } arguments;
 
 void args_parse(int argc, char* argv[]);
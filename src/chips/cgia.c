@@ -17,11 +17,14 @@
 #define _CGIA_RGBA(r, g, b) \
     (0xFF000000 | _CGIA_CLAMP((r * 4) / 3) | (_CGIA_CLAMP((g * 4) / 3) << 8) | (_CGIA_CLAMP((b * 4) / 3) << 16))
 
-// used to access regs from firmware render function which expects global symbol
+// used to access regs from firmware render function which expects global symbol,
+// the instance the firmware globals belong to, see _cgia_activate()
 static cgia_t* CGIA_vpu;
 static uint8_t vram_cache[2][256 * 256];
 
 static void _copy_internal_regs(cgia_t* vpu);
+static void _cgia_save_globals(cgia_t* vpu);
+static void _cgia_activate(cgia_t* vpu);
 
 void cgia_init(cgia_t* vpu, const cgia_desc_t* desc) {
     CHIPS_ASSERT(vpu && desc);
@@ -29,6 +32,10 @@ void cgia_init(cgia_t* vpu, const cgia_desc_t* desc) {
     CHIPS_ASSERT(desc->fetch_cb);
     CHIPS_ASSERT((desc->tick_hz > 0) && (desc->tick_hz < (MODE_BIT_CLK_KHZ * 1000)));
 
+    // the firmware globals are initialized for this instance
+    if (CGIA_vpu && (CGIA_vpu != vpu)) {
+        _cgia_save_globals(CGIA_vpu);
+    }
     memset(vpu, 0, sizeof(*vpu));
     vpu->fb = desc->framebuffer.ptr;
     vpu->fetch_cb = desc->fetch_cb;
@@ -50,11 +57,24 @@ void cgia_init(cgia_t* vpu, const cgia_desc_t* desc) {
 
     fwcgia_init();
     _copy_internal_regs(vpu);
+    _cgia_save_globals(vpu);
 
     pwm_init(&vpu->pwm[0], desc->tick_hz);
     pwm_init(&vpu->pwm[1], desc->tick_hz);
 }
 
+void cgia_discard(cgia_t* vpu) {
+    CHIPS_ASSERT(vpu);
+    if (CGIA_vpu == vpu) {
+        CGIA_vpu = 0;
+    }
+}
+
+void cgia_activate(cgia_t* vpu) {
+    CHIPS_ASSERT(vpu);
+    _cgia_activate(vpu);
+}
+
 void cgia_reset(cgia_t* vpu) {
     CHIPS_ASSERT(vpu);
     vpu->h_count = 0;
@@ -107,6 +127,8 @@ static uint64_t _cgia_tick(cgia_t* vpu, uint64_t pins) {
 }
 
 uint64_t cgia_tick(cgia_t* vpu, uint64_t pins) {
+    _cgia_activate(vpu);
+
     // handle registers
     if (pins & CGIA_CS) {
         uint8_t addr = CGIA_GET_REG_ADDR(pins);
@@ -770,12 +792,124 @@ static void _cgia_transfer_vcache_bank(uint8_t bank) {
     }
 }
 void cgia_mirror_vram(cgia_t* vpu) {
+    if (CGIA_vpu != vpu) {
+        // activating mirrors VRAM
+        _cgia_activate(vpu);
+        return;
+    }
     _cgia_copy_vcache_bank(vpu, vram_cache_ptr[0] == vram_cache[0] ? 0 : 1);
     _cgia_copy_vcache_bank(vpu, vram_cache_ptr[1] == vram_cache[0] ? 0 : 1);
 }
 void cgia_mem_wr(cgia_t* vpu, uint32_t addr, uint8_t data) {
+    _cgia_activate(vpu);
     cgia_ram_write(addr, data);
 }
+void cgia_mem_wr_range(cgia_t* vpu, uint32_t addr, const uint8_t* src, uint32_t len) {
+    _cgia_activate(vpu);
+    while (len > 0) {
+        // split at 64 KB bank boundaries
+        const uint32_t bank = addr & 0xFF0000;
+        const uint32_t chunk = (0x10000 - (addr & 0xFFFF)) < len ? (0x10000 - (addr & 0xFFFF)) : len;
+        // banks which are neither cached nor about to be cached are not mirrored
+        for (int i = 0; i < CGIA_VRAM_BANKS; ++i) {
+            if (bank == vram_cache_bank_mask[i] || bank == vram_wanted_bank_mask[i]) {
+                for (uint32_t j = 0; j < chunk; ++j) {
+                    cgia_ram_write(addr + j, src[j]);
+                }
+                break;
+            }
+        }
+        addr = (addr + chunk) & 0xFFFFFF;
+        src += chunk;
+        len -= chunk;
+    }
+}
+
+/* firmware globals
+
+    The firmware keeps its registers and renderer state in globals, a copy
+    of them in cgia_t makes it part of snapshots and rewind. The VRAM
+    cache contents are not copied, they mirror RAM and are fetched again
+    by cgia_mirror_vram() when other banks are cached. The interpolators
+    are set up for every rendered line and hold host pointers, they are
+    left out.
+
+    With several instances (forks) the globals belong to the one used
+    last. Using another one swaps the copies and fetches its VRAM caches.
+*/
+typedef struct {
+    typeof(CGIA) regs;
+    typeof(plane_int) plane_int;
+    typeof(sprite_dsc_offsets) sprite_dsc_offsets;
+    typeof(vram_cache_bank_mask) bank_mask;
+    typeof(vram_wanted_bank_mask) wanted_bank_mask;
+    uint8_t cache_ptr_idx[CGIA_VRAM_BANKS];
+} _cgia_globals_t;
+static_assert(sizeof(_cgia_globals_t) <= CGIA_GLOBALS_SIZE, "CGIA_GLOBALS_SIZE is too small for the firmware state");
+
+static void _cgia_save_globals(cgia_t* vpu) {
+    _cgia_globals_t* g = (_cgia_globals_t*)vpu->globals;
+    memcpy(&g->regs, &CGIA, sizeof(g->regs));
+    memcpy(g->plane_int, plane_int, sizeof(g->plane_int));
+    memcpy(g->sprite_dsc_offsets, sprite_dsc_offsets, sizeof(g->sprite_dsc_offsets));
+    memcpy(g->bank_mask, vram_cache_bank_mask, sizeof(g->bank_mask));
+    memcpy(g->wanted_bank_mask, vram_wanted_bank_mask, sizeof(g->wanted_bank_mask));
+    for (int i = 0; i < CGIA_VRAM_BANKS; ++i) {
+        g->cache_ptr_idx[i] = vram_cache_ptr[i] == vram_cache[0] ? 0 : 1;
+    }
+}
+
+// true if other banks are cached now
+static bool _cgia_load_globals(cgia_t* vpu) {
+    const _cgia_globals_t* g = (const _cgia_globals_t*)vpu->globals;
+    bool banks_changed = false;
+    for (int i = 0; i < CGIA_VRAM_BANKS; ++i) {
+        banks_changed |= (vram_cache_bank_mask[i] != g->bank_mask[i])
+                       || (vram_wanted_bank_mask[i] != g->wanted_bank_mask[i])
+                       || (vram_cache_ptr[i] != vram_cache[g->cache_ptr_idx[i] & 1]);
+        vram_cache_ptr[i] = vram_cache[g->cache_ptr_idx[i] & 1];
+    }
+    memcpy(&CGIA, &g->regs, sizeof(g->regs));
+    memcpy(plane_int, g->plane_int, sizeof(g->plane_int));
+    memcpy(sprite_dsc_offsets, g->sprite_dsc_offsets, sizeof(g->sprite_dsc_offsets));
+    memcpy(vram_cache_bank_mask, g->bank_mask, sizeof(g->bank_mask));
+    memcpy(vram_wanted_bank_mask, g->wanted_bank_mask, sizeof(g->wanted_bank_mask));
+    _copy_internal_regs(vpu);
+    return banks_changed;
+}
+
+static void _cgia_activate(cgia_t* vpu) {
+    if (CGIA_vpu != vpu) {
+        if (CGIA_vpu) {
+            _cgia_save_globals(CGIA_vpu);
+        }
+        CGIA_vpu = vpu;
+        _cgia_load_globals(vpu);
+        cgia_mirror_vram(vpu);
+    }
+}
+
+void cgia_save_globals(cgia_t* vpu) {
+    CHIPS_ASSERT(vpu);
+    // an inactive instance has its copy up to date
+    if (CGIA_vpu == vpu) {
+        _cgia_save_globals(vpu);
+    }
+}
+
+bool cgia_load_globals(cgia_t* vpu) {
+    CHIPS_ASSERT(vpu);
+    if (CGIA_vpu != vpu) {
+        if (CGIA_vpu) {
+            _cgia_save_globals(CGIA_vpu);
+        }
+        CGIA_vpu = vpu;
+        // the VRAM caches hold the banks of another instance
+        _cgia_load_globals(vpu);
+        return true;
+    }
+    return _cgia_load_globals(vpu);
+}
 
 static void _copy_internal_regs(cgia_t* vpu) {
     vpu->regs = (uint8_t*)&CGIA;
@@ -47,6 +47,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdalign.h>
 #include <limits.h>
 
 #ifdef __cplusplus
@@ -169,6 +170,9 @@ typedef uint8_t (*cgia_fetch_t)(uint32_t data, void* user_data);
 // CGIA has 7 address lines
 #define CGIA_NUM_REGS (1U << 7)
 
+// room for the firmware renderer globals in cgia_t, see cgia_save_globals()
+#define CGIA_GLOBALS_SIZE (1024)
+
 // the cgia setup parameters
 typedef struct {
     // the CPU tick rate in hz
@@ -231,10 +235,17 @@ typedef struct {
 
     // audio output
     pwm_t pwm[2];
+
+    // copy of the firmware registers, plane state and VRAM cache banks, which live in globals
+    alignas(8) uint8_t globals[CGIA_GLOBALS_SIZE];
 } cgia_t;
 
 // initialize a new cgia_t instance
 void cgia_init(cgia_t* vpu, const cgia_desc_t* desc);
+// discard a cgia_t instance
+void cgia_discard(cgia_t* vpu);
+// make the firmware globals (and vpu->regs) belong to vpu, needed before accessing vpu->regs directly
+void cgia_activate(cgia_t* vpu);
 // reset a cgia_t instance
 void cgia_reset(cgia_t* vpu);
 // tick the cgia_t instance, this will call the fetch_cb and generate the image
@@ -245,8 +256,14 @@ void cgia_snapshot_onsave(cgia_t* snapshot);
 void cgia_snapshot_onload(cgia_t* snapshot, cgia_t* sys);
 // mirror RAM writes to CGIA VRAM
 void cgia_mem_wr(cgia_t* vpu, uint32_t addr, uint8_t data);
+// mirror a block of RAM writes to CGIA VRAM, src is the written data
+void cgia_mem_wr_range(cgia_t* vpu, uint32_t addr, const uint8_t* src, uint32_t len);
 // copy VRAM - after fastload
 void cgia_mirror_vram(cgia_t* vpu);
+// copy the firmware globals into vpu->globals, call before vpu is copied for a snapshot
+void cgia_save_globals(cgia_t* vpu);
+// restore the firmware globals from vpu->globals, true if other banks are cached now and VRAM must be mirrored
+bool cgia_load_globals(cgia_t* vpu);
 
 #ifdef __cplusplus
 }  // extern "C"
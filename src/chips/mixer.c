@@ -0,0 +1,101 @@
+#include "./mixer.h"
+
+#include <string.h>
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+    #include <xmmintrin.h>
+    #define _MIXER_USE_SSE
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    #include <arm_neon.h>
+    #define _MIXER_USE_NEON
+#endif
+#ifndef CHIPS_ASSERT
+    #include <assert.h>
+    #define CHIPS_ASSERT(c) assert(c)
+#endif
+
+#define _MIXER_DEFAULT(val, def) (((val) != 0) ? (val) : (def))
+
+static void _mixer_init_regs(mixer_t* m) {
+    memset(m->reg, 0, sizeof(m->reg));
+    for (int src = 0; src < MIXER_NUM_SOURCES; src++) {
+        m->reg[MIXER_REG_GAIN(src)] = 0xFF;
+        m->reg[MIXER_REG_PAN(src)] = 0x80;
+    }
+    m->reg[MIXER_REG_MASTER] = 0xFF;
+}
+
+void mixer_init(mixer_t* m, const mixer_desc_t* desc) {
+    CHIPS_ASSERT(m && desc);
+    memset(m, 0, sizeof(*m));
+    m->volume = _MIXER_DEFAULT(desc->volume, 1.0f);
+    _mixer_init_regs(m);
+}
+
+void mixer_reset(mixer_t* m) {
+    CHIPS_ASSERT(m);
+    _mixer_init_regs(m);
+    memset(m->source, 0, sizeof(m->source));
+    m->pins = 0;
+}
+
+uint64_t mixer_tick(mixer_t* m, uint64_t pins) {
+    if (pins & MIXER_CS) {
+        const uint8_t addr = pins & MIXER_RS;
+        if (pins & MIXER_RW) {
+            MIXER_SET_DATA(pins, m->reg[addr]);
+        }
+        else {
+            m->reg[addr] = MIXER_GET_DATA(pins);
+        }
+        m->pins = pins;
+    }
+    return pins;
+}
+
+/* compute left/right gain of a source
+
+   Panning is a balance control: at center both channels are at full gain,
+   moving towards one side attenuates the opposite channel only.
+*/
+static void _mixer_source_gain(const mixer_t* m, int src, float master, float* left, float* right) {
+    const float gain = (float)m->reg[MIXER_REG_GAIN(src)] / 255.0f * master;
+    const int pan = m->reg[MIXER_REG_PAN(src)];
+    const float l = pan <= 0x80 ? 1.0f : (float)(0xFF - pan) / 127.0f;
+    const float r = pan >= 0x80 ? 1.0f : (float)pan / 128.0f;
+    *left = gain * l;
+    *right = gain * r;
+}
+
+void mixer_mix(mixer_t* m, float* out, int num_frames) {
+    CHIPS_ASSERT(m && out);
+    CHIPS_ASSERT((num_frames >= 0) && (num_frames <= MIXER_MAX_SAMPLES));
+    const float master = (float)m->reg[MIXER_REG_MASTER] / 255.0f * m->volume;
+    const int num_samples = num_frames * MIXER_NUM_CHANNELS;
+    memset(out, 0, (size_t)num_samples * sizeof(float));
+    for (int src = 0; src < MIXER_NUM_SOURCES; src++) {
+        float gl, gr;
+        _mixer_source_gain(m, src, master, &gl, &gr);
+        if ((gl == 0.0f) && (gr == 0.0f)) {
+            continue;
+        }
+        const float* in = m->source[src];
+        int i = 0;
+#if defined(_MIXER_USE_SSE)
+        const __m128 g = _mm_setr_ps(gl, gr, gl, gr);
+        for (; i + 4 <= num_samples; i += 4) {
+            _mm_storeu_ps(&out[i], _mm_add_ps(_mm_loadu_ps(&out[i]), _mm_mul_ps(_mm_load_ps(&in[i]), g)));
+        }
+#elif defined(_MIXER_USE_NEON)
+        const float gv[4] = { gl, gr, gl, gr };
+        const float32x4_t g = vld1q_f32(gv);
+        for (; i + 4 <= num_samples; i += 4) {
+            vst1q_f32(&out[i], vmlaq_f32(vld1q_f32(&out[i]), vld1q_f32(&in[i]), g));
+        }
+#endif
+        // scalar tail (and fallback)
+        for (; i < num_samples; i += 2) {
+            out[i] += in[i] * gl;
+            out[i + 1] += in[i + 1] * gr;
+        }
+    }
+}
@@ -0,0 +1,141 @@
+#pragma once
+/*
+    mixer.h -- X65 stereo audio mixer
+
+    Optionally provide the following macros with your own implementation
+
+        CHIPS_ASSERT(c)     -- your own assert macro (default: assert(c))
+
+    Every sound source renders into its own stereo block buffer using
+    mixer_put() / mixer_put_mono(). When a block is complete, mixer_mix()
+    accumulates all sources, scaled by their gain and pan registers and
+    the master volume, into an interleaved stereo output buffer.
+
+    ## Emulated Pins
+    *************************************
+    *           +-----------+           *
+    *    CS --->|           |           *
+    *    RW --->|           |           *
+    *           |           |           *
+    *   RS0 --->|           |           *
+    *        ...|   MIXER   |           *
+    *   RS3 --->|           |           *
+    *           |           |           *
+    *    D0 <-->|           |           *
+    *        ...|           |           *
+    *    D7 <-->|           |           *
+    *           +-----------+           *
+    *************************************
+
+    ## Registers
+
+    - 0x00..0x07: gain/pan pairs of the sound sources (see MIXER_SOURCE_*)
+        - gain: 0x00 mute .. 0xFF full volume
+        - pan:  0x00 left .. 0x80 center .. 0xFF right
+    - 0x0F: master volume, 0x00 mute .. 0xFF full volume
+
+    ## 0BSD license
+
+    Copyright (c) 2025 Tomasz Sterna
+*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdalign.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// register select same as lower 4 shared address bus bits
+#define MIXER_PIN_RS0 (0)
+#define MIXER_PIN_RS1 (1)
+#define MIXER_PIN_RS2 (2)
+#define MIXER_PIN_RS3 (3)
+
+// data bus pins shared with CPU
+#define MIXER_PIN_D0 (16)
+#define MIXER_PIN_D1 (17)
+#define MIXER_PIN_D2 (18)
+#define MIXER_PIN_D3 (19)
+#define MIXER_PIN_D4 (20)
+#define MIXER_PIN_D5 (21)
+#define MIXER_PIN_D6 (22)
+#define MIXER_PIN_D7 (23)
+
+// control pins shared with CPU
+#define MIXER_PIN_RW (24)  // same as M6502_RW
+
+// chip-specific control pins
+#define MIXER_PIN_CS (40)
+
+// pin bit masks
+#define MIXER_RS0     (1ULL << MIXER_PIN_RS0)
+#define MIXER_RS1     (1ULL << MIXER_PIN_RS1)
+#define MIXER_RS2     (1ULL << MIXER_PIN_RS2)
+#define MIXER_RS3     (1ULL << MIXER_PIN_RS3)
+#define MIXER_RS      (MIXER_RS3 | MIXER_RS2 | MIXER_RS1 | MIXER_RS0)
+#define MIXER_DB_PINS (0xFF0000ULL)
+#define MIXER_RW      (1ULL << MIXER_PIN_RW)
+#define MIXER_CS      (1ULL << MIXER_PIN_CS)
+
+// sound sources
+#define MIXER_SOURCE_FM   (0)  // YMF262 (OPL3)
+#define MIXER_SOURCE_PWM0 (1)  // CGIA PWM channel 0
+#define MIXER_SOURCE_PWM1 (2)  // CGIA PWM channel 1
+#define MIXER_SOURCE_SD1  (3)  // YMF825 (SD-1), not emulated yet
+#define MIXER_NUM_SOURCES (4)
+
+// register indices
+#define MIXER_REG_GAIN(src) ((src) * 2)      // source gain
+#define MIXER_REG_PAN(src)  ((src) * 2 + 1)  // source stereo position
+#define MIXER_REG_MASTER    (0x0F)           // master volume
+#define MIXER_NUM_REGS      (16)
+
+// number of output channels (interleaved stereo)
+#define MIXER_NUM_CHANNELS (2)
+// max number of sample frames in a block
+#define MIXER_MAX_SAMPLES (1024)
+
+// mixer setup parameters
+typedef struct {
+    float volume;  // base volume applied on top of the master volume register (default 1.0)
+} mixer_desc_t;
+
+// mixer state
+typedef struct {
+    uint8_t reg[MIXER_NUM_REGS];
+    float volume;
+    uint64_t pins;
+    // per-source interleaved stereo block buffers
+    alignas(16) float source[MIXER_NUM_SOURCES][MIXER_MAX_SAMPLES * MIXER_NUM_CHANNELS];
+} mixer_t;
+
+// extract 8-bit data bus from 64-bit pins
+#define MIXER_GET_DATA(p) ((uint8_t)((p) >> 16))
+// merge 8-bit data bus value into 64-bit pins
+#define MIXER_SET_DATA(p, d) \
+    { p = (((p) & ~0xFF0000ULL) | (((d) << 16) & 0xFF0000ULL)); }
+
+// initialize a new mixer instance
+void mixer_init(mixer_t* mixer, const mixer_desc_t* desc);
+// reset an existing mixer instance
+void mixer_reset(mixer_t* mixer);
+// tick the mixer, handles register access only
+uint64_t mixer_tick(mixer_t* mixer, uint64_t pins);
+// mix num_frames of all sources into interleaved stereo output buffer
+void mixer_mix(mixer_t* mixer, float* out, int num_frames);
+
+// put a stereo sample frame into a source block buffer
+static inline void mixer_put(mixer_t* mixer, int src, int pos, float left, float right) {
+    float* dst = &mixer->source[src][pos * MIXER_NUM_CHANNELS];
+    dst[0] = left;
+    dst[1] = right;
+}
+// put a mono sample into a source block buffer
+static inline void mixer_put_mono(mixer_t* mixer, int src, int pos, float sample) {
+    mixer_put(mixer, src, pos, sample, sample);
+}
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
@@ -1,12 +1,6 @@
-#define CHIPS_IMPL
-#include "chips/m6526.h"
-#undef CHIPS_IMPL
-
 #include "ria816.h"
 
 #include <string.h>
-#include <stdlib.h>
-#include <time.h>
 #include <sys/types.h>
 #ifndef CHIPS_ASSERT
     #include <assert.h>
@@ -16,27 +10,129 @@
 // fixed point precision for more precise error accumulation
 #define RIA816_FIXEDPOINT_SCALE (256)
 
+/* expand the 64-bit seed into the generator state with splitmix64,
+   this never produces the all-zero state
+*/
+static void _ria816_rng_seed(ria816_t* c, uint64_t seed) {
+    for (int i = 0; i < 4; i += 2) {
+        uint64_t z = (seed += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        z ^= z >> 31;
+        c->rng[i] = (uint32_t)z;
+        c->rng[i + 1] = (uint32_t)(z >> 32);
+    }
+}
+
 void ria816_init(ria816_t* c, const ria816_desc_t* desc) {
     CHIPS_ASSERT(c);
     memset(c, 0, sizeof(*c));
-    rb_init(&c->uart_rx);
-    rb_init(&c->uart_tx);
+    rb_init_size(&c->uart_rx, desc->uart_buffer_size);
+    rb_init_size(&c->uart_tx, desc->uart_buffer_size);
 
-    m6526_init(&c->cia);
+    c->timers.ta.underflow = RIA816_TIMER_IDLE;
+    c->timers.tb.underflow = RIA816_TIMER_IDLE;
+    c->timers.next_event = RIA816_TIMER_IDLE;
 
     c->ticks_per_ms = desc->tick_hz * RIA816_FIXEDPOINT_SCALE / 1000000;
-
-    // Seed the random number generator
-    srand((unsigned int)time(NULL));
+    c->dma_cb = desc->dma_cb;
+    c->api_cb = desc->api_cb;
+    c->fd_cb = desc->fd_cb;
+    c->user_data = desc->user_data;
+    c->api.sp = RIA816_API_STACK_SIZE;
+    c->api_latency = desc->api_latency;
+    c->reg[RIA816_MATH_CTRL] = RIA816_MATH_SIGNED_A;
+    _ria816_rng_seed(c, desc->rng_seed);
 }
 
 void ria816_reset(ria816_t* c) {
     CHIPS_ASSERT(c);
     c->pins = 0;
     c->us = 0;
-    rb_init(&c->uart_rx);
-    rb_init(&c->uart_tx);
-    m6526_reset(&c->cia);
+    rb_init_size(&c->uart_rx, c->uart_rx.size);
+    rb_init_size(&c->uart_tx, c->uart_tx.size);
+    memset(&c->timers, 0, sizeof(c->timers));
+    c->timers.ta.underflow = RIA816_TIMER_IDLE;
+    c->timers.tb.underflow = RIA816_TIMER_IDLE;
+    c->timers.next_event = RIA816_TIMER_IDLE;
+    ria816_api_zxstack(c);
+    c->api.busy_ticks = 0;
+    c->reg[RIA816_API_BUSY] = 0;
+    c->reg[RIA816_MATH_CTRL] = RIA816_MATH_SIGNED_A;
+    memset(&c->perf, 0, sizeof(c->perf));
+}
+
+uint16_t ria816_timer_counter(const ria816_t* c, const ria816_timer_t* t) {
+    if (t->underflow == RIA816_TIMER_IDLE) {
+        return t->counter;
+    }
+    // underflows are handled when due, so the counter can't have wrapped yet
+    return (uint16_t)(t->counter - (c->us - t->base));
+}
+
+/* timer B counting timer A underflows instead of microseconds (CNT is always high) */
+static inline bool _ria816_timer_b_cascaded(const ria816_timers_t* t) {
+    return M6526_TIMER_STARTED(t->tb.cr) && (M6526_TB_INMODE_TA(t->tb.cr) || M6526_TB_INMODE_TACNT(t->tb.cr));
+}
+
+static inline bool _ria816_timer_counts_us(const ria816_timers_t* t, const ria816_timer_t* timer) {
+    if (!M6526_TIMER_STARTED(timer->cr)) {
+        return false;
+    }
+    return (timer == &t->ta) ? M6526_TA_INMODE_PHI2(timer->cr) : M6526_TB_INMODE_PHI2(timer->cr);
+}
+
+/* (re)compute the next underflow from the counter value at the current time,
+   the counter passes 0 and underflows one microsecond later
+*/
+static void _ria816_timer_schedule(ria816_t* c, ria816_timer_t* t) {
+    t->base = c->us;
+    t->underflow = _ria816_timer_counts_us(&c->timers, t) ? c->us + t->counter + 1 : RIA816_TIMER_IDLE;
+    const uint64_t ta = c->timers.ta.underflow;
+    const uint64_t tb = c->timers.tb.underflow;
+    c->timers.next_event = (ta < tb) ? ta : tb;
+}
+
+/* take the current counter value as new base, before timer setup changes */
+static void _ria816_timer_sync(ria816_t* c, ria816_timer_t* t) {
+    t->counter = ria816_timer_counter(c, t);
+    t->base = c->us;
+}
+
+static void _ria816_timer_underflow(ria816_t* c, ria816_timer_t* t, uint64_t when, uint8_t icr_bit) {
+    c->timers.icr |= icr_bit;
+    if (c->timers.icr & c->timers.imr) {
+        c->timers.icr |= RIA816_TIMERS_ICR_IRQ;
+    }
+    t->counter = t->latch;
+    t->base = when;
+    if (M6526_RUNMODE_ONESHOT(t->cr)) {
+        t->cr &= ~(1 << 0);
+    }
+    t->underflow = _ria816_timer_counts_us(&c->timers, t) ? when + t->counter + 1 : RIA816_TIMER_IDLE;
+}
+
+/* handle the timer underflows which are due */
+static void _ria816_timers_update(ria816_t* c) {
+    ria816_timers_t* t = &c->timers;
+    while (t->next_event <= c->us) {
+        if (t->ta.underflow <= c->us) {
+            const uint64_t when = t->ta.underflow;
+            _ria816_timer_underflow(c, &t->ta, when, RIA816_TIMERS_ICR_TA);
+            if (_ria816_timer_b_cascaded(t)) {
+                if (t->tb.counter == 0) {
+                    _ria816_timer_underflow(c, &t->tb, when, RIA816_TIMERS_ICR_TB);
+                }
+                else {
+                    t->tb.counter--;
+                }
+            }
+        }
+        if (t->tb.underflow <= c->us) {
+            _ria816_timer_underflow(c, &t->tb, t->tb.underflow, RIA816_TIMERS_ICR_TB);
+        }
+        t->next_event = (t->ta.underflow < t->tb.underflow) ? t->ta.underflow : t->tb.underflow;
+    }
 }
 
 static uint64_t _ria816_tick(ria816_t* c, uint64_t pins) {
@@ -45,7 +141,9 @@ static uint64_t _ria816_tick(ria816_t* c, uint64_t pins) {
         c->us += 1;
         c->ticks_counter -= c->ticks_per_ms;
 
-        c->cia.pins = _m6526_tick(&c->cia, pins);
+        if (c->timers.next_event <= c->us) {
+            _ria816_timers_update(c);
+        }
     }
     return pins;
 }
@@ -63,6 +161,147 @@ uint8_t ria816_uart_status(const ria816_t* c) {
     return data;
 }
 
+void ria816_api_zxstack(ria816_t* c) {
+    c->api.sp = RIA816_API_STACK_SIZE;
+}
+
+uint16_t ria816_api_stack_len(const ria816_t* c) {
+    return RIA816_API_STACK_SIZE - c->api.sp;
+}
+
+uint8_t ria816_api_pop(ria816_t* c) {
+    return (c->api.sp < RIA816_API_STACK_SIZE) ? c->api.stack[c->api.sp++] : 0;
+}
+
+uint16_t ria816_api_pop16(ria816_t* c) {
+    const uint16_t lo = ria816_api_pop(c);
+    return lo | (uint16_t)(ria816_api_pop(c) << 8);
+}
+
+uint32_t ria816_api_pop24(ria816_t* c) {
+    const uint32_t lo = ria816_api_pop16(c);
+    return lo | ((uint32_t)ria816_api_pop(c) << 16);
+}
+
+uint32_t ria816_api_pop32(ria816_t* c) {
+    const uint32_t lo = ria816_api_pop16(c);
+    return lo | ((uint32_t)ria816_api_pop16(c) << 16);
+}
+
+bool ria816_api_push(ria816_t* c, uint8_t data) {
+    if (c->api.sp == 0) {
+        return false;
+    }
+    c->api.stack[--c->api.sp] = data;
+    return true;
+}
+
+bool ria816_api_push16(ria816_t* c, uint16_t data) {
+    return ria816_api_push(c, (uint8_t)(data >> 8)) && ria816_api_push(c, (uint8_t)data);
+}
+
+bool ria816_api_push32(ria816_t* c, uint32_t data) {
+    return ria816_api_push16(c, (uint16_t)(data >> 16)) && ria816_api_push16(c, (uint16_t)data);
+}
+
+static inline uint32_t _ria816_rotl(uint32_t x, int k) {
+    return (x << k) | (x >> (32 - k));
+}
+
+/* xoshiro128** by David Blackman and Sebastiano Vigna */
+uint32_t ria816_rand32(ria816_t* c) {
+    uint32_t* s = c->rng;
+    const uint32_t result = _ria816_rotl(s[1] * 5, 7) * 9;
+    const uint32_t t = s[1] << 9;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = _ria816_rotl(s[3], 11);
+    return result;
+}
+
+/* finish a kernel API call, makes result visible to the CPU */
+static void _ria816_api_done(ria816_t* c) {
+    c->reg[RIA816_API_ERRNO] = c->api.result;
+    c->reg[RIA816_API_BUSY] = 0;
+    c->api.busy_ticks = 0;
+}
+
+/* start a kernel API call, the call runs to completion right away
+   but stays busy for api_latency ticks
+*/
+static void _ria816_api_call(ria816_t* c, uint8_t op) {
+    if (c->reg[RIA816_API_BUSY] & RIA816_API_BUSY_FLAG) {
+        // operation already in progress
+        return;
+    }
+    if (op == RIA816_API_OP_ZXSTACK) {
+        ria816_api_zxstack(c);
+        c->api.result = RIA816_ERRNO_OK;
+    }
+    else if (c->api_cb) {
+        c->api.result = c->api_cb(op, c->user_data);
+    }
+    else {
+        c->api.result = RIA816_ERRNO_ENOSYS;
+    }
+    if (c->api_latency > 0) {
+        c->reg[RIA816_API_BUSY] = RIA816_API_BUSY_FLAG;
+        c->api.busy_ticks = c->api_latency;
+    }
+    else {
+        _ria816_api_done(c);
+    }
+}
+
+/* single byte access to the file opened as FDA/FDB */
+static uint8_t _ria816_fd_rw(ria816_t* c, uint8_t fd_reg, bool write, uint8_t data) {
+    const uint8_t err = c->fd_cb ? c->fd_cb(c->reg[fd_reg], write, &data, c->user_data) : RIA816_ERRNO_EBADF;
+    if (err != RIA816_ERRNO_OK) {
+        c->reg[RIA816_API_ERRNO] = err;
+        return write ? data : 0;
+    }
+    return data;
+}
+
+/* math operand, sign or zero extended according to RIA816_MATH_CTRL */
+static int64_t _ria816_math_oper(const ria816_t* c, uint8_t addr, uint8_t signed_bit) {
+    const uint16_t value = RIA816_REG16(c->reg, addr);
+    return (c->reg[RIA816_MATH_CTRL] & signed_bit) ? (int64_t)(int16_t)value : (int64_t)value;
+}
+
+static uint32_t _ria816_math_mul(const ria816_t* c) {
+    const int64_t a = _ria816_math_oper(c, RIA816_MATH_OPERA, RIA816_MATH_SIGNED_A);
+    const int64_t b = _ria816_math_oper(c, RIA816_MATH_OPERB, RIA816_MATH_SIGNED_B);
+    return (uint32_t)(a * b);
+}
+
+/* returns the 16-bit quotient, latch also updates remainder and overflow flag */
+static uint16_t _ria816_math_div(ria816_t* c, bool latch) {
+    const uint8_t ctrl = c->reg[RIA816_MATH_CTRL];
+    int64_t a;
+    if (ctrl & RIA816_MATH_DIV32) {
+        const uint32_t value = ((uint32_t)RIA816_REG16(c->reg, RIA816_MATH_HI) << 16)
+                               | RIA816_REG16(c->reg, RIA816_MATH_OPERA);
+        a = (ctrl & RIA816_MATH_SIGNED_A) ? (int64_t)(int32_t)value : (int64_t)value;
+    }
+    else {
+        a = _ria816_math_oper(c, RIA816_MATH_OPERA, RIA816_MATH_SIGNED_A);
+    }
+    const int64_t b = _ria816_math_oper(c, RIA816_MATH_OPERB, RIA816_MATH_SIGNED_B);
+    // quotient is signed if any operand is
+    const bool is_signed = ctrl & (RIA816_MATH_SIGNED_A | RIA816_MATH_SIGNED_B);
+    const int64_t q = b ? (a / b) : 0;
+    const bool overflow = !b || (is_signed ? (q < INT16_MIN || q > INT16_MAX) : (q > UINT16_MAX));
+    if (latch) {
+        c->math_hi = (uint16_t)(b ? (a % b) : a);
+        c->reg[RIA816_MATH_CTRL] = overflow ? (ctrl | RIA816_MATH_OVERFLOW) : (ctrl & ~RIA816_MATH_OVERFLOW);
+    }
+    return overflow ? 0xFFFF : (uint16_t)q;
+}
+
 static uint8_t _ria816_read(ria816_t* c, uint8_t addr) {
     uint8_t data = 0xFF;
 
@@ -70,17 +309,18 @@ static uint8_t _ria816_read(ria816_t* c, uint8_t addr) {
         // multiplication accelerator
         case RIA816_MATH_MULAB:
         case RIA816_MATH_MULAB + 1: {
-            uint16_t mul = RIA816_REG16(c->reg, RIA816_MATH_OPERA) * RIA816_REG16(c->reg, RIA816_MATH_OPERB);
-            data = (addr == RIA816_MATH_MULAB) ? (mul & 0xFF) : (mul >> 8);
+            const uint32_t mul = _ria816_math_mul(c);
+            if (addr == RIA816_MATH_MULAB) c->math_hi = (uint16_t)(mul >> 16);
+            data = (addr == RIA816_MATH_MULAB) ? (mul & 0xFF) : ((mul >> 8) & 0xFF);
         } break;
         // division accelerator
         case RIA816_MATH_DIVAB:
         case RIA816_MATH_DIVAB + 1: {
-            const int16_t oper_a = RIA816_REG16(c->reg, RIA816_MATH_OPERA);
-            const uint16_t oper_b = RIA816_REG16(c->reg, RIA816_MATH_OPERB);
-            uint16_t div = oper_b ? (oper_a / oper_b) : 0xFFFF;
+            const uint16_t div = _ria816_math_div(c, addr == RIA816_MATH_DIVAB);
             data = (addr == RIA816_MATH_DIVAB) ? (div & 0xFF) : (div >> 8);
         } break;
+        case RIA816_MATH_HI:
+        case RIA816_MATH_HI + 1: data = (uint8_t)(c->math_hi >> ((addr - RIA816_MATH_HI) * 8)); break;
 
         // Time Of Day
         case RIA816_TIME_TM:
@@ -98,20 +338,81 @@ static uint8_t _ria816_read(ria816_t* c, uint8_t addr) {
         case RIA816_UART_TX_RX: rb_get(&c->uart_rx, &data); break;
 
         case RIA816_HW_RNG:
-        case RIA816_HW_RNG + 1: data = (uint8_t)rand(); break;
+        case RIA816_HW_RNG + 1: data = (uint8_t)(ria816_rand32(c) >> 24); break;
 
         case RIA816_IRQ_STATUS: data = c->irq.status; break;
         case RIA816_IRQ_ENABLE: data = c->irq.enable; break;
 
+        case RIA816_PERF:
+            data = (c->perf.pos < sizeof(c->perf.latch)) ? c->perf.latch[c->perf.pos++] : 0;
+            break;
+
+        case RIA816_FS_FDARW: data = _ria816_fd_rw(c, RIA816_FS_FDA, false, 0); break;
+        case RIA816_FS_FDBRW: data = _ria816_fd_rw(c, RIA816_FS_FDB, false, 0); break;
+        case RIA816_API_STACK: data = ria816_api_pop(c); break;
+
         default: data = c->reg[addr];
     }
     return data;
 }
 
+static void _ria816_set_reg24(ria816_t* c, uint8_t addr, uint32_t value) {
+    c->reg[addr] = (uint8_t)value;
+    c->reg[addr + 1] = (uint8_t)(value >> 8);
+    c->reg[addr + 2] = (uint8_t)(value >> 16);
+}
+
+/* run a DMA transfer through the system callback */
+static void _ria816_dma(ria816_t* c) {
+    if (!c->dma_cb) {
+        return;
+    }
+    const uint8_t count = c->reg[RIA816_DMA_COUNT];
+    const ria816_dma_t dma = {
+        .src = RIA816_REG24(c->reg, RIA816_DMA_ADDRSRC),
+        .src_step = (int8_t)c->reg[RIA816_DMA_STEPSRC],
+        .dst = RIA816_REG24(c->reg, RIA816_DMA_ADDRDST),
+        .dst_step = (int8_t)c->reg[RIA816_DMA_STEPDST],
+        .count = count ? count : 256,
+    };
+    c->reg[RIA816_DMA_DMAERR] = c->dma_cb(&dma, c->user_data);
+    if (c->reg[RIA816_DMA_DMAERR] == RIA816_DMA_OK) {
+        // leave address registers pointing past the transfer, so transfers can be chained
+        _ria816_set_reg24(c, RIA816_DMA_ADDRSRC, dma.src + (uint32_t)(dma.src_step * dma.count));
+        _ria816_set_reg24(c, RIA816_DMA_ADDRDST, dma.dst + (uint32_t)(dma.dst_step * dma.count));
+    }
+}
+
+/* snapshot all counters, so multi-byte values read consistently */
+static void _ria816_perf_latch(ria816_t* c, uint8_t index) {
+    for (int i = 0; i < RIA816_PERF_NUM_COUNTERS; i++) {
+        for (int b = 0; b < RIA816_PERF_COUNTER_SIZE; b++) {
+            c->perf.latch[i * RIA816_PERF_COUNTER_SIZE + b] = (uint8_t)(c->perf.counter[i] >> (b * 8));
+        }
+    }
+    c->perf.pos = (index < RIA816_PERF_NUM_COUNTERS) ? index * RIA816_PERF_COUNTER_SIZE : sizeof(c->perf.latch);
+}
+
 static void _ria816_write(ria816_t* c, uint8_t addr, uint8_t data) {
     switch (addr) {
         case RIA816_UART_TX_RX: rb_put(&c->uart_tx, data); break;
 
+        case RIA816_MATH_CTRL: c->reg[addr] = data & ~RIA816_MATH_OVERFLOW; break;
+        case RIA816_PERF: _ria816_perf_latch(c, data); break;
+
+        case RIA816_DMA_COUNT:
+            c->reg[addr] = data;
+            _ria816_dma(c);
+            break;
+
+        case RIA816_FS_FDARW: _ria816_fd_rw(c, RIA816_FS_FDA, true, data); break;
+        case RIA816_FS_FDBRW: _ria816_fd_rw(c, RIA816_FS_FDB, true, data); break;
+        case RIA816_API_STACK: ria816_api_push(c, data); break;
+        case RIA816_API_OP:
+            c->reg[addr] = data;
+            _ria816_api_call(c, data);
+            break;
+
         case RIA816_IRQ_STATUS:
             c->irq.interrupt = false;
             c->irq.status = 0;
@@ -122,6 +423,68 @@ static void _ria816_write(ria816_t* c, uint8_t addr, uint8_t data) {
     }
 }
 
+static uint8_t _ria816_timers_read(ria816_t* c, uint8_t addr) {
+    uint8_t data = 0xFF;
+    switch (addr) {
+        case RIA816_TIMERS_TALO: data = (uint8_t)ria816_timer_counter(c, &c->timers.ta); break;
+        case RIA816_TIMERS_TAHI: data = (uint8_t)(ria816_timer_counter(c, &c->timers.ta) >> 8); break;
+        case RIA816_TIMERS_TBLO: data = (uint8_t)ria816_timer_counter(c, &c->timers.tb); break;
+        case RIA816_TIMERS_TBHI: data = (uint8_t)(ria816_timer_counter(c, &c->timers.tb) >> 8); break;
+        case RIA816_TIMERS_ICR:
+            // reading clears the interrupt
+            data = c->timers.icr;
+            c->timers.icr = 0;
+            break;
+        case RIA816_TIMERS_CRA: data = c->timers.ta.cr; break;
+        case RIA816_TIMERS_CRB: data = c->timers.tb.cr; break;
+    }
+    return data;
+}
+
+static void _ria816_timers_write_latch_hi(ria816_t* c, ria816_timer_t* t, uint8_t data) {
+    t->latch = (uint16_t)((data << 8) | (t->latch & 0x00FF));
+    // if timer is not running, writing hi-byte loads counter from latch
+    if (!M6526_TIMER_STARTED(t->cr)) {
+        t->counter = t->latch;
+        t->base = c->us;
+    }
+}
+
+static void _ria816_timers_write_cr(ria816_t* c, ria816_timer_t* t, uint8_t data) {
+    _ria816_timer_sync(c, t);
+    if (M6526_FORCE_LOAD(data)) {
+        t->counter = t->latch;
+    }
+    // force-load is a strobe, it always reads back as zero
+    t->cr = data & ~(1 << 4);
+    _ria816_timer_schedule(c, t);
+}
+
+static void _ria816_timers_write(ria816_t* c, uint8_t addr, uint8_t data) {
+    ria816_timers_t* t = &c->timers;
+    switch (addr) {
+        case RIA816_TIMERS_TALO: t->ta.latch = (t->ta.latch & 0xFF00) | data; break;
+        case RIA816_TIMERS_TAHI: _ria816_timers_write_latch_hi(c, &t->ta, data); break;
+        case RIA816_TIMERS_TBLO: t->tb.latch = (t->tb.latch & 0xFF00) | data; break;
+        case RIA816_TIMERS_TBHI: _ria816_timers_write_latch_hi(c, &t->tb, data); break;
+        case RIA816_TIMERS_ICR:
+            // bit 7 selects whether the mask bits written as 1 are set or cleared
+            if (data & (1 << 7)) {
+                t->imr |= (data & 0x1F);
+            }
+            else {
+                t->imr &= ~(data & 0x1F);
+            }
+            // unmasking a pending condition raises the interrupt, masking does not clear it
+            if (t->icr & t->imr) {
+                t->icr |= RIA816_TIMERS_ICR_IRQ;
+            }
+            break;
+        case RIA816_TIMERS_CRA: _ria816_timers_write_cr(c, &t->ta, data); break;
+        case RIA816_TIMERS_CRB: _ria816_timers_write_cr(c, &t->tb, data); break;
+    }
+}
+
 static uint64_t _ria816_update_irq(ria816_t* c, uint64_t pins) {
     uint8_t ints = RIA816_GET_INTS(pins) & c->irq.enable;
 
@@ -137,6 +500,13 @@ static uint64_t _ria816_update_irq(ria816_t* c, uint64_t pins) {
 
 uint64_t ria816_tick(ria816_t* c, uint64_t pins) {
     pins = _ria816_tick(c, pins);
+    c->perf.counter[RIA816_PERF_CYCLES]++;
+    if (pins & (RIA816_SYNC | RIA816_INTACK)) {
+        c->perf.counter[(pins & RIA816_SYNC) ? RIA816_PERF_INSTRUCTIONS : RIA816_PERF_IRQS]++;
+    }
+    if (c->api.busy_ticks > 0 && --c->api.busy_ticks == 0) {
+        _ria816_api_done(c);
+    }
     if (pins & RIA816_CS) {
         uint8_t addr = pins & RIA816_RS;
         if (pins & RIA816_RW) {
@@ -149,22 +519,36 @@ uint64_t ria816_tick(ria816_t* c, uint64_t pins) {
         }
     }
     if (pins & RIA816_TIMERS_CS) {
-        // CIA timers emulation
-        uint8_t addr = pins & M6526_RS;
-        if (addr < M6526_REG_ICR) addr -= 4;
-        if (pins & M6526_RW) {
-            uint8_t data = _m6526_read(&c->cia, addr);
-            M6526_SET_DATA(pins, data);
+        uint8_t addr = pins & (RIA816_TIMERS_NUM_REGS - 1);
+        if (pins & RIA816_RW) {
+            uint8_t data = _ria816_timers_read(c, addr);
+            RIA816_SET_DATA(pins, data);
         }
         else {
-            uint8_t data = M6526_GET_DATA(pins);
-            _m6526_write(&c->cia, addr, data);
+            uint8_t data = RIA816_GET_DATA(pins);
+            _ria816_timers_write(c, addr, data);
         }
     }
 
-    if (c->cia.pins & M6526_IRQ) pins |= RIA816_INT0;
+    if (c->timers.icr & RIA816_TIMERS_ICR_IRQ) pins |= RIA816_INT0;
     pins = _ria816_update_irq(c, pins);
 
     c->pins = pins;
     return pins;
 }
+
+void ria816_snapshot_onsave(ria816_t* snapshot) {
+    CHIPS_ASSERT(snapshot);
+    snapshot->dma_cb = 0;
+    snapshot->api_cb = 0;
+    snapshot->fd_cb = 0;
+    snapshot->user_data = 0;
+}
+
+void ria816_snapshot_onload(ria816_t* snapshot, ria816_t* sys) {
+    CHIPS_ASSERT(snapshot && sys);
+    snapshot->dma_cb = sys->dma_cb;
+    snapshot->api_cb = sys->api_cb;
+    snapshot->fd_cb = sys->fd_cb;
+    snapshot->user_data = sys->user_data;
+}
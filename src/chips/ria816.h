@@ -52,6 +52,87 @@
     ria816_reset(&sys->ria);
     ~~~
 
+    ## DMA
+
+    The RIA has no access to system memory on its own. Writing the
+    RIA816_DMA_COUNT register (0 means 256) starts a transfer, which is
+    handed to the system through the dma_cb callback. On return the
+    source and destination address registers are advanced past the
+    transferred bytes, and RIA816_DMA_DMAERR holds the error code
+    returned by the callback.
+
+    ## Kernel API calls
+
+    Call parameters are pushed to RIA816_API_STACK (512 bytes, writes
+    push, reads pop), then the operation id is written to RIA816_API_OP.
+    Multi-byte values are pushed high byte first, so they lie in memory
+    little-endian, strings are pushed last character first. Operations
+    other than RIA816_API_OP_ZXSTACK are handed to the system through the
+    api_cb callback, which pops the parameters and leaves its results on
+    the stack, RIA816_API_ERRNO is set to the returned RIA816_ERRNO_* code.
+    The call itself is executed at once, but with a non-zero api_latency
+    RIA816_API_BUSY reads RIA816_API_BUSY_FLAG and API_ERRNO is updated
+    only after that many ticks, emulating the firmware's response time.
+    API_OP writes while busy are ignored.
+
+    - OPEN: flags (cc65 O_* values), path (rest of stack) -> fd (16 bit)
+    - CLOSE: fd -> 0 (16 bit)
+    - READ_STACK: fd, count (16 bit, max 512) -> bytes read (16 bit), data
+    - READ_RAM: fd, count (16 bit), address (24 bit) -> bytes read (16 bit)
+    - WRITE_STACK: fd, data (rest of stack) -> bytes written (16 bit)
+    - WRITE_RAM: fd, count (16 bit), address (24 bit) -> bytes written (16 bit)
+    - LSEEK: fd, whence, offset (32 bit) -> new offset (32 bit)
+    - LRAND: -> random number (32 bit)
+    - CLOCK: -> time since reset in RIA816_CLOCKS_PER_SEC units (32 bit)
+    - CLOCK_GETTIME: clock id (0: realtime, 1: monotonic) -> seconds (32 bit), nanoseconds (32 bit)
+    - MEMSET: address (24 bit), value, count (16 bit) -> 0 (16 bit)
+    - MEMCPY: destination (24 bit), source (24 bit), count (16 bit) -> 0 (16 bit)
+
+    Parameters are listed in the order they are popped (push them in
+    reverse), failing calls return -1. RIA816_FS_FDARW and RIA816_FS_FDBRW
+    read and write single bytes of the files opened as RIA816_FS_FDA and
+    RIA816_FS_FDB, through the fd_cb callback.
+
+    ## Math accelerator
+
+    MULAB and DIVAB are computed from OPERA and OPERB when read. Reading
+    the low byte of MULAB latches the high word of the 32-bit product
+    into RIA816_MATH_HI, reading the low byte of DIVAB latches the
+    remainder there, so a full result takes one more 16-bit read.
+    RIA816_MATH_CTRL selects signed or unsigned operands, by default OPERA
+    is signed and OPERB is unsigned. With RIA816_MATH_DIV32 set the
+    dividend is the 32-bit value made of the word written to
+    RIA816_MATH_HI and OPERA. Quotients which don't fit into 16 bits
+    and divisions by zero set RIA816_MATH_OVERFLOW and read 0xFFFF.
+    Remainders take the sign of the dividend.
+
+    ## Performance counters
+
+    The RIA counts CPU cycles (one per ria816_tick() call), executed
+    instructions (RIA816_SYNC input pin) and interrupts taken
+    (RIA816_INTACK input pin) since reset. Writing a RIA816_PERF_*
+    counter index to RIA816_PERF copies all counters at once, after that
+    reading RIA816_PERF returns the selected counter as 48-bit value low
+    byte first, followed by the following counters. Cycle counts match
+    the ticks reported by the debugger.
+
+    ## Random numbers
+
+    RIA816_HW_RNG and the LRAND API call read a xoshiro128** generator
+    which is part of the ria816_t state, seeded from ria816_desc_t.rng_seed.
+    Equal seeds give equal sequences and snapshots restore the sequence,
+    so runs can be replayed exactly.
+
+    ## Timers
+
+    The RIA816_TIMERS_CS window holds two m6526 compatible 16-bit timers
+    counting at 1 MHz (timer B may also count timer A underflows), their
+    interrupt sets RIA816_INT0 until the ICR is read. The timers are not
+    stepped, instead the microsecond of the next underflow is computed
+    whenever a timer is loaded or started, and the counters are derived
+    from the elapsed time when read. The I/O ports, TOD clock, serial
+    register and the CNT and PB6/PB7 pins are not connected.
+
 */
 #include <stdint.h>
 #include <stdbool.h>
@@ -99,6 +180,10 @@ extern "C" {
 #define RIA816_PIN_INT6 (54)
 #define RIA816_PIN_INT_ (55)  // cannot be used with MCP23008
 
+// CPU activity inputs for the performance counters
+#define RIA816_PIN_SYNC   (56)  // CPU fetched an instruction opcode
+#define RIA816_PIN_INTACK (57)  // CPU started an IRQ or NMI sequence
+
 // pin bit masks
 #define RIA816_RS0       (1ULL << RIA816_PIN_RS0)
 #define RIA816_RS1       (1ULL << RIA816_PIN_RS1)
@@ -128,13 +213,16 @@ extern "C" {
 #define RIA816_INT4      (1ULL << RIA816_PIN_INT4)
 #define RIA816_INT5      (1ULL << RIA816_PIN_INT5)
 #define RIA816_INT6      (1ULL << RIA816_PIN_INT6)
+#define RIA816_SYNC      (1ULL << RIA816_PIN_SYNC)
+#define RIA816_INTACK    (1ULL << RIA816_PIN_INTACK)
 
 // register indices
 #define RIA816_MATH_OPERA     (0x00)  // Operand A for multiplication and division.
 #define RIA816_MATH_OPERB     (0x02)  // Operand B for multiplication and division.
 #define RIA816_MATH_MULAB     (0x04)  // OPERA * OPERB.
-#define RIA816_MATH_DIVAB     (0x06)  // Signed OPERA / unsigned OPERB.
+#define RIA816_MATH_DIVAB     (0x06)  // OPERA / OPERB quotient.
 #define RIA816_TIME_TM        (0x08)  // Time Of Day (ms) - 48bits (6 bytes)
+#define RIA816_MATH_HI        (0x0E)  // Read: product high word or remainder. Write: dividend high word.
 #define RIA816_DMA_ADDRSRC    (0x10)  // DMA source address.
 #define RIA816_DMA_STEPSRC    (0x13)  // DMA source step.
 #define RIA816_DMA_ADDRDST    (0x14)  // DMA destination address.
@@ -145,6 +233,8 @@ extern "C" {
 #define RIA816_FS_FDARW       (0x1B)  // Read bytes from the FDA. Write bytes to the FDA.
 #define RIA816_FS_FDB         (0x1C)  // File-descriptor B number.
 #define RIA816_FS_FDBRW       (0x1D)  // Read bytes from the FDB. Write bytes to the FDB.
+#define RIA816_MATH_CTRL      (0x1E)  // Math accelerator operand signedness and divide width.
+#define RIA816_PERF           (0x1F)  // Write: counter index to latch all counters. Read: latched counter bytes.
 #define RIA816_UART_READY     (0x20)  // Flow control for UART FIFO.
 #define RIA816_UART_TX_RX     (0x21)  // Write bytes to the UART. Read bytes from the UART.
 #define RIA816_HW_RNG         (0x22)  // Random Number Generator.
@@ -168,6 +258,85 @@ extern "C" {
 #define RIA816_CPU_E_IRQB_BRK (0x3E)  // 6502 vector.
 #define RIA816_NUM_REGS       (64)
 
+// timer register indices in the RIA816_TIMERS_CS window (m6526 registers 8..15)
+#define RIA816_TIMERS_TALO     (0x00)  // Timer A latch low byte. Timer A counter low byte.
+#define RIA816_TIMERS_TAHI     (0x01)  // Timer A latch high byte. Timer A counter high byte.
+#define RIA816_TIMERS_TBLO     (0x02)  // Timer B latch low byte. Timer B counter low byte.
+#define RIA816_TIMERS_TBHI     (0x03)  // Timer B latch high byte. Timer B counter high byte.
+#define RIA816_TIMERS_ICR      (0x05)  // Interrupt control register.
+#define RIA816_TIMERS_CRA      (0x06)  // Timer A control register.
+#define RIA816_TIMERS_CRB      (0x07)  // Timer B control register.
+#define RIA816_TIMERS_NUM_REGS (8)
+
+// timer interrupt control register bits
+#define RIA816_TIMERS_ICR_TA  (1 << 0)  // timer A underflow
+#define RIA816_TIMERS_ICR_TB  (1 << 1)  // timer B underflow
+#define RIA816_TIMERS_ICR_IRQ (1 << 7)  // interrupt requested
+
+// underflow time of a timer which does not count microseconds
+#define RIA816_TIMER_IDLE (UINT64_MAX)
+
+// math accelerator control bits
+#define RIA816_MATH_SIGNED_A (1 << 0)  // OPERA (and the 32-bit dividend) is signed, set after reset
+#define RIA816_MATH_SIGNED_B (1 << 1)  // OPERB is signed
+#define RIA816_MATH_DIV32    (1 << 2)  // divide MATH_HI:OPERA instead of OPERA
+#define RIA816_MATH_OVERFLOW (1 << 7)  // read-only: last quotient didn't fit in 16 bits, or division by zero
+
+// performance counters, each is latched as 48 bits
+#define RIA816_PERF_CYCLES       (0)  // CPU cycles since reset
+#define RIA816_PERF_INSTRUCTIONS (1)  // instructions executed since reset
+#define RIA816_PERF_IRQS         (2)  // IRQs and NMIs taken since reset
+#define RIA816_PERF_NUM_COUNTERS (3)
+#define RIA816_PERF_COUNTER_SIZE (6)
+
+// DMA error codes
+#define RIA816_DMA_OK        (0)  // transfer completed
+#define RIA816_DMA_ERR_RANGE (1)  // transfer wraps around the 24-bit address space
+#define RIA816_DMA_ERR_IO    (2)  // transfer touches registers which can't be reached by DMA
+
+// kernel API operations
+#define RIA816_API_OP_ZXSTACK       (0x00)  // clear API stack
+#define RIA816_API_OP_LRAND         (0x05)
+#define RIA816_API_OP_CLOCK         (0x0D)
+#define RIA816_API_OP_CLOCK_GETTIME (0x0F)
+#define RIA816_API_OP_OPEN          (0x14)
+#define RIA816_API_OP_CLOSE         (0x15)
+#define RIA816_API_OP_READ_STACK    (0x16)
+#define RIA816_API_OP_READ_RAM      (0x17)
+#define RIA816_API_OP_WRITE_STACK   (0x18)
+#define RIA816_API_OP_WRITE_RAM     (0x19)
+#define RIA816_API_OP_LSEEK         (0x1A)
+#define RIA816_API_OP_MEMSET        (0x20)
+#define RIA816_API_OP_MEMCPY        (0x21)
+#define RIA816_API_NUM_OPS          (256)
+
+#define RIA816_API_BUSY_FLAG   (1 << 7)
+#define RIA816_CLOCKS_PER_SEC  (100)
+
+#define RIA816_API_STACK_SIZE  (512)
+
+// API error numbers, same values as cc65's errno.h
+#define RIA816_ERRNO_OK       (0)
+#define RIA816_ERRNO_ENOENT   (1)
+#define RIA816_ERRNO_ENOMEM   (2)
+#define RIA816_ERRNO_EACCES   (3)
+#define RIA816_ERRNO_ENODEV   (4)
+#define RIA816_ERRNO_EMFILE   (5)
+#define RIA816_ERRNO_EBUSY    (6)
+#define RIA816_ERRNO_EINVAL   (7)
+#define RIA816_ERRNO_ENOSPC   (8)
+#define RIA816_ERRNO_EEXIST   (9)
+#define RIA816_ERRNO_EAGAIN   (10)
+#define RIA816_ERRNO_EIO      (11)
+#define RIA816_ERRNO_EINTR    (12)
+#define RIA816_ERRNO_ENOSYS   (13)
+#define RIA816_ERRNO_ESPIPE   (14)
+#define RIA816_ERRNO_ERANGE   (15)
+#define RIA816_ERRNO_EBADF    (16)
+#define RIA816_ERRNO_ENOEXEC  (17)
+#define RIA816_ERRNO_EUNKNOWN (18)
+#define RIA816_ERRNO_EOF      (0xFF)  // FDARW/FDBRW read past end of file
+
 typedef struct {
     uint8_t pins;
     uint8_t enable;
@@ -175,10 +344,57 @@ typedef struct {
     bool interrupt;
 } ria816_interrupt_t;
 
+// timer state, the counter is only up to date at the base time
+typedef struct {
+    uint16_t latch;      // 16-bit initial value latch
+    uint16_t counter;    // 16-bit counter value at base time
+    uint8_t cr;          // control register, same bits as m6526
+    uint64_t base;       // monotonic clock time the counter was loaded
+    uint64_t underflow;  // monotonic clock time of the next underflow, or RIA816_TIMER_IDLE
+} ria816_timer_t;
+
+typedef struct {
+    ria816_timer_t ta;
+    ria816_timer_t tb;
+    uint8_t icr;          // interrupt control register
+    uint8_t imr;          // interrupt mask
+    uint64_t next_event;  // earliest underflow of both timers
+} ria816_timers_t;
+
+// DMA transfer request
+typedef struct {
+    uint32_t src;     // 24-bit source address
+    int8_t src_step;  // source address increment after each byte
+    uint32_t dst;     // 24-bit destination address
+    int8_t dst_step;  // destination address increment after each byte
+    uint16_t count;   // number of bytes to transfer (1..256)
+} ria816_dma_t;
+
+// DMA transfer callback, performs the transfer and returns RIA816_DMA_* error code
+typedef uint8_t (*ria816_dma_cb_t)(const ria816_dma_t* dma, void* user_data);
+// kernel API call callback, returns RIA816_ERRNO_* code
+typedef uint8_t (*ria816_api_cb_t)(uint8_t op, void* user_data);
+// single byte file access through FDARW/FDBRW, returns RIA816_ERRNO_* code
+typedef uint8_t (*ria816_fd_cb_t)(uint8_t fd, bool write, uint8_t* data, void* user_data);
+
 // the ria816 setup parameters
 typedef struct {
     // the CPU tick rate in hz
     int tick_hz;
+    // DMA transfer callback
+    ria816_dma_cb_t dma_cb;
+    // kernel API call callback
+    ria816_api_cb_t api_cb;
+    // file byte access callback
+    ria816_fd_cb_t fd_cb;
+    // number of ticks a kernel API call keeps RIA816_API_BUSY set
+    uint32_t api_latency;
+    // capacity of the UART FIFOs (default RB_BUFFER_SIZE, max RB_MAX_BUFFER_SIZE)
+    int uart_buffer_size;
+    // random number generator seed, equal seeds give equal RIA816_HW_RNG sequences
+    uint64_t rng_seed;
+    // optional user-data for the callbacks
+    void* user_data;
 } ria816_desc_t;
 
 // ria816 state
@@ -186,12 +402,30 @@ typedef struct {
     uint8_t reg[RIA816_NUM_REGS];
     ring_buffer_t uart_rx;
     ring_buffer_t uart_tx;
-    m6526_t cia;
+    ria816_timers_t timers;
+    uint32_t rng[4];   // xoshiro128** random number generator state
+    uint16_t math_hi;  // latched product high word or remainder
+    struct {
+        uint64_t counter[RIA816_PERF_NUM_COUNTERS];
+        uint8_t latch[RIA816_PERF_NUM_COUNTERS * RIA816_PERF_COUNTER_SIZE];
+        uint8_t pos;  // next byte read from RIA816_PERF
+    } perf;
     ria816_interrupt_t irq;
     uint64_t us;  // monotonic clock
     int ticks_per_ms;
     int ticks_counter;
     uint64_t pins;
+    struct {
+        uint8_t stack[RIA816_API_STACK_SIZE];
+        uint16_t sp;          // stack grows down, RIA816_API_STACK_SIZE when empty
+        uint8_t result;       // errno of running call
+        uint32_t busy_ticks;  // ticks until running call completes
+    } api;
+    uint32_t api_latency;
+    ria816_dma_cb_t dma_cb;
+    ria816_api_cb_t api_cb;
+    ria816_fd_cb_t fd_cb;
+    void* user_data;
 } ria816_t;
 
 // extract 8-bit data bus from 64-bit pins
@@ -204,6 +438,8 @@ typedef struct {
 #define RIA816_GET_INTS(p) ((uint8_t)((p) >> 48))
 
 #define RIA816_REG16(regs, ADDR) (uint16_t)((uint16_t)(regs[ADDR]) | ((uint16_t)(regs[ADDR + 1]) << 8))
+#define RIA816_REG24(regs, ADDR) \
+    (uint32_t)((uint32_t)(regs[ADDR]) | ((uint32_t)(regs[ADDR + 1]) << 8) | ((uint32_t)(regs[ADDR + 2]) << 16))
 
 // initialize a new RIA816 instance
 void ria816_init(ria816_t* ria816, const ria816_desc_t* desc);
@@ -211,8 +447,31 @@ void ria816_init(ria816_t* ria816, const ria816_desc_t* desc);
 void ria816_reset(ria816_t* ria816);
 // tick the RIA816
 uint64_t ria816_tick(ria816_t* ria816, uint64_t pins);
+// prepare ria816_t snapshot for saving
+void ria816_snapshot_onsave(ria816_t* snapshot);
+// fixup ria816_t snapshot after loading
+void ria816_snapshot_onload(ria816_t* snapshot, ria816_t* sys);
 
 uint8_t ria816_uart_status(const ria816_t* c);
+// current value of a timer counter
+uint16_t ria816_timer_counter(const ria816_t* c, const ria816_timer_t* t);
+
+// ---- API stack access for kernel call implementations ----
+// clear the API stack
+void ria816_api_zxstack(ria816_t* c);
+// number of bytes on the API stack
+uint16_t ria816_api_stack_len(const ria816_t* c);
+// pop values from API stack, return 0 if stack is empty
+uint8_t ria816_api_pop(ria816_t* c);
+uint16_t ria816_api_pop16(ria816_t* c);
+uint32_t ria816_api_pop24(ria816_t* c);
+uint32_t ria816_api_pop32(ria816_t* c);
+// next 32 bits of the RIA random number generator
+uint32_t ria816_rand32(ria816_t* c);
+// push values to API stack, return false if stack is full
+bool ria816_api_push(ria816_t* c, uint8_t data);
+bool ria816_api_push16(ria816_t* c, uint16_t data);
+bool ria816_api_push32(ria816_t* c, uint32_t data);
 
 #ifdef __cplusplus
 }  // extern "C"
@@ -1,21 +1,71 @@
 #include "./ymf262.h"
 
 #include <string.h>
+#include <stdlib.h>
 #ifndef CHIPS_ASSERT
     #include <assert.h>
     #define CHIPS_ASSERT(c) assert(c)
 #endif
+#if !defined(__EMSCRIPTEN__)
+    #define _YMF262_USE_THREADS
+    #include <stdatomic.h>
+    #include <pthread.h>
+    #include <time.h>
+#endif
+
+#define _YMF262_DEFAULT_LATENCY (1024)
+#define _YMF262_QUEUE_SIZE      (16384)   // register write queue entries
+#define _YMF262_RING_FRAMES     (8192)    // rendered sample frames ring buffer size
+#define _YMF262_CMD_RESET       (0xFFFF)  // queued pseudo register: reset chip
+#define _YMF262_CMD_LOAD        (0xFFFE)  // queued pseudo register: take over the loaded chip state
+
+#if defined(_YMF262_USE_THREADS)
+static ymf262_worker_t* _ymf262_worker_start(const ymf262_t* ymf, int latency);
+static void _ymf262_worker_stop(ymf262_worker_t* w);
+static void _ymf262_worker_push(ymf262_worker_t* w, uint64_t sample, uint16_t reg, uint8_t data);
+static void _ymf262_worker_publish(ymf262_worker_t* w, uint64_t sample_index);
+static void _ymf262_worker_load(ymf262_worker_t* w, const ymf262_t* ymf);
+#endif
+
+static void _ymf262_timers_reset(ymf262_t* ymf) {
+    ymf->status = 0;
+    ymf->timer_ctrl = 0;
+    for (int t = 0; t < YMF262_NUM_TIMERS; t++) {
+        ymf->timer[t].value = 0;
+        ymf->timer[t].expire_at = 0;
+        ymf->timer[t].expire_tick = YMF262_TIMER_STOPPED;
+    }
+    ymf->timer_event_tick = YMF262_TIMER_STOPPED;
+}
 
 void ymf262_init(ymf262_t* ymf, const ymf262_desc_t* desc) {
     CHIPS_ASSERT(ymf && desc);
     CHIPS_ASSERT(desc->tick_hz > 0);
     CHIPS_ASSERT(desc->sound_hz > 0);
     memset(ymf, 0, sizeof(*ymf));
+    ymf->tick_hz = desc->tick_hz;
     ymf->sound_hz = desc->sound_hz;
     ymf->sample_period = (desc->tick_hz * YMF262_FIXEDPOINT_SCALE) / desc->sound_hz;
     ymf->sample_counter = ymf->sample_period;
     ymf->resampler.rateratio = (desc->sound_hz << YMF262_RESAMPLER_FRAC) / YMF262_SAMPLE_RATE;
     ESFM_init(&ymf->chip);
+    _ymf262_timers_reset(ymf);
+#if defined(_YMF262_USE_THREADS)
+    if (desc->threaded) {
+        // on failure just keep generating samples on the calling thread
+        ymf->worker = _ymf262_worker_start(ymf, desc->latency > 0 ? desc->latency : _YMF262_DEFAULT_LATENCY);
+    }
+#endif
+}
+
+void ymf262_discard(ymf262_t* ymf) {
+    CHIPS_ASSERT(ymf);
+#if defined(_YMF262_USE_THREADS)
+    if (ymf->worker) {
+        _ymf262_worker_stop(ymf->worker);
+        ymf->worker = 0;
+    }
+#endif
 }
 
 void ymf262_reset(ymf262_t* ymf) {
@@ -24,6 +74,39 @@ void ymf262_reset(ymf262_t* ymf) {
     ymf->addr[1] = 0;
     ESFM_init(&ymf->chip);
     ymf->resampler.samplecnt = 0;
+    _ymf262_timers_reset(ymf);
+#if defined(_YMF262_USE_THREADS)
+    if (ymf->worker) {
+        _ymf262_worker_push(ymf->worker, ymf->sample_index, _YMF262_CMD_RESET, 0);
+    }
+#endif
+}
+
+/* generate a new output sample into ymf->samples */
+static void _ymf262_generate(ymf262_t* ymf) {
+    // spin OPL3 chip in its own rate
+    // until we have two samples we can linearly (I know… bad for audio)
+    // interpolate the sample in our requested audio rate
+    while (ymf->resampler.samplecnt >= ymf->resampler.rateratio) {
+        ymf->resampler.oldsamples[0] = ymf->resampler.samples[0];
+        ymf->resampler.oldsamples[1] = ymf->resampler.samples[1];
+        ESFM_generate(&ymf->chip, ymf->resampler.samples);
+        ymf->resampler.samplecnt -= ymf->resampler.rateratio;
+    }
+    ymf->resampler.samplecnt += 1 << YMF262_RESAMPLER_FRAC;
+
+    float sample_0 =
+        ((float)(ymf->resampler.oldsamples[0] * (ymf->resampler.rateratio - ymf->resampler.samplecnt)
+                 + ymf->resampler.samples[0] * ymf->resampler.samplecnt)
+         / (float)ymf->resampler.rateratio);
+    float sample_1 =
+        ((float)(ymf->resampler.oldsamples[1] * (ymf->resampler.rateratio - ymf->resampler.samplecnt)
+                 + ymf->resampler.samples[1] * ymf->resampler.samplecnt)
+         / (float)ymf->resampler.rateratio);
+
+    // convert uint16_t range to float in range -1.0f to 1.0f
+    ymf->samples[0] = sample_0 < 0 ? sample_0 / 32768.0f : sample_0 / 32767.0f;
+    ymf->samples[1] = sample_1 < 0 ? sample_1 / 32768.0f : sample_1 / 32767.0f;
 }
 
 /* tick the sound generation, return true when new sample ready */
@@ -32,44 +115,92 @@ static bool _ymf262_tick(ymf262_t* ymf) {
     ymf->sample_counter -= YMF262_FIXEDPOINT_SCALE;
     if (ymf->sample_counter <= 0) {
         ymf->sample_counter += ymf->sample_period;
-
-        // spin OPL3 chip in its own rate
-        // until we have two samples we can linearly (I know… bad for audio)
-        // interpolate the sample in our requested audio rate
-        while (ymf->resampler.samplecnt >= ymf->resampler.rateratio) {
-            ymf->resampler.oldsamples[0] = ymf->resampler.samples[0];
-            ymf->resampler.oldsamples[1] = ymf->resampler.samples[1];
-            ESFM_generate(&ymf->chip, ymf->resampler.samples);
-            ymf->resampler.samplecnt -= ymf->resampler.rateratio;
+        ymf->sample_index++;
+#if defined(_YMF262_USE_THREADS)
+        if (ymf->worker) {
+            // let the worker render up to the current sample
+            _ymf262_worker_publish(ymf->worker, ymf->sample_index);
+            return true;
+        }
+#endif
+        if (!ymf->muted) {
+            _ymf262_generate(ymf);
         }
-        ymf->resampler.samplecnt += 1 << YMF262_RESAMPLER_FRAC;
-
-        float sample_0 =
-            ((float)(ymf->resampler.oldsamples[0] * (ymf->resampler.rateratio - ymf->resampler.samplecnt)
-                     + ymf->resampler.samples[0] * ymf->resampler.samplecnt)
-             / (float)ymf->resampler.rateratio);
-        float sample_1 =
-            ((float)(ymf->resampler.oldsamples[1] * (ymf->resampler.rateratio - ymf->resampler.samplecnt)
-                     + ymf->resampler.samples[1] * ymf->resampler.samplecnt)
-             / (float)ymf->resampler.rateratio);
-
-        // convert uint16_t range to float in range -1.0f to 1.0f
-        ymf->samples[0] = sample_0 < 0 ? sample_0 / 32768.0f : sample_0 / 32767.0f;
-        ymf->samples[1] = sample_1 < 0 ? sample_1 / 32768.0f : sample_1 / 32767.0f;
-
         return true;  // new sample is ready
     }
     // fallthrough: no new sample ready yet
     return false;
 }
 
+/* timer period in chip samples */
+static uint64_t _ymf262_timer_period(const ymf262_t* ymf, int t) {
+    return (uint64_t)(256 - ymf->timer[t].value) * ((t == 0) ? YMF262_TIMER1_SAMPLES : YMF262_TIMER2_SAMPLES);
+}
+
+/* first tick at or after given chip sample time */
+static uint64_t _ymf262_samples_to_ticks(const ymf262_t* ymf, uint64_t samples) {
+    return (samples * (uint64_t)ymf->tick_hz + (YMF262_SAMPLE_RATE - 1)) / YMF262_SAMPLE_RATE;
+}
+
+static void _ymf262_timers_schedule(ymf262_t* ymf) {
+    const uint64_t t0 = ymf->timer[0].expire_tick;
+    const uint64_t t1 = ymf->timer[1].expire_tick;
+    ymf->timer_event_tick = t0 < t1 ? t0 : t1;
+}
+
+static void _ymf262_timer_start(ymf262_t* ymf, int t) {
+    // timers count on the chip's own sample clock grid
+    const uint64_t now = ymf->ticks * YMF262_SAMPLE_RATE / (uint64_t)ymf->tick_hz;
+    ymf->timer[t].expire_at = now + _ymf262_timer_period(ymf, t);
+    ymf->timer[t].expire_tick = _ymf262_samples_to_ticks(ymf, ymf->timer[t].expire_at);
+}
+
+/* handle all timer overflows due at the current tick, then schedule the next event */
+static void _ymf262_timers_expire(ymf262_t* ymf) {
+    static const uint8_t flags[YMF262_NUM_TIMERS] = { YMF262_STATUS_FT1, YMF262_STATUS_FT2 };
+    static const uint8_t masks[YMF262_NUM_TIMERS] = { YMF262_TIMER_CTRL_MT1, YMF262_TIMER_CTRL_MT2 };
+    for (int t = 0; t < YMF262_NUM_TIMERS; t++) {
+        while (ymf->timer[t].expire_tick <= ymf->ticks) {
+            if (!(ymf->timer_ctrl & masks[t])) {
+                ymf->status |= flags[t] | YMF262_STATUS_IRQ;
+            }
+            // overflow reloads the preset, which may have changed meanwhile
+            ymf->timer[t].expire_at += _ymf262_timer_period(ymf, t);
+            ymf->timer[t].expire_tick = _ymf262_samples_to_ticks(ymf, ymf->timer[t].expire_at);
+        }
+    }
+    _ymf262_timers_schedule(ymf);
+}
+
+/* write timer control register */
+static void _ymf262_timer_ctrl(ymf262_t* ymf, uint8_t data) {
+    if (data & YMF262_TIMER_CTRL_RST) {
+        // IRQ-RESET clears the flags, the other bits are ignored
+        ymf->status = 0;
+        return;
+    }
+    static const uint8_t starts[YMF262_NUM_TIMERS] = { YMF262_TIMER_CTRL_ST1, YMF262_TIMER_CTRL_ST2 };
+    for (int t = 0; t < YMF262_NUM_TIMERS; t++) {
+        if (data & starts[t]) {
+            if (ymf->timer[t].expire_tick == YMF262_TIMER_STOPPED) {
+                _ymf262_timer_start(ymf, t);
+            }
+        }
+        else {
+            ymf->timer[t].expire_tick = YMF262_TIMER_STOPPED;
+        }
+    }
+    ymf->timer_ctrl = data;
+    _ymf262_timers_schedule(ymf);
+}
+
 /* read a register */
 static uint64_t _ymf262_read(ymf262_t* ymf, uint64_t pins) {
     const uint8_t reg = YMF262_GET_ADDR(pins);
     uint8_t data;
     switch (reg) {
-        case 0x00:        // status register
-            data = 0x00;  // FIXME: implement?
+        case 0x00:  // status register
+            data = ymf->status;
             break;
         default: data = 0xFF; break;
     }
@@ -86,13 +217,34 @@ static void _ymf262_write(ymf262_t* ymf, uint64_t pins) {
             ymf->addr[0] = data;
             break;
         case 0x01:  // bank 0 register write
+            switch (ymf->addr[0]) {
+                case YMF262_REG_TIMER1: ymf->timer[0].value = data; break;
+                case YMF262_REG_TIMER2: ymf->timer[1].value = data; break;
+                case YMF262_REG_TIMER_CTRL: _ymf262_timer_ctrl(ymf, data); break;
+            }
             ESFM_write_reg(&ymf->chip, ymf->addr[0], data);
+#if defined(_YMF262_USE_THREADS)
+            if (ymf->worker) {
+                _ymf262_worker_push(ymf->worker, ymf->sample_index, ymf->addr[0], data);
+            }
+#endif
+            if (ymf->write_cb) {
+                ymf->write_cb(ymf->addr[0], data, ymf->ticks, ymf->user_data);
+            }
             break;
         case 0x02:  // bank 1 address latch
             ymf->addr[1] = data;
             break;
         case 0x03:  // bank 1 register write
             ESFM_write_reg(&ymf->chip, (0x100 | ymf->addr[1]), data);
+#if defined(_YMF262_USE_THREADS)
+            if (ymf->worker) {
+                _ymf262_worker_push(ymf->worker, ymf->sample_index, (0x100 | ymf->addr[1]), data);
+            }
+#endif
+            if (ymf->write_cb) {
+                ymf->write_cb((0x100 | ymf->addr[1]), data, ymf->ticks, ymf->user_data);
+            }
             break;
     }
 }
@@ -115,16 +267,245 @@ uint64_t ymf262_tick(ymf262_t* ymf, uint64_t pins) {
 
     /* then perform the regular per-tick actions */
     pins |= _ymf262_tick(ymf) ? YMF262_SAMPLE : 0;
+    ymf->ticks++;
+
+    /* timers are event driven, only check if the next overflow is due */
+    if (ymf->ticks >= ymf->timer_event_tick) {
+        _ymf262_timers_expire(ymf);
+    }
+    if (ymf->status & YMF262_STATUS_IRQ) {
+        pins |= YMF262_IRQ;
+    }
+    else {
+        pins &= ~YMF262_IRQ;
+    }
 
     ymf->pins = pins;
     return pins;
 }
 
+void ymf262_set_write_cb(ymf262_t* ymf, ymf262_write_cb_t cb, void* user_data) {
+    CHIPS_ASSERT(ymf);
+    ymf->write_cb = cb;
+    ymf->user_data = user_data;
+}
+
+#if defined(_YMF262_USE_THREADS)
+typedef struct {
+    uint64_t sample;  // sample index the write happened before
+    uint16_t reg;     // 9-bit register or _YMF262_CMD_*
+    uint8_t data;
+} _ymf262_write_t;
+
+struct ymf262_worker_t {
+    ymf262_t synth;  // chip instance owned by the worker thread
+    int latency;
+    pthread_t thread;
+    atomic_bool quit;
+    atomic_uint_fast64_t now;       // sample index published by the emulation thread
+    uint64_t rendered;              // sample index rendered by the worker thread
+    uint64_t offset;                // emulation thread: worker sample index minus ymf262_t.sample_index
+    uint64_t underruns;             // frames not rendered in time (consumer side)
+    atomic_uint_fast64_t overruns;  // frames dropped because the consumer fell behind
+
+    // register writes: emulation thread -> worker thread
+    atomic_uint queue_head;
+    atomic_uint queue_tail;
+    _ymf262_write_t queue[_YMF262_QUEUE_SIZE];
+    // chip state for _YMF262_CMD_LOAD, written while load_pending is clear
+    atomic_bool load_pending;
+    esfm_chip load;
+
+    // rendered interleaved stereo frames: worker thread -> consumer
+    atomic_uint ring_head;
+    atomic_uint ring_tail;
+    float ring[_YMF262_RING_FRAMES * 2];
+};
+
+static void _ymf262_sleep(void) {
+    const struct timespec ts = { .tv_sec = 0, .tv_nsec = 100 * 1000 };
+    nanosleep(&ts, NULL);
+}
+
+// apply all queued writes which happened before the sample about to be rendered
+static void _ymf262_worker_apply(ymf262_worker_t* w) {
+    unsigned tail = atomic_load_explicit(&w->queue_tail, memory_order_relaxed);
+    const unsigned head = atomic_load_explicit(&w->queue_head, memory_order_acquire);
+    while (tail != head) {
+        const _ymf262_write_t* wr = &w->queue[tail % _YMF262_QUEUE_SIZE];
+        if (wr->sample > w->rendered) {
+            break;
+        }
+        if (wr->reg == _YMF262_CMD_RESET) {
+            ESFM_init(&w->synth.chip);
+            w->synth.resampler.samplecnt = 0;
+        }
+        else if (wr->reg == _YMF262_CMD_LOAD) {
+            w->synth.chip = w->load;
+            w->synth.resampler.samplecnt = 0;
+            atomic_store_explicit(&w->load_pending, false, memory_order_release);
+        }
+        else {
+            ESFM_write_reg(&w->synth.chip, wr->reg, wr->data);
+        }
+        tail++;
+    }
+    atomic_store_explicit(&w->queue_tail, tail, memory_order_release);
+}
+
+static void* _ymf262_worker_thread(void* arg) {
+    ymf262_worker_t* w = (ymf262_worker_t*)arg;
+    while (!atomic_load_explicit(&w->quit, memory_order_relaxed)) {
+        const uint64_t now = atomic_load_explicit(&w->now, memory_order_acquire);
+        if (w->rendered >= now) {
+            _ymf262_sleep();
+            continue;
+        }
+        while (w->rendered < now) {
+            _ymf262_worker_apply(w);
+            _ymf262_generate(&w->synth);
+            const unsigned head = atomic_load_explicit(&w->ring_head, memory_order_relaxed);
+            const unsigned tail = atomic_load_explicit(&w->ring_tail, memory_order_acquire);
+            if ((head - tail) < _YMF262_RING_FRAMES) {
+                float* dst = &w->ring[(head % _YMF262_RING_FRAMES) * 2];
+                dst[0] = w->synth.samples[0];
+                dst[1] = w->synth.samples[1];
+                atomic_store_explicit(&w->ring_head, head + 1, memory_order_release);
+            }
+            else {
+                // never wait for the consumer, it may be the thread feeding us
+                atomic_fetch_add_explicit(&w->overruns, 1, memory_order_relaxed);
+            }
+            w->rendered++;
+        }
+    }
+    return NULL;
+}
+
+static ymf262_worker_t* _ymf262_worker_start(const ymf262_t* ymf, int latency) {
+    CHIPS_ASSERT(latency < _YMF262_RING_FRAMES);
+    ymf262_worker_t* w = (ymf262_worker_t*)calloc(1, sizeof(ymf262_worker_t));
+    if (!w) {
+        return 0;
+    }
+    w->synth = *ymf;
+    w->synth.worker = 0;
+    w->synth.write_cb = 0;
+    w->synth.user_data = 0;
+    w->latency = latency;
+    w->rendered = ymf->sample_index;
+    atomic_init(&w->quit, false);
+    atomic_init(&w->now, ymf->sample_index);
+    atomic_init(&w->overruns, 0);
+    atomic_init(&w->queue_head, 0);
+    atomic_init(&w->queue_tail, 0);
+    atomic_init(&w->load_pending, false);
+    // prime the ring with silence, this is the headroom the worker has
+    atomic_init(&w->ring_head, (unsigned)latency);
+    atomic_init(&w->ring_tail, 0);
+    if (0 != pthread_create(&w->thread, NULL, _ymf262_worker_thread, w)) {
+        free(w);
+        return 0;
+    }
+    return w;
+}
+
+static void _ymf262_worker_stop(ymf262_worker_t* w) {
+    atomic_store(&w->quit, true);
+    pthread_join(w->thread, NULL);
+    free(w);
+}
+
+static void _ymf262_worker_push(ymf262_worker_t* w, uint64_t sample, uint16_t reg, uint8_t data) {
+    const unsigned head = atomic_load_explicit(&w->queue_head, memory_order_relaxed);
+    // the worker drains all writes before the current sample, so this can only
+    // spin if more than _YMF262_QUEUE_SIZE writes are pending
+    while ((head - atomic_load_explicit(&w->queue_tail, memory_order_acquire)) >= _YMF262_QUEUE_SIZE) {
+        _ymf262_sleep();
+    }
+    w->queue[head % _YMF262_QUEUE_SIZE] = (_ymf262_write_t){ .sample = sample + w->offset, .reg = reg, .data = data };
+    atomic_store_explicit(&w->queue_head, head + 1, memory_order_release);
+}
+
+static void _ymf262_worker_publish(ymf262_worker_t* w, uint64_t sample_index) {
+    atomic_store_explicit(&w->now, sample_index + w->offset, memory_order_release);
+}
+
+/* hand a loaded chip state to the running worker
+
+   The worker timeline continues where it is, so going back in time
+   (rewind, run-ahead) neither stalls nor restarts the output, and the
+   loaded state takes effect at the current output position.
+*/
+static void _ymf262_worker_load(ymf262_worker_t* w, const ymf262_t* ymf) {
+    // the emulation thread is the only one publishing
+    w->offset = atomic_load_explicit(&w->now, memory_order_relaxed) - ymf->sample_index;
+    // the previous load has to be taken over first, this happens within one rendered sample
+    while (atomic_load_explicit(&w->load_pending, memory_order_acquire)) {
+        _ymf262_sleep();
+    }
+    w->load = ymf->chip;
+    atomic_store_explicit(&w->load_pending, true, memory_order_relaxed);
+    _ymf262_worker_push(w, ymf->sample_index, _YMF262_CMD_LOAD, 0);
+}
+#endif
+
+int ymf262_read_samples(ymf262_t* ymf, float* dst, int num_frames) {
+    CHIPS_ASSERT(ymf && dst && (num_frames >= 0));
+    int num_read = 0;
+#if defined(_YMF262_USE_THREADS)
+    ymf262_worker_t* w = ymf->worker;
+    if (w) {
+        unsigned tail = atomic_load_explicit(&w->ring_tail, memory_order_relaxed);
+        const unsigned head = atomic_load_explicit(&w->ring_head, memory_order_acquire);
+        const unsigned avail = head - tail;
+        num_read = avail < (unsigned)num_frames ? (int)avail : num_frames;
+        for (int i = 0; i < num_read; i++, tail++) {
+            const float* src = &w->ring[(tail % _YMF262_RING_FRAMES) * 2];
+            dst[i * 2] = src[0];
+            dst[i * 2 + 1] = src[1];
+        }
+        atomic_store_explicit(&w->ring_tail, tail, memory_order_release);
+        w->underruns += (uint64_t)(num_frames - num_read);
+    }
+#endif
+    memset(&dst[num_read * 2], 0, (size_t)(num_frames - num_read) * 2 * sizeof(float));
+    return num_read;
+}
+
+uint64_t ymf262_underruns(const ymf262_t* ymf) {
+    CHIPS_ASSERT(ymf);
+#if defined(_YMF262_USE_THREADS)
+    if (ymf->worker) {
+        return ymf->worker->underruns;
+    }
+#endif
+    return 0;
+}
+
 void ymf262_snapshot_onsave(ymf262_t* snapshot) {
     CHIPS_ASSERT(snapshot);
+    snapshot->write_cb = 0;
+    snapshot->user_data = 0;
+    snapshot->worker = 0;
+    snapshot->muted = false;
 }
 
 void ymf262_snapshot_onload(ymf262_t* snapshot, ymf262_t* ymf) {
     CHIPS_ASSERT(snapshot && ymf);
     ESFM_init(&ymf->chip);
+    snapshot->write_cb = ymf->write_cb;
+    snapshot->user_data = ymf->user_data;
+    snapshot->worker = ymf->worker;
+    snapshot->muted = ymf->muted;
+#if defined(_YMF262_USE_THREADS)
+    if (ymf->worker) {
+        /* the running worker takes over the loaded chip state
+
+           In threaded mode the snapshot holds the register state only,
+           envelopes and phases of playing notes restart.
+        */
+        _ymf262_worker_load(ymf->worker, snapshot);
+    }
+#endif
 }
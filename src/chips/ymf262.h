@@ -22,11 +22,29 @@
              |           |<-- IC
              +-----------+
 
+    TIMERS:
+
+    Timer 1 (80 us resolution) and Timer 2 (320 us resolution) run on the
+    chip's sample clock grid. They are not counted down on every tick:
+    when a timer is started (or reloads) the tick of its next overflow is
+    computed, and ymf262_tick() only compares the tick counter against the
+    earliest one. Unmasked overflows set the status flags and the IRQ pin
+    until they are cleared through the IRQ-RESET bit of register 0x04.
+
+    THREADED SYNTHESIS:
+
+    With ymf262_desc_t.threaded set, register writes are still applied to
+    the chip state on the calling thread (for debugging UI and snapshots),
+    but sample generation runs on a worker thread. Writes are forwarded
+    with their sample timestamp through a lock-free queue, the worker
+    renders into a ring buffer which is drained with ymf262_read_samples().
+    The ring is primed with 'latency' frames of silence, so the consumer
+    never waits for the worker. Not available on the web platform, the
+    flag is ignored there.
+
     NOT EMULATED:
 
     - the RESET pin state is ignored
-    - IRQ is not generated
-    - status register always reads 0
 
     ## 0BSD license
 
@@ -91,29 +109,78 @@ extern "C" {
 
 // samplerate of the chip
 #define YMF262_SAMPLE_RATE (49716)
+
+// timer registers (bank 0)
+#define YMF262_REG_TIMER1     (0x02)
+#define YMF262_REG_TIMER2     (0x03)
+#define YMF262_REG_TIMER_CTRL (0x04)
+// timer control register bits
+#define YMF262_TIMER_CTRL_RST (1 << 7)  // reset status flags
+#define YMF262_TIMER_CTRL_MT1 (1 << 6)  // mask timer 1
+#define YMF262_TIMER_CTRL_MT2 (1 << 5)  // mask timer 2
+#define YMF262_TIMER_CTRL_ST2 (1 << 1)  // start timer 2
+#define YMF262_TIMER_CTRL_ST1 (1 << 0)  // start timer 1
+// status register bits
+#define YMF262_STATUS_IRQ (1 << 7)
+#define YMF262_STATUS_FT1 (1 << 6)  // timer 1 overflow
+#define YMF262_STATUS_FT2 (1 << 5)  // timer 2 overflow
+// timer resolution in chip samples (80 us and 320 us)
+#define YMF262_TIMER1_SAMPLES (4)
+#define YMF262_TIMER2_SAMPLES (16)
+#define YMF262_NUM_TIMERS     (2)
+// expire_tick of a stopped timer
+#define YMF262_TIMER_STOPPED (UINT64_MAX)
 // error-accumulation precision boost
 #define YMF262_RESAMPLER_FRAC   (10)
 #define YMF262_FIXEDPOINT_SCALE (16)
 
+// register write callback, reg is the 9-bit OPL3 register (bit 8 selects bank 1),
+// tick is the value of the chip tick counter at the time of the write
+typedef void (*ymf262_write_cb_t)(uint16_t reg, uint8_t data, uint64_t tick, void* user_data);
+
 // setup parameters for ymf262_init() call
 typedef struct {
-    int tick_hz;  /* frequency at which ymf262_tick() will be called in Hz */
-    int sound_hz; /* number of samples that will be produced per second */
+    int tick_hz;   /* frequency at which ymf262_tick() will be called in Hz */
+    int sound_hz;  /* number of samples that will be produced per second */
+    bool threaded; /* generate samples on a worker thread */
+    int latency;   /* threaded: number of sample frames the output lags behind (default 1024) */
 } ymf262_desc_t;
 
+// opaque synthesis worker thread state
+typedef struct ymf262_worker_t ymf262_worker_t;
+
 // YMF262 state
 typedef struct {
     uint8_t addr[YMF262_NUM_BANKS];  // register address latch
 
     uint64_t pins;  // last pin state for debug inspection
 
+    int tick_hz;     // tick frequency, to convert tick counter to time
     int sound_hz;    // keep samplerate for chip resets
+    uint64_t ticks;  // number of ticks since init
     esfm_chip chip;  // wrapped opl3 chip emulator
 
+    uint64_t sample_index;    // number of samples produced since init
+    ymf262_worker_t* worker;  // synthesis worker, when running threaded
+
+    uint8_t status;      // status register
+    uint8_t timer_ctrl;  // last write to timer control register
+    struct {
+        uint8_t value;         // timer preset (registers 0x02/0x03)
+        uint64_t expire_at;    // next overflow in chip samples since init
+        uint64_t expire_tick;  // next overflow in ticks, YMF262_TIMER_STOPPED if not running
+    } timer[YMF262_NUM_TIMERS];
+    uint64_t timer_event_tick;  // earliest expire_tick of all timers
+
+    // optional register write hook (e.g. VGM logger)
+    ymf262_write_cb_t write_cb;
+    void* user_data;
+
     // sample generation state
     int sample_period;
     int sample_counter;
     float samples[2];
+    bool muted;  // samples are counted but not generated, for emulation nobody hears
 
     struct {
         int32_t rateratio;
@@ -134,10 +201,19 @@ typedef struct {
 
 // initialize a YMF262 instance
 void ymf262_init(ymf262_t* ymf, const ymf262_desc_t* desc);
+// discard a YMF262 instance, stops the synthesis worker
+void ymf262_discard(ymf262_t* ymf);
 // reset an existing YMF262 instance
 void ymf262_reset(ymf262_t* ymf);
 // tick the YMF262, return true if a new sample is ready
 uint64_t ymf262_tick(ymf262_t* ymf, uint64_t pins);
+// install a register write hook, pass NULL to remove it
+void ymf262_set_write_cb(ymf262_t* ymf, ymf262_write_cb_t cb, void* user_data);
+// threaded: read interleaved stereo frames rendered by the worker, never blocks,
+// missing frames are filled with silence, returns number of frames actually rendered
+int ymf262_read_samples(ymf262_t* ymf, float* dst, int num_frames);
+// threaded: number of frames which were not rendered in time
+uint64_t ymf262_underruns(const ymf262_t* ymf);
 // prepare ymf262_t snapshot for saving
 void ymf262_snapshot_onsave(ymf262_t* snapshot);
 // fixup ymf262_t snapshot after loading
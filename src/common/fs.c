@@ -8,7 +8,6 @@
 #include <assert.h>
 #include <ctype.h>
 #include <stdio.h>
-#include <stdalign.h>
 #include <stdarg.h>
 #if defined(__EMSCRIPTEN__)
 #include <emscripten/emscripten.h>
@@ -16,10 +15,19 @@
 #if defined(WIN32)
 #include <windows.h>
 #endif
+#if !defined(__EMSCRIPTEN__)
+#include <pthread.h>
+#if !defined(WIN32)
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#endif
 
 #define FS_EXT_SIZE (16)
 #define FS_PATH_SIZE (2048)
-#define FS_MAX_SIZE (2024 * 1024)
+#define FS_MAX_SIZE (2024 * 1024)  // largest file fetched over HTTP
 
 typedef struct {
     char cstr[FS_PATH_SIZE];
@@ -31,20 +39,64 @@ typedef struct {
     fs_snapshot_load_callback_t callback;
 } fs_snapshot_load_context_t;
 
+// the data is followed by a zero byte, so text files can be used as C strings
 typedef struct {
     fs_path_t path;
     fs_result_t result;
     uint8_t* ptr;
     size_t size;
-    alignas(64) uint8_t buf[FS_MAX_SIZE + 1];
+    uint8_t* buf;         // heap buffer holding the data, if any
+    bool mapped;          // ptr is a read-only mapping of the file
+    uint32_t generation;  // bumped by fs_reset(), a fetch for an older generation is dropped
 } fs_channel_state_t;
 
+#if !defined(__EMSCRIPTEN__)
+// snapshot load or save, done on the I/O thread
+typedef struct fs_io_job_t {
+    struct fs_io_job_t* next;
+    bool save;
+    fs_path_t path;
+    size_t snapshot_index;
+    size_t max_size;  // only load the start of the file, 0 for all of it
+    fs_snapshot_encode_t encode;
+    void* encode_user_data;
+    fs_snapshot_load_callback_t callback;
+    fs_result_t result;
+    chips_range_t data;
+    #if defined(WIN32)
+    HANDLE file;
+    #else
+    FILE* file;
+    #endif
+} fs_io_job_t;
+
+typedef struct {
+    bool running;
+    bool quit;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    fs_io_job_t* queue;
+    fs_io_job_t** queue_tail;
+    fs_io_job_t* done;
+    fs_io_job_t** done_tail;
+} fs_io_t;
+#endif
+
 typedef struct {
     bool valid;
     fs_channel_state_t channels[FS_CHANNEL_NUM];
+    #if !defined(__EMSCRIPTEN__)
+    fs_io_t io;
+    #endif
 } fs_state_t;
 static fs_state_t state;
 
+#if !defined(__EMSCRIPTEN__)
+static void* fs_io_thread(void* arg);
+static void fs_win32_posix_unmap_file(chips_range_t data);
+#endif
+
 void fs_init(void) {
     memset(&state, 0, sizeof(state));
     state.valid = true;
@@ -54,11 +106,69 @@ void fs_init(void) {
         .num_lanes = 1,
         .logger.func = slog_func,
     });
+    #if !defined(__EMSCRIPTEN__)
+    fs_io_t* io = &state.io;
+    io->queue_tail = &io->queue;
+    io->done_tail = &io->done;
+    pthread_mutex_init(&io->lock, NULL);
+    pthread_cond_init(&io->cond, NULL);
+    io->running = 0 == pthread_create(&io->thread, NULL, fs_io_thread, NULL);
+    #endif
+}
+
+void fs_shutdown(void) {
+    assert(state.valid);
+    #if !defined(__EMSCRIPTEN__)
+    // queued saves are written before the thread exits, their callbacks don't run anymore
+    fs_io_t* io = &state.io;
+    if (io->running) {
+        pthread_mutex_lock(&io->lock);
+        io->quit = true;
+        pthread_cond_signal(&io->cond);
+        pthread_mutex_unlock(&io->lock);
+        pthread_join(io->thread, NULL);
+        io->running = false;
+    }
+    while (io->done) {
+        fs_io_job_t* job = io->done;
+        io->done = job->next;
+        free(job->data.ptr);
+        free(job);
+    }
+    pthread_cond_destroy(&io->cond);
+    pthread_mutex_destroy(&io->lock);
+    #endif
+    for (int chn = 0; chn < FS_CHANNEL_NUM; chn++) {
+        fs_reset((fs_channel_t)chn);
+    }
+    sfetch_shutdown();
+    state.valid = false;
 }
 
 void fs_dowork(void) {
     assert(state.valid);
     sfetch_dowork();
+    #if !defined(__EMSCRIPTEN__)
+    // report finished snapshot loads and saves on the calling thread
+    fs_io_t* io = &state.io;
+    pthread_mutex_lock(&io->lock);
+    fs_io_job_t* done = io->done;
+    io->done = 0;
+    io->done_tail = &io->done;
+    pthread_mutex_unlock(&io->lock);
+    while (done) {
+        fs_io_job_t* job = done;
+        done = job->next;
+        fs_snapshot_response_t response = {
+            .snapshot_index = job->snapshot_index,
+            .result = job->result,
+            .data = job->data,
+        };
+        job->callback(&response);
+        free(response.data.ptr);
+        free(job);
+    }
+    #endif
 }
 
 static void fs_path_reset(fs_path_t* path) {
@@ -169,7 +279,8 @@ static bool fs_base64_decode(fs_channel_state_t* channel, const char* src) {
 
     // output length
     int olen = (count / 4) * 3;
-    if (olen >= (int)sizeof(channel->buf)) {
+    channel->buf = malloc((size_t)olen + 1);
+    if (!channel->buf) {
         return false;
     }
 
@@ -204,6 +315,7 @@ static bool fs_base64_decode(fs_channel_state_t* channel, const char* src) {
             }
         }
     }
+    channel->buf[channel->size] = 0;
     return true;
 }
 
@@ -225,10 +337,19 @@ void fs_reset(fs_channel_t chn) {
     assert(state.valid);
     assert(chn < FS_CHANNEL_NUM);
     fs_channel_state_t* channel = &state.channels[chn];
+    #if !defined(__EMSCRIPTEN__)
+    if (channel->mapped) {
+        fs_win32_posix_unmap_file((chips_range_t){ .ptr = channel->ptr, .size = channel->size });
+    }
+    #endif
+    free(channel->buf);
     fs_path_reset(&channel->path);
     channel->result = FS_RESULT_IDLE;
     channel->ptr = 0;
     channel->size = 0;
+    channel->buf = 0;
+    channel->mapped = false;
+    channel->generation++;
 }
 
 bool fs_load_base64(fs_channel_t chn, const char* name, const char* payload) {
@@ -248,26 +369,39 @@ bool fs_load_base64(fs_channel_t chn, const char* name, const char* payload) {
     }
 }
 
+#if defined(__EMSCRIPTEN__)
+
+typedef struct {
+    fs_channel_t chn;
+    uint32_t generation;
+} fs_fetch_context_t;
+
+// the fetch owns its buffer until it is done, the channel takes it over only if it wasn't reset meanwhile
 static void fs_fetch_callback(const sfetch_response_t* response) {
     assert(state.valid);
-    fs_channel_t chn = *(fs_channel_t*)response->user_data;
-    assert(chn < FS_CHANNEL_NUM);
-    fs_channel_state_t* channel = &state.channels[chn];
-    if (response->fetched) {
+    if (!response->fetched && !response->failed) {
+        return;
+    }
+    const fs_fetch_context_t* ctx = (const fs_fetch_context_t*)response->user_data;
+    assert(ctx->chn < FS_CHANNEL_NUM);
+    fs_channel_state_t* channel = &state.channels[ctx->chn];
+    uint8_t* buf = (uint8_t*)response->buffer.ptr;
+    if (response->fetched && (ctx->generation == channel->generation)) {
+        // in case it's a text file, zero-terminate the data
+        buf[response->data.size] = 0;
         channel->result = FS_RESULT_SUCCESS;
-        channel->ptr = (uint8_t*)response->data.ptr;
+        channel->buf = buf;
+        channel->ptr = buf;
         channel->size = response->data.size;
-        assert(channel->size < sizeof(channel->buf));
-        // in case it's a text file, zero-terminate the data
-        channel->buf[channel->size] = 0;
     }
-    else if (response->failed) {
-        channel->result = FS_RESULT_FAILED;
+    else {
+        if (ctx->generation == channel->generation) {
+            channel->result = FS_RESULT_FAILED;
+        }
+        free(buf);
     }
 }
 
-#if defined(__EMSCRIPTEN__)
-
 EM_JS_DEPS(chips_ini, "$UTF8ToString,$stringToNewUTF8");
 
 EM_JS(void, emsc_js_save_ini, (const char* c_key, const char* c_payload), {
@@ -292,20 +426,27 @@ EM_JS(const char*, emsc_js_load_ini, (const char* c_key), {
     }
 });
 
+// user_data holds the channel in the low 8 bits and the channel generation above
 static void fs_emsc_dropped_file_callback(const sapp_html5_fetch_response* response) {
-    fs_channel_t chn = (fs_channel_t)(uintptr_t)response->user_data;
+    fs_channel_t chn = (fs_channel_t)((uintptr_t)response->user_data & 0xFF);
+    const uint32_t generation = (uint32_t)((uintptr_t)response->user_data >> 8);
     assert(chn < FS_CHANNEL_NUM);
     fs_channel_state_t* channel = &state.channels[chn];
-    if (response->succeeded) {
+    uint8_t* buf = (uint8_t*)response->buffer.ptr;
+    if (generation != (channel->generation & (UINTPTR_MAX >> 8))) {
+        free(buf);
+    }
+    else if (response->succeeded) {
+        // in case it's a text file, zero-terminate the data
+        buf[response->data.size] = 0;
         channel->result = FS_RESULT_SUCCESS;
-        channel->ptr = (uint8_t*)response->data.ptr;
+        channel->buf = buf;
+        channel->ptr = buf;
         channel->size = response->data.size;
-        assert(channel->size < sizeof(channel->buf));
-        // in case it's a text file, zero-terminate the data
-        channel->buf[channel->size] = 0;
     }
     else {
         channel->result = FS_RESULT_FAILED;
+        free(buf);
     }
 }
 
@@ -413,15 +554,16 @@ EMSCRIPTEN_KEEPALIVE void fs_emsc_load_snapshot_callback(const fs_snapshot_load_
     size_t snapshot_index = ctx->snapshot_index;
     fs_snapshot_load_callback_t callback = ctx->callback;
     if (bytes) {
-        callback(&(fs_snapshot_response_t){
+        fs_snapshot_response_t response = {
             .snapshot_index = snapshot_index,
             .result = FS_RESULT_SUCCESS,
             .data = {
                 .ptr = bytes,
                 .size = (size_t)num_bytes
             }
-        });
-        free(bytes);
+        };
+        callback(&response);
+        free(response.data.ptr);
     }
     else {
         callback(&(fs_snapshot_response_t){
@@ -445,28 +587,6 @@ bool fs_emsc_load_snapshot_async(const char* system_name, size_t snapshot_index,
     return true;
 }
 #else // any native platform
-static void fs_win32_posix_snapshot_fetch_callback(const sfetch_response_t* response) {
-    const fs_snapshot_load_context_t* ctx = (fs_snapshot_load_context_t*) response->user_data;
-    size_t snapshot_index = ctx->snapshot_index;
-    fs_snapshot_load_callback_t callback = ctx->callback;
-    if (response->fetched) {
-        callback(&(fs_snapshot_response_t){
-            .snapshot_index = snapshot_index,
-            .result = FS_RESULT_SUCCESS,
-            .data = {
-                .ptr = (uint8_t*)response->data.ptr,
-                .size = response->data.size
-            }
-        });
-    }
-    else if (response->failed) {
-        callback(&(fs_snapshot_response_t){
-            .snapshot_index = snapshot_index,
-            .result = FS_RESULT_FAILED,
-        });
-    }
-}
-
 static bool fs_win32_posix_write_file(fs_path_t path, chips_range_t data) {
     if (path.clamped) {
         return false;
@@ -543,6 +663,110 @@ static chips_range_t fs_win32_posix_read_file(fs_path_t path, bool null_terminat
     #endif
 }
 
+/*  map a whole file read-only, release with fs_win32_posix_unmap_file()
+
+    The data is zero-terminated by the rest of its last page, so empty
+    files and files of a whole number of pages are not mapped, read those
+    with fs_win32_posix_read_file() instead. Truncating the file while it
+    is mapped makes accesses past the new end fault.
+*/
+static chips_range_t fs_win32_posix_map_file(fs_path_t path) {
+    if (path.clamped) {
+        return (chips_range_t){0};
+    }
+    #if defined(WIN32)
+        WCHAR wc_path[FS_PATH_SIZE];
+        if (!fs_win32_path_to_wide(&path, wc_path, sizeof(wc_path))) {
+            return (chips_range_t){0};
+        }
+        HANDLE fp = CreateFileW(wc_path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (fp == INVALID_HANDLE_VALUE) {
+            return (chips_range_t){0};
+        }
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        LARGE_INTEGER file_size;
+        void* ptr = 0;
+        if (GetFileSizeEx(fp, &file_size) && (file_size.QuadPart > 0) && ((uint64_t)file_size.QuadPart < SIZE_MAX)
+            && ((file_size.QuadPart % info.dwPageSize) != 0)) {
+            HANDLE mapping = CreateFileMappingW(fp, NULL, PAGE_READONLY, 0, 0, NULL);
+            if (mapping) {
+                // the view keeps the file open
+                ptr = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                CloseHandle(mapping);
+            }
+        }
+        CloseHandle(fp);
+        if (!ptr) {
+            return (chips_range_t){0};
+        }
+        return (chips_range_t){ .ptr = ptr, .size = (size_t)file_size.QuadPart };
+    #else
+        const int fd = open(path.cstr, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return (chips_range_t){0};
+        }
+        const long page_size = sysconf(_SC_PAGESIZE);
+        struct stat st;
+        void* ptr = MAP_FAILED;
+        if ((fstat(fd, &st) == 0) && S_ISREG(st.st_mode) && (st.st_size > 0) && (page_size > 0)
+            && ((st.st_size % page_size) != 0)) {
+            ptr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        // the mapping keeps the file open
+        close(fd);
+        if (ptr == MAP_FAILED) {
+            return (chips_range_t){0};
+        }
+        return (chips_range_t){ .ptr = ptr, .size = (size_t)st.st_size };
+    #endif
+}
+
+static void fs_win32_posix_unmap_file(chips_range_t data) {
+    #if defined(WIN32)
+        UnmapViewOfFile(data.ptr);
+    #else
+        munmap(data.ptr, data.size);
+    #endif
+}
+
+// read at most max_size bytes from the start of a file, free the returned range.ptr with free(ptr)
+static chips_range_t fs_win32_posix_read_file_start(fs_path_t path, size_t max_size) {
+    if (path.clamped) {
+        return (chips_range_t){0};
+    }
+    void* ptr = malloc(max_size);
+    if (!ptr) {
+        return (chips_range_t){0};
+    }
+    size_t read_size = 0;
+    #if defined(WIN32)
+        WCHAR wc_path[FS_PATH_SIZE];
+        HANDLE fp = INVALID_HANDLE_VALUE;
+        if (fs_win32_path_to_wide(&path, wc_path, sizeof(wc_path))) {
+            fp = CreateFileW(wc_path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        }
+        if (fp != INVALID_HANDLE_VALUE) {
+            DWORD read_bytes = 0;
+            if (ReadFile(fp, ptr, (DWORD)max_size, &read_bytes, NULL)) {
+                read_size = read_bytes;
+            }
+            CloseHandle(fp);
+        }
+    #else
+        FILE* fp = fopen(path.cstr, "rb");
+        if (fp) {
+            read_size = fread(ptr, 1, max_size, fp);
+            fclose(fp);
+        }
+    #endif
+    if (read_size == 0) {
+        free(ptr);
+        return (chips_range_t){0};
+    }
+    return (chips_range_t){ .ptr = ptr, .size = read_size };
+}
+
 static fs_path_t fs_win32_posix_tmp_dir(void) {
     #if defined(WIN32)
     WCHAR wc_tmp_path[FS_PATH_SIZE];
@@ -574,25 +798,211 @@ bool fs_win32_posix_save_snapshot(const char* system_name, size_t snapshot_index
     return fs_win32_posix_write_file(path, data);
 }
 
-bool fs_win32_posix_load_snapshot_async(const char* system_name, size_t snapshot_index, fs_snapshot_load_callback_t callback) {
+// start writing a snapshot to a temporary file next to its path
+static bool fs_win32_posix_begin_write(fs_io_job_t* job) {
+    fs_path_t tmp_path = fs_path_printf("%s.tmp", job->path.cstr);
+    if (tmp_path.clamped) {
+        return false;
+    }
+    #if defined(WIN32)
+        WCHAR wc_path[FS_PATH_SIZE];
+        if (!fs_win32_path_to_wide(&tmp_path, wc_path, sizeof(wc_path))) {
+            return false;
+        }
+        HANDLE fp = CreateFileW(wc_path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (fp == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        DWORD written = 0;
+        if (!WriteFile(fp, job->data.ptr, (DWORD)job->data.size, &written, NULL) || (written != job->data.size)) {
+            CloseHandle(fp);
+            DeleteFileW(wc_path);
+            return false;
+        }
+        job->file = fp;
+    #else
+        FILE* fp = fopen(tmp_path.cstr, "wb");
+        if (!fp) {
+            return false;
+        }
+        if (fwrite(job->data.ptr, job->data.size, 1, fp) != 1) {
+            fclose(fp);
+            remove(tmp_path.cstr);
+            return false;
+        }
+        job->file = fp;
+    #endif
+    return true;
+}
+
+// flush the temporary file to disk and move it over the snapshot, so a crash never leaves a torn snapshot
+static bool fs_win32_posix_end_write(fs_io_job_t* job) {
+    fs_path_t tmp_path = fs_path_printf("%s.tmp", job->path.cstr);
+    #if defined(WIN32)
+        bool ok = FlushFileBuffers(job->file);
+        CloseHandle(job->file);
+        WCHAR wc_tmp_path[FS_PATH_SIZE];
+        WCHAR wc_path[FS_PATH_SIZE];
+        if (!fs_win32_path_to_wide(&tmp_path, wc_tmp_path, sizeof(wc_tmp_path))
+            || !fs_win32_path_to_wide(&job->path, wc_path, sizeof(wc_path))) {
+            return false;
+        }
+        ok = ok && MoveFileExW(wc_tmp_path, wc_path, MOVEFILE_REPLACE_EXISTING);
+        if (!ok) {
+            DeleteFileW(wc_tmp_path);
+        }
+    #else
+        bool ok = (fflush(job->file) == 0) && (fsync(fileno(job->file)) == 0);
+        ok = (fclose(job->file) == 0) && ok;
+        ok = ok && (rename(tmp_path.cstr, job->path.cstr) == 0);
+        if (!ok) {
+            remove(tmp_path.cstr);
+        }
+    #endif
+    return ok;
+}
+
+// the last save of the same path queued before job in the batch, NULL if none
+static const fs_io_job_t* fs_io_find_earlier_save(const fs_io_job_t* batch, const fs_io_job_t* job) {
+    const fs_io_job_t* found = NULL;
+    for (const fs_io_job_t* prev = batch; prev != job; prev = prev->next) {
+        if (prev->save && (0 == strcmp(prev->path.cstr, job->path.cstr))) {
+            found = prev;
+        }
+    }
+    return found;
+}
+
+// copy at most max_size bytes (0 for all) of a range, free the returned range.ptr with free(ptr)
+static chips_range_t fs_io_copy_range(chips_range_t data, size_t max_size) {
+    const size_t size = (max_size && (max_size < data.size)) ? max_size : data.size;
+    void* ptr = malloc(size);
+    if (!ptr) {
+        return (chips_range_t){0};
+    }
+    memcpy(ptr, data.ptr, size);
+    return (chips_range_t){ .ptr = ptr, .size = size };
+}
+
+// jobs queued while the previous batch was busy are done together
+static void fs_io_run_batch(fs_io_job_t* batch) {
+    // everything is written before the first flush, so the flushes can overlap
+    for (fs_io_job_t* job = batch; job; job = job->next) {
+        if (!job->save) {
+            // an earlier save in this batch is not in place yet, the load gets its data like it would from the file
+            const fs_io_job_t* save = fs_io_find_earlier_save(batch, job);
+            if (save && save->data.ptr && (save->result != FS_RESULT_FAILED)) {
+                job->data = fs_io_copy_range(save->data, job->max_size);
+            }
+            else if (job->max_size) {
+                job->data = fs_win32_posix_read_file_start(job->path, job->max_size);
+            }
+            else {
+                job->data = fs_win32_posix_read_file(job->path, false);
+            }
+            job->result = job->data.ptr ? FS_RESULT_SUCCESS : FS_RESULT_FAILED;
+            continue;
+        }
+        job->data = job->encode(job->encode_user_data);
+        if (!job->data.ptr) {
+            job->result = FS_RESULT_FAILED;
+            continue;
+        }
+        bool superseded = false;
+        for (fs_io_job_t* next = job->next; next; next = next->next) {
+            superseded |= next->save && (0 == strcmp(next->path.cstr, job->path.cstr));
+        }
+        if (superseded) {
+            // a later save in this batch replaces the file anyway
+            job->result = FS_RESULT_SUCCESS;
+        }
+        else {
+            job->result = fs_win32_posix_begin_write(job) ? FS_RESULT_PENDING : FS_RESULT_FAILED;
+        }
+    }
+    for (fs_io_job_t* job = batch; job; job = job->next) {
+        if (job->save && (job->result == FS_RESULT_PENDING)) {
+            job->result = fs_win32_posix_end_write(job) ? FS_RESULT_SUCCESS : FS_RESULT_FAILED;
+        }
+    }
+}
+
+static void* fs_io_thread(void* arg) {
+    (void)arg;
+    fs_io_t* io = &state.io;
+    pthread_mutex_lock(&io->lock);
+    for (;;) {
+        while (!io->queue && !io->quit) {
+            pthread_cond_wait(&io->cond, &io->lock);
+        }
+        if (!io->queue) {
+            break;
+        }
+        fs_io_job_t* batch = io->queue;
+        io->queue = 0;
+        io->queue_tail = &io->queue;
+        pthread_mutex_unlock(&io->lock);
+
+        fs_io_run_batch(batch);
+
+        pthread_mutex_lock(&io->lock);
+        *io->done_tail = batch;
+        while (*io->done_tail) {
+            io->done_tail = &(*io->done_tail)->next;
+        }
+    }
+    pthread_mutex_unlock(&io->lock);
+    return 0;
+}
+
+static bool fs_io_push(fs_io_job_t* job) {
+    fs_io_t* io = &state.io;
+    if (!io->running) {
+        return false;
+    }
+    pthread_mutex_lock(&io->lock);
+    *io->queue_tail = job;
+    io->queue_tail = &job->next;
+    pthread_cond_signal(&io->cond);
+    pthread_mutex_unlock(&io->lock);
+    return true;
+}
+
+bool fs_win32_posix_save_snapshot_async(const char* system_name, size_t snapshot_index, fs_snapshot_encode_t encode, void* user_data, fs_snapshot_save_callback_t callback) {
+    assert(system_name && encode && callback);
+    fs_path_t path = fs_win32_posix_make_snapshot_path(system_name, snapshot_index);
+    fs_io_job_t* job = path.clamped ? NULL : calloc(1, sizeof(fs_io_job_t));
+    if (!job) {
+        return false;
+    }
+    job->save = true;
+    job->path = path;
+    job->snapshot_index = snapshot_index;
+    job->encode = encode;
+    job->encode_user_data = user_data;
+    job->callback = callback;
+    if (!fs_io_push(job)) {
+        free(job);
+        return false;
+    }
+    return true;
+}
+
+bool fs_win32_posix_load_snapshot_async(const char* system_name, size_t snapshot_index, size_t max_size, fs_snapshot_load_callback_t callback) {
     assert(system_name && callback);
     fs_path_t path = fs_win32_posix_make_snapshot_path(system_name, snapshot_index);
-    if (path.clamped) {
+    fs_io_job_t* job = path.clamped ? NULL : calloc(1, sizeof(fs_io_job_t));
+    if (!job) {
+        return false;
+    }
+    job->path = path;
+    job->snapshot_index = snapshot_index;
+    job->max_size = max_size;
+    job->callback = callback;
+    if (!fs_io_push(job)) {
+        free(job);
         return false;
     }
-    fs_snapshot_load_context_t context = {
-        .snapshot_index = snapshot_index,
-        .callback = callback
-    };
-    const fs_channel_t chn = FS_CHANNEL_SNAPSHOTS;
-    fs_channel_state_t* channel = &state.channels[chn];
-    sfetch_send(&(sfetch_request_t){
-        .path = path.cstr,
-        .channel = (int)chn,
-        .callback = fs_win32_posix_snapshot_fetch_callback,
-        .buffer = { .ptr = channel->buf, .size = FS_MAX_SIZE },
-        .user_data = { .ptr = &context, .size = sizeof(context) }
-    });
     return true;
 }
 #endif
@@ -603,14 +1013,37 @@ void fs_load_file_async(fs_channel_t chn, const char* path) {
     fs_reset(chn);
     fs_channel_state_t* channel = &state.channels[chn];
     channel->path = fs_path_printf("%s", path);
-    channel->result = FS_RESULT_PENDING;
-    sfetch_send(&(sfetch_request_t){
-        .path = path,
-        .channel = chn,
-        .callback = fs_fetch_callback,
-        .buffer = { .ptr = channel->buf, .size = FS_MAX_SIZE },
-        .user_data = { .ptr = &chn, .size = sizeof(chn) },
-    });
+    #if defined(__EMSCRIPTEN__)
+        // one byte more for the zero terminator
+        uint8_t* buf = malloc(FS_MAX_SIZE + 1);
+        if (!buf) {
+            channel->result = FS_RESULT_FAILED;
+            return;
+        }
+        const fs_fetch_context_t ctx = { .chn = chn, .generation = channel->generation };
+        channel->result = FS_RESULT_PENDING;
+        sfetch_send(&(sfetch_request_t){
+            .path = path,
+            .channel = chn,
+            .callback = fs_fetch_callback,
+            .buffer = { .ptr = buf, .size = FS_MAX_SIZE },
+            .user_data = { .ptr = &ctx, .size = sizeof(ctx) },
+        });
+    #else
+        // local files are mapped instead of copied, and there's no size limit
+        chips_range_t data = fs_win32_posix_map_file(channel->path);
+        channel->mapped = data.ptr != 0;
+        if (!channel->mapped) {
+            data = fs_win32_posix_read_file(channel->path, true);
+            if (data.ptr) {
+                channel->buf = data.ptr;
+                data.size -= 1;
+            }
+        }
+        channel->ptr = data.ptr;
+        channel->size = data.size;
+        channel->result = data.ptr ? FS_RESULT_SUCCESS : FS_RESULT_FAILED;
+    #endif
 }
 
 void fs_load_dropped_file_async(fs_channel_t chn) {
@@ -622,11 +1055,18 @@ void fs_load_dropped_file_async(fs_channel_t chn) {
     channel->path = fs_path_printf("%s", path);
     channel->result = FS_RESULT_PENDING;
     #if defined(__EMSCRIPTEN__)
+        // the size is known up front, the buffer fits the file and its zero terminator
+        const size_t size = (size_t)sapp_html5_get_dropped_file_size(0);
+        uint8_t* buf = malloc(size + 1);
+        if (!buf) {
+            channel->result = FS_RESULT_FAILED;
+            return;
+        }
         sapp_html5_fetch_dropped_file(&(sapp_html5_fetch_request){
             .dropped_file_index = 0,
             .callback = fs_emsc_dropped_file_callback,
-            .buffer = { .ptr = channel->buf, .size = FS_MAX_SIZE },
-            .user_data = (void*)(intptr_t)chn,
+            .buffer = { .ptr = buf, .size = size },
+            .user_data = (void*)(((uintptr_t)channel->generation << 8) | (uintptr_t)chn),
         });
     #else
         fs_load_file_async(chn, path);
@@ -641,11 +1081,39 @@ bool fs_save_snapshot(const char* system_name, size_t snapshot_index, chips_rang
     #endif
 }
 
+bool fs_save_snapshot_async(const char* system_name, size_t snapshot_index, fs_snapshot_encode_t encode, void* user_data, fs_snapshot_save_callback_t callback) {
+    #if defined(__EMSCRIPTEN__)
+    // no threads, encode and store right away
+    chips_range_t data = encode(user_data);
+    const bool ok = data.ptr && fs_emsc_save_snapshot(system_name, snapshot_index, data);
+    fs_snapshot_response_t response = {
+        .snapshot_index = snapshot_index,
+        .result = ok ? FS_RESULT_SUCCESS : FS_RESULT_FAILED,
+        .data = data,
+    };
+    callback(&response);
+    free(response.data.ptr);
+    return true;
+    #else
+    return fs_win32_posix_save_snapshot_async(system_name, snapshot_index, encode, user_data, callback);
+    #endif
+}
+
 bool fs_load_snapshot_async(const char* system_name, size_t snapshot_index, fs_snapshot_load_callback_t callback) {
     #if defined(__EMSCRIPTEN__)
     return fs_emsc_load_snapshot_async(system_name, snapshot_index, callback);
     #else
-    return fs_win32_posix_load_snapshot_async(system_name, snapshot_index, callback);
+    return fs_win32_posix_load_snapshot_async(system_name, snapshot_index, 0, callback);
+    #endif
+}
+
+bool fs_load_snapshot_preview_async(const char* system_name, size_t snapshot_index, size_t max_size, fs_snapshot_load_callback_t callback) {
+    assert(max_size > 0);
+    #if defined(__EMSCRIPTEN__)
+    // IndexedDB values can only be read as a whole
+    return fs_emsc_load_snapshot_async(system_name, snapshot_index, callback);
+    #else
+    return fs_win32_posix_load_snapshot_async(system_name, snapshot_index, max_size, callback);
     #endif
 }
 
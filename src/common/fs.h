@@ -27,16 +27,25 @@ typedef struct {
     chips_range_t data;
 } fs_snapshot_response_t;
 
-typedef void (*fs_snapshot_load_callback_t)(const fs_snapshot_response_t* response);
+// response->data is freed after the callback returns, a callback keeping it sets data.ptr to NULL
+typedef void (*fs_snapshot_load_callback_t)(fs_snapshot_response_t* response);
+typedef void (*fs_snapshot_save_callback_t)(fs_snapshot_response_t* response);
+// produces the snapshot data to save, runs on the I/O thread, release the result with free()
+typedef chips_range_t (*fs_snapshot_encode_t)(void* user_data);
 
 void fs_init(void);
+void fs_shutdown(void);
 void fs_dowork(void);
 void fs_reset(fs_channel_t chn);
 void fs_load_file_async(fs_channel_t chn, const char* path);
 void fs_load_dropped_file_async(fs_channel_t chn);
 bool fs_load_base64(fs_channel_t chn, const char* name, const char* payload);
 bool fs_save_snapshot(const char* system_name, size_t snapshot_index, chips_range_t data);
+// encode and write a snapshot in the background, callback runs in fs_dowork() with the encoded data
+bool fs_save_snapshot_async(const char* system_name, size_t snapshot_index, fs_snapshot_encode_t encode, void* user_data, fs_snapshot_save_callback_t callback);
 bool fs_load_snapshot_async(const char* system_name, size_t snapshot_index, fs_snapshot_load_callback_t callback);
+// load only the first max_size bytes of a snapshot (e.g. a header with a thumbnail), data may be shorter or longer
+bool fs_load_snapshot_preview_async(const char* system_name, size_t snapshot_index, size_t max_size, fs_snapshot_load_callback_t callback);
 fs_result_t fs_result(fs_channel_t chn);
 bool fs_success(fs_channel_t chn);
 bool fs_failed(fs_channel_t chn);
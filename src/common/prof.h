@@ -2,8 +2,11 @@
     A simple profiling helper module.
 */
 typedef enum {
-    PROF_FRAME,     // frame time
-    PROF_EMU,       // emulator time
+    PROF_FRAME,             // frame time
+    PROF_EMU,               // emulator time
+    PROF_RUNAHEAD,          // run-ahead part of emulator time
+    PROF_RUNAHEAD_FRAME,    // one frame run ahead
+    PROF_RUNAHEAD_RESTORE,  // going back after running ahead
     PROF_NUM_BUCKET_TYPES,
 } prof_bucket_type_t;
 
@@ -1,8 +1,13 @@
 #include "./x65.h"
 
 #include "chips/clk.h"
+#include "util/snapfile.h"
+#include "util/lz.h"
 
 #include <string.h>  // memcpy, memset
+#include <stdlib.h>  // malloc, free
+#include <errno.h>
+#include <time.h>
 
 #ifndef CHIPS_ASSERT
     #include <assert.h>
@@ -10,23 +15,38 @@
 #endif
 
 static uint8_t _x65_vpu_fetch(uint32_t addr, void* user_data);
+static uint8_t _x65_dma(const ria816_dma_t* dma, void* user_data);
+static uint64_t _x65_dma_pins(const x65_t* sys);
+static void _x65_dma_cycle_done(x65_t* sys, uint64_t pins);
+static uint8_t _x65_api_call(uint8_t op, void* user_data);
+static uint8_t _x65_fd_rw(uint8_t fd, bool write, uint8_t* data, void* user_data);
 
 #define _X65_DEFAULT(val, def) (((val) != 0) ? (val) : (def))
 
-void x65_init(x65_t* sys, const x65_desc_t* desc) {
+bool x65_init(x65_t* sys, const x65_desc_t* desc) {
     CHIPS_ASSERT(sys && desc);
     if (desc->debug.callback.func) {
         CHIPS_ASSERT(desc->debug.stopped);
     }
 
     memset(sys, 0, sizeof(x65_t));
+    const bool ram_ok = desc->huge_pages ? guestmem_alloc_huge(&sys->mem, X65_RAM_SIZE)
+                                         : guestmem_alloc(&sys->mem, X65_RAM_SIZE);
+    if (!ram_ok) {
+        return false;
+    }
+    sys->ram = sys->mem.ptr;
     sys->valid = true;
     sys->running = false;
     sys->joystick_type = desc->joystick_type;
     sys->debug = desc->debug;
     sys->audio.callback = desc->audio.callback;
     sys->audio.num_samples = _X65_DEFAULT(desc->audio.num_samples, X65_DEFAULT_AUDIO_SAMPLES);
+    sys->fs = desc->fs;
+    sys->dirty.enabled = desc->track_dirty_pages;
+    hostfs_close_all(sys->fs);
     CHIPS_ASSERT(sys->audio.num_samples <= X65_MAX_AUDIO_SAMPLES);
+    CHIPS_ASSERT(X65_MAX_AUDIO_SAMPLES <= MIXER_MAX_SAMPLES);
 
     // initialize the hardware
     sys->pins = w65816_init(&sys->cpu, &(w65816_desc_t){});
@@ -34,6 +54,13 @@ void x65_init(x65_t* sys, const x65_desc_t* desc) {
         &sys->ria,
         &(ria816_desc_t){
             .tick_hz = X65_FREQUENCY,
+            .dma_cb = _x65_dma,
+            .api_cb = _x65_api_call,
+            .fd_cb = _x65_fd_rw,
+            .api_latency = clk_us_to_ticks(X65_FREQUENCY, desc->api_latency_us),
+            .uart_buffer_size = desc->uart_buffer_size,
+            .rng_seed = desc->rng_seed,
+            .user_data = sys,
         });
     tca6416a_init(&sys->gpio, 0xff, 0xff);
     cgia_init(&sys->cgia, &(cgia_desc_t){
@@ -48,7 +75,7 @@ void x65_init(x65_t* sys, const x65_desc_t* desc) {
     const beeper_desc_t beeper_desc = {
         .tick_hz = X65_FREQUENCY,
         .sound_hz = _X65_DEFAULT(desc->audio.sample_rate, 44100),
-        .base_volume = _X65_DEFAULT(desc->audio.volume, 1.0f),
+        .base_volume = 1.0f,
     };
     beeper_init(&sys->beeper[0], &beeper_desc);
     beeper_init(&sys->beeper[1], &beeper_desc);
@@ -57,11 +84,23 @@ void x65_init(x65_t* sys, const x65_desc_t* desc) {
         &(ymf262_desc_t){
             .tick_hz = X65_FREQUENCY,
             .sound_hz = _X65_DEFAULT(desc->audio.sample_rate, 44100),
+            .threaded = desc->fm_thread,
+            .latency = sys->audio.num_samples,
+        });
+    mixer_init(
+        &sys->mixer,
+        &(mixer_desc_t){
+            .volume = _X65_DEFAULT(desc->audio.volume, 1.0f),
         });
+    return true;
 }
 
 void x65_discard(x65_t* sys) {
     CHIPS_ASSERT(sys && sys->valid);
+    cgia_discard(&sys->cgia);
+    ymf262_discard(&sys->opl3);
+    guestmem_free(&sys->mem);
+    sys->ram = 0;
     sys->valid = false;
 }
 
@@ -70,12 +109,15 @@ void x65_reset(x65_t* sys) {
     sys->kbd_joy1_mask = sys->kbd_joy2_mask = 0;
     sys->joy_joy1_mask = sys->joy_joy2_mask = 0;
     sys->pins |= W65816_RES;
+    memset(&sys->dma, 0, sizeof(sys->dma));
     ria816_reset(&sys->ria);
+    hostfs_close_all(sys->fs);
     tca6416a_reset(&sys->gpio, 0xff, 0xff);
     cgia_reset(&sys->cgia);
     beeper_reset(&sys->beeper[0]);
     beeper_reset(&sys->beeper[1]);
     ymf262_reset(&sys->opl3);
+    mixer_reset(&sys->mixer);
 }
 
 void x65_set_running(x65_t* sys, bool running) {
@@ -83,14 +125,65 @@ void x65_set_running(x65_t* sys, bool running) {
     sys->running = running;
 }
 
-static uint64_t _x65_tick(x65_t* sys, uint64_t pins) {
+// new audio sample ready, each source goes into its own mixer block buffer
+static void _x65_audio_sample(x65_t* sys) {
+    if (sys->audio.muted) {
+        return;
+    }
+    const int pos = sys->audio.sample_pos++;
+    if (!sys->opl3.worker) {
+        mixer_put(&sys->mixer, MIXER_SOURCE_FM, pos, sys->opl3.samples[0], sys->opl3.samples[1]);
+    }
+    mixer_put_mono(&sys->mixer, MIXER_SOURCE_PWM0, pos, sys->beeper[0].sample);
+    mixer_put_mono(&sys->mixer, MIXER_SOURCE_PWM1, pos, sys->beeper[1].sample);
+    mixer_put_mono(&sys->mixer, MIXER_SOURCE_SD1, pos, 0.0f);
+    if (sys->audio.sample_pos == sys->audio.num_samples) {
+        if (sys->opl3.worker) {
+            // FM block was rendered ahead by the synthesis thread
+            ymf262_read_samples(&sys->opl3, sys->mixer.source[MIXER_SOURCE_FM], sys->audio.num_samples);
+        }
+        mixer_mix(&sys->mixer, sys->audio.sample_buffer, sys->audio.num_samples);
+        if (sys->audio.callback.func) {
+            sys->audio.callback.func(sys->audio.sample_buffer, sys->audio.num_samples, sys->audio.callback.user_data);
+        }
+        sys->audio.sample_pos = 0;
+    }
+}
+
+// mark RAM written by bulk transfers, the tick inlines its own check
+static void _x65_dirty_range(x65_t* sys, uint32_t addr, uint32_t count) {
+    if (sys->dirty.enabled && count) {
+        const uint32_t last = (addr + count - 1) / X65_RAM_PAGE_SIZE;
+        for (uint32_t page = addr / X65_RAM_PAGE_SIZE; page <= last; page++) {
+            sys->dirty.map[page >> 3] |= (uint8_t)(1 << (page & 7));
+        }
+    }
+}
+
+/* track_dirty is a compile-time constant at both call sites, so the
+   untracked tick has no extra work on the RAM write path
+*/
+static inline __attribute__((always_inline)) uint64_t _x65_tick(x65_t* sys, uint64_t pins, const bool track_dirty) {
     if (!sys->running) {
         // keep CPU in RESET state
         pins |= W65816_RES;
     }
 
-    // tick the CPU
-    pins = w65816_tick(&sys->cpu, pins);
+    bool sync = false;
+    uint64_t cpu_pins = 0;
+    const bool dma = sys->dma.req.count != 0;
+    if (dma) {
+        // the DMA engine owns the bus, the CPU waits with its pins kept
+        cpu_pins = pins;
+        pins = _x65_dma_pins(sys);
+    }
+    else {
+        // opcode fetch cycle, either an instruction or an interrupt sequence starts
+        sync = (pins & (W65816_VPA | W65816_VDA)) == (W65816_VPA | W65816_VDA);
+
+        // tick the CPU
+        pins = w65816_tick(&sys->cpu, pins);
+    }
     const uint32_t addr = W65816_GET_ADDR(pins) & 0xFFFFFF;
 
     // those pins are set each tick by the CIAs and VIC
@@ -107,6 +200,7 @@ static uint64_t _x65_tick(x65_t* sys, uint64_t pins) {
     uint64_t gpio_pins = pins & W65816_PIN_MASK;
     uint64_t sd1_pins = pins & W65816_PIN_MASK;
     uint64_t opl3_pins = pins & W65816_PIN_MASK;
+    uint64_t mixer_pins = pins & W65816_PIN_MASK;
     if ((pins & (W65816_RDY | W65816_RW)) != (W65816_RDY | W65816_RW)) {
         if (sys->ria.reg[RIA816_EXT_IO] && ((addr & 0xFF00) == X65_EXT_BASE)) {
             const uint8_t slot = (addr & 0xFF) >> 5;
@@ -147,8 +241,8 @@ static uint64_t _x65_tick(x65_t* sys, uint64_t pins) {
                 sd1_pins |= 0;  // FIXME: YMF825_CS;
             }
             else if (addr >= X65_IO_MIXER_BASE) {
-                // SD-1 (FEB0..FEBF)
-                // FIXME: MIXER_CS;
+                // Audio mixer (FEB0..FEBF)
+                mixer_pins |= MIXER_CS;
             }
         }
         else {
@@ -178,8 +272,17 @@ static uint64_t _x65_tick(x65_t* sys, uint64_t pins) {
     }
 
     /* tick RIA816:
-     */
+        SYNC and INTACK feed the performance counters
+    */
     {
+        if (sync) {
+            if (sys->cpu.brk_flags & (W65816_BRK_IRQ | W65816_BRK_NMI)) {
+                ria_pins |= RIA816_INTACK;
+            }
+            else if (!sys->cpu.brk_flags) {
+                ria_pins |= RIA816_SYNC;
+            }
+        }
         ria_pins = ria816_tick(&sys->ria, ria_pins);
         if ((ria_pins & (RIA816_CS | RIA816_RW)) == (RIA816_CS | RIA816_RW)) {
             pins = W65816_COPY_DATA(pins, ria_pins);
@@ -204,23 +307,19 @@ static uint64_t _x65_tick(x65_t* sys, uint64_t pins) {
     beeper_set(&sys->beeper[1], pwm_get_state(&sys->cgia.pwm[1]));
     beeper_tick(&sys->beeper[1]);
 
+    // tick the audio mixer (register access only, mixing is done per block)
+    {
+        mixer_pins = mixer_tick(&sys->mixer, mixer_pins);
+        if ((mixer_pins & (MIXER_CS | MIXER_RW)) == (MIXER_CS | MIXER_RW)) {
+            pins = W65816_COPY_DATA(pins, mixer_pins);
+        }
+    }
+
     // tick the FM chip
     {
         opl3_pins = ymf262_tick(&sys->opl3, opl3_pins);
         if (opl3_pins & YMF262_SAMPLE) {
-            // new audio sample ready
-            sys->audio.sample_buffer[sys->audio.sample_pos++] =
-                (sys->opl3.samples[0] + sys->opl3.samples[1]) / 2.0f  // average left and right channels
-                + sys->beeper[0].sample + sys->beeper[1].sample;
-            if (sys->audio.sample_pos == sys->audio.num_samples) {
-                if (sys->audio.callback.func) {
-                    sys->audio.callback.func(
-                        sys->audio.sample_buffer,
-                        sys->audio.num_samples,
-                        sys->audio.callback.user_data);
-                }
-                sys->audio.sample_pos = 0;
-            }
+            _x65_audio_sample(sys);
         }
         if ((opl3_pins & (YMF262_CS | YMF262_RW)) == (YMF262_CS | YMF262_RW)) {
             pins = W65816_COPY_DATA(pins, opl3_pins);
@@ -249,8 +348,16 @@ static uint64_t _x65_tick(x65_t* sys, uint64_t pins) {
             uint8_t data = W65816_GET_DATA(pins);
             sys->ram[addr] = data;
             cgia_mem_wr(&sys->cgia, addr, data);
+            if (track_dirty) {
+                const uint32_t page = addr / X65_RAM_PAGE_SIZE;
+                sys->dirty.map[page >> 3] |= (uint8_t)(1 << (page & 7));
+            }
         }
     }
+    if (dma) {
+        _x65_dma_cycle_done(sys, pins);
+        pins = (cpu_pins & ~(W65816_IRQ | W65816_NMI)) | (pins & (W65816_IRQ | W65816_NMI));
+    }
     return pins;
 }
 
@@ -264,8 +371,12 @@ uint8_t mem_rd(x65_t* sys, uint8_t bank, uint16_t addr) {
             return 0xFF;
         }
         else if (addr >= 0xFF00) {
+            cgia_activate(&sys->cgia);
             return sys->cgia.regs[addr & 0x7F];
         }
+        else if (addr >= X65_IO_MIXER_BASE && addr < X65_IO_MIXER_BASE + X65_IO_MIXER_LEN) {
+            return sys->mixer.reg[addr & (X65_IO_MIXER_LEN - 1)];
+        }
     }
     return sys->ram[(bank << 16) | addr];
 }
@@ -280,13 +391,19 @@ void mem_wr(x65_t* sys, uint8_t bank, uint16_t addr, uint8_t data) {
             return;
         }
         else if (addr >= 0xFF00) {
+            cgia_activate(&sys->cgia);
             sys->cgia.regs[addr & 0x7F] = data;
             return;
         }
+        else if (addr >= X65_IO_MIXER_BASE && addr < X65_IO_MIXER_BASE + X65_IO_MIXER_LEN) {
+            sys->mixer.reg[addr & (X65_IO_MIXER_LEN - 1)] = data;
+            return;
+        }
     }
     const uint32_t full_addr = (bank << 16) | addr;
     sys->ram[full_addr] = data;
     cgia_mem_wr(&sys->cgia, full_addr, data);
+    _x65_dirty_range(sys, full_addr, 1);
 }
 
 uint8_t _x65_vpu_fetch(uint32_t addr, void* user_data) {
@@ -294,27 +411,443 @@ uint8_t _x65_vpu_fetch(uint32_t addr, void* user_data) {
     return sys->ram[addr & 0xFFFFFF];
 }
 
-uint32_t x65_exec(x65_t* sys, uint32_t micro_seconds) {
-    CHIPS_ASSERT(sys && sys->valid);
-    uint32_t num_ticks = clk_us_to_ticks(X65_FREQUENCY, micro_seconds);
-    uint64_t pins = sys->pins;
+/*  DMA
+
+    Plain RAM transfers are done directly on the ram array, unit-step
+    copies with memmove() semantics (overlapping ranges are safe) and
+    a single VRAM cache update for the destination range.
+    Transfers which reach the bank 0 I/O window take the bus from the
+    CPU: each register access is a bus cycle of the tick, decoded like
+    a CPU access while the CPU waits, so the chips see the bytes on the
+    system clock (e.g. streaming a buffer into the OPL3 data port with a
+    zero destination step). Their RAM accesses are done in between
+    without a cycle. RIA and timer registers can't be reached by DMA.
+*/
+static bool _x65_dma_is_io(const x65_t* sys, uint32_t addr) {
+    if (addr >= X65_IO_BASE && addr <= 0xFFFF) {
+        return true;
+    }
+    if ((addr & 0xFFFF00) == X65_EXT_BASE) {
+        return sys->ria.reg[RIA816_EXT_IO] & (1U << ((addr & 0xFF) >> 5));
+    }
+    return false;
+}
+
+static bool _x65_dma_is_unreachable(uint32_t addr) {
+    return (addr >= X65_IO_RIA_BASE && addr <= 0xFFFF) || (addr >= X65_IO_TIMERS_BASE && addr < 0xFF90);
+}
+
+// do the RAM accesses of the pending transfer up to its next I/O access
+static void _x65_dma_advance(x65_t* sys) {
+    ria816_dma_t* dma = &sys->dma.req;
+    while (dma->count) {
+        if (!sys->dma.has_data) {
+            if (_x65_dma_is_io(sys, dma->src)) {
+                return;
+            }
+            sys->dma.data = sys->ram[dma->src];
+            sys->dma.has_data = true;
+            dma->src += dma->src_step;
+        }
+        if (_x65_dma_is_io(sys, dma->dst)) {
+            return;
+        }
+        sys->ram[dma->dst] = sys->dma.data;
+        cgia_mem_wr(&sys->cgia, dma->dst, sys->dma.data);
+        _x65_dirty_range(sys, dma->dst, 1);
+        sys->dma.has_data = false;
+        dma->dst += dma->dst_step;
+        dma->count--;
+    }
+}
+
+// bus pins of the next I/O access, the source is read before the destination is written
+static uint64_t _x65_dma_pins(const x65_t* sys) {
+    uint64_t pins = 0;
+    if (sys->dma.has_data) {
+        W65816_SET_ADDR(pins, (uint64_t)sys->dma.req.dst);
+        W65816_SET_DATA(pins, sys->dma.data);
+    }
+    else {
+        // unmapped registers read as $FF
+        W65816_SET_ADDR(pins, (uint64_t)sys->dma.req.src);
+        W65816_SET_DATA(pins, 0xFF);
+        pins |= W65816_RW;
+    }
+    return pins;
+}
+
+static void _x65_dma_cycle_done(x65_t* sys, uint64_t pins) {
+    ria816_dma_t* dma = &sys->dma.req;
+    if (sys->dma.has_data) {
+        sys->dma.has_data = false;
+        dma->dst += dma->dst_step;
+        dma->count--;
+    }
+    else {
+        sys->dma.data = W65816_GET_DATA(pins);
+        sys->dma.has_data = true;
+        dma->src += dma->src_step;
+    }
+    _x65_dma_advance(sys);
+}
+
+static uint8_t _x65_dma(const ria816_dma_t* dma, void* user_data) {
+    x65_t* sys = (x65_t*)user_data;
+    CHIPS_ASSERT(sys && dma && dma->count > 0);
+    const int32_t n = dma->count - 1;
+    const int32_t src_end = (int32_t)dma->src + dma->src_step * n;
+    const int32_t dst_end = (int32_t)dma->dst + dma->dst_step * n;
+    if (src_end < 0 || src_end > 0xFFFFFF || dst_end < 0 || dst_end > 0xFFFFFF) {
+        return RIA816_DMA_ERR_RANGE;
+    }
+
+    // I/O can only be hit if a range reaches into the bank 0 extension/I/O pages
+    const uint32_t src_hi = (uint32_t)(src_end > (int32_t)dma->src ? src_end : (int32_t)dma->src);
+    const uint32_t src_lo = (uint32_t)(src_end < (int32_t)dma->src ? src_end : (int32_t)dma->src);
+    const uint32_t dst_hi = (uint32_t)(dst_end > (int32_t)dma->dst ? dst_end : (int32_t)dma->dst);
+    const uint32_t dst_lo = (uint32_t)(dst_end < (int32_t)dma->dst ? dst_end : (int32_t)dma->dst);
+    const bool src_ram = src_lo > 0xFFFF || src_hi < X65_EXT_BASE;
+    const bool dst_ram = dst_lo > 0xFFFF || dst_hi < X65_EXT_BASE;
+
+    if (src_ram && dst_ram) {
+        if (dma->src_step == 1 && dma->dst_step == 1) {
+            memmove(&sys->ram[dma->dst], &sys->ram[dma->src], dma->count);
+            cgia_mem_wr_range(&sys->cgia, dma->dst, &sys->ram[dma->dst], dma->count);
+            _x65_dirty_range(sys, dma->dst, dma->count);
+        }
+        else {
+            uint32_t src = dma->src, dst = dma->dst;
+            for (int i = 0; i < dma->count; i++) {
+                sys->ram[dst] = sys->ram[src];
+                cgia_mem_wr(&sys->cgia, dst, sys->ram[dst]);
+                _x65_dirty_range(sys, dst, 1);
+                src += dma->src_step;
+                dst += dma->dst_step;
+            }
+        }
+        return RIA816_DMA_OK;
+    }
+
+    // validate the whole transfer first, so a failing one has no side effects
+    uint32_t src = dma->src, dst = dma->dst;
+    for (int i = 0; i < dma->count; i++) {
+        if (_x65_dma_is_unreachable(src) || _x65_dma_is_unreachable(dst)) {
+            return RIA816_DMA_ERR_IO;
+        }
+        src += dma->src_step;
+        dst += dma->dst_step;
+    }
+    // the CPU can't start another transfer before this one is done
+    CHIPS_ASSERT(sys->dma.req.count == 0);
+    sys->dma.req = *dma;
+    sys->dma.has_data = false;
+    _x65_dma_advance(sys);
+    return RIA816_DMA_OK;
+}
+
+/*  Kernel API calls
+
+    Operations which the firmware implements are done natively in a
+    single step, through a dispatch table. File operations are served
+    from the host directory, reads and writes of guest RAM go straight
+    to/from the ram array (the RAM behind the I/O window, not the chip
+    registers). The guest still sees RIA816_API_BUSY for the configured
+    x65_desc_t.api_latency_us.
+*/
+static uint8_t _x65_api_errno(int err) {
+    switch (err) {
+        case ENOENT:
+        case ENOTDIR: return RIA816_ERRNO_ENOENT;
+        case ENOMEM: return RIA816_ERRNO_ENOMEM;
+        case EACCES:
+        case EPERM:
+        case EROFS:
+        case EISDIR: return RIA816_ERRNO_EACCES;
+        case ENODEV: return RIA816_ERRNO_ENODEV;
+        case EMFILE:
+        case ENFILE: return RIA816_ERRNO_EMFILE;
+        case EBUSY: return RIA816_ERRNO_EBUSY;
+        case EINVAL:
+        case ENAMETOOLONG: return RIA816_ERRNO_EINVAL;
+        case ENOSPC: return RIA816_ERRNO_ENOSPC;
+        case EEXIST: return RIA816_ERRNO_EEXIST;
+        case EAGAIN: return RIA816_ERRNO_EAGAIN;
+        case EIO: return RIA816_ERRNO_EIO;
+        case EINTR: return RIA816_ERRNO_EINTR;
+        case ENOSYS: return RIA816_ERRNO_ENOSYS;
+        case ESPIPE: return RIA816_ERRNO_ESPIPE;
+        case ERANGE:
+        case EOVERFLOW: return RIA816_ERRNO_ERANGE;
+        case EBADF: return RIA816_ERRNO_EBADF;
+        default: return RIA816_ERRNO_EUNKNOWN;
+    }
+}
+
+// replace remaining call parameters with a 16-bit result, -1 on failure
+static uint8_t _x65_api_return16(x65_t* sys, int32_t result) {
+    ria816_api_zxstack(&sys->ria);
+    ria816_api_push16(&sys->ria, (uint16_t)(result < 0 ? -1 : result));
+    return result < 0 ? _x65_api_errno(errno) : RIA816_ERRNO_OK;
+}
+
+// replace remaining call parameters with a 32-bit result, -1 on failure
+static uint8_t _x65_api_return32(x65_t* sys, int64_t result) {
+    if (result > INT32_MAX) {
+        errno = EOVERFLOW;
+        result = -1;
+    }
+    ria816_api_zxstack(&sys->ria);
+    ria816_api_push32(&sys->ria, (uint32_t)(result < 0 ? -1 : result));
+    return result < 0 ? _x65_api_errno(errno) : RIA816_ERRNO_OK;
+}
+
+// fail a file operation if no host directory is attached
+static bool _x65_api_has_fs(x65_t* sys) {
+    if (!sys->fs) {
+        errno = ENODEV;
+    }
+    return sys->fs != 0;
+}
+
+static uint8_t _x65_api_open(x65_t* sys) {
+    ria816_t* ria = &sys->ria;
+    const uint8_t flags = ria816_api_pop(ria);
+    char path[RIA816_API_STACK_SIZE + 1];
+    uint16_t len = 0;
+    while (ria816_api_stack_len(ria) > 0) {
+        const char c = (char)ria816_api_pop(ria);
+        if (c == 0) break;
+        path[len++] = c;
+    }
+    path[len] = 0;
+    return _x65_api_return16(sys, _x65_api_has_fs(sys) ? hostfs_open(sys->fs, path, flags) : -1);
+}
+
+static uint8_t _x65_api_close(x65_t* sys) {
+    const uint8_t fd = ria816_api_pop(&sys->ria);
+    return _x65_api_return16(sys, _x65_api_has_fs(sys) ? hostfs_close(sys->fs, fd) : -1);
+}
+
+static uint8_t _x65_api_read_stack(x65_t* sys) {
+    ria816_t* ria = &sys->ria;
+    const uint8_t fd = ria816_api_pop(ria);
+    uint16_t count = ria816_api_pop16(ria);
+    if (count > RIA816_API_STACK_SIZE - 2) {
+        count = RIA816_API_STACK_SIZE - 2;  // leave room for the result
+    }
+    uint8_t buf[RIA816_API_STACK_SIZE];
+    const int32_t n = _x65_api_has_fs(sys) ? hostfs_read(sys->fs, fd, buf, count) : -1;
+    const uint8_t err = _x65_api_return16(sys, n);
+    if (n > 0) {
+        // data goes below the result, so it is popped in file order after it
+        ria816_api_zxstack(ria);
+        for (int32_t i = n - 1; i >= 0; i--) {
+            ria816_api_push(ria, buf[i]);
+        }
+        ria816_api_push16(ria, (uint16_t)n);
+    }
+    return err;
+}
+
+static uint8_t _x65_api_write_stack(x65_t* sys) {
+    ria816_t* ria = &sys->ria;
+    const uint8_t fd = ria816_api_pop(ria);
+    const uint16_t count = ria816_api_stack_len(ria);
+    const uint8_t* data = &ria->api.stack[ria->api.sp];
+    return _x65_api_return16(sys, _x65_api_has_fs(sys) ? hostfs_write(sys->fs, fd, data, count) : -1);
+}
+
+static uint8_t _x65_api_read_ram(x65_t* sys) {
+    ria816_t* ria = &sys->ria;
+    const uint8_t fd = ria816_api_pop(ria);
+    const uint16_t count = ria816_api_pop16(ria);
+    const uint32_t addr = ria816_api_pop24(ria);
+    if (addr + count > X65_RAM_SIZE) {
+        errno = EINVAL;
+        return _x65_api_return16(sys, -1);
+    }
+    const int32_t n = _x65_api_has_fs(sys) ? hostfs_read(sys->fs, fd, &sys->ram[addr], count) : -1;
+    if (n > 0) {
+        cgia_mem_wr_range(&sys->cgia, addr, &sys->ram[addr], (uint32_t)n);
+        _x65_dirty_range(sys, addr, (uint32_t)n);
+    }
+    return _x65_api_return16(sys, n);
+}
+
+static uint8_t _x65_api_write_ram(x65_t* sys) {
+    ria816_t* ria = &sys->ria;
+    const uint8_t fd = ria816_api_pop(ria);
+    const uint16_t count = ria816_api_pop16(ria);
+    const uint32_t addr = ria816_api_pop24(ria);
+    if (addr + count > X65_RAM_SIZE) {
+        errno = EINVAL;
+        return _x65_api_return16(sys, -1);
+    }
+    return _x65_api_return16(sys, _x65_api_has_fs(sys) ? hostfs_write(sys->fs, fd, &sys->ram[addr], count) : -1);
+}
+
+static uint8_t _x65_api_lseek(x65_t* sys) {
+    ria816_t* ria = &sys->ria;
+    const uint8_t fd = ria816_api_pop(ria);
+    const uint8_t whence = ria816_api_pop(ria);
+    const int32_t offset = (int32_t)ria816_api_pop32(ria);
+    return _x65_api_return32(sys, _x65_api_has_fs(sys) ? hostfs_lseek(sys->fs, fd, offset, whence) : -1);
+}
+
+static uint8_t _x65_api_lrand(x65_t* sys) {
+    ria816_api_zxstack(&sys->ria);
+    ria816_api_push32(&sys->ria, ria816_rand32(&sys->ria));
+    return RIA816_ERRNO_OK;
+}
+
+static uint8_t _x65_api_clock(x65_t* sys) {
+    ria816_api_zxstack(&sys->ria);
+    ria816_api_push32(&sys->ria, (uint32_t)(sys->ria.us / (1000000 / RIA816_CLOCKS_PER_SEC)));
+    return RIA816_ERRNO_OK;
+}
+
+static uint8_t _x65_api_clock_gettime(x65_t* sys) {
+    const uint8_t clock_id = ria816_api_pop(&sys->ria);
+    uint64_t sec, nsec;
+    if (clock_id == 0) {
+        struct timespec ts;
+        timespec_get(&ts, TIME_UTC);
+        sec = (uint64_t)ts.tv_sec;
+        nsec = (uint64_t)ts.tv_nsec;
+    }
+    else if (clock_id == 1) {
+        sec = sys->ria.us / 1000000;
+        nsec = (sys->ria.us % 1000000) * 1000;
+    }
+    else {
+        errno = EINVAL;
+        return _x65_api_return32(sys, -1);
+    }
+    ria816_api_zxstack(&sys->ria);
+    ria816_api_push32(&sys->ria, (uint32_t)nsec);
+    ria816_api_push32(&sys->ria, (uint32_t)sec);
+    return RIA816_ERRNO_OK;
+}
+
+static uint8_t _x65_api_memset(x65_t* sys) {
+    ria816_t* ria = &sys->ria;
+    const uint32_t addr = ria816_api_pop24(ria);
+    const uint8_t value = ria816_api_pop(ria);
+    const uint16_t count = ria816_api_pop16(ria);
+    if (addr + count > X65_RAM_SIZE) {
+        errno = EINVAL;
+        return _x65_api_return16(sys, -1);
+    }
+    memset(&sys->ram[addr], value, count);
+    cgia_mem_wr_range(&sys->cgia, addr, &sys->ram[addr], count);
+    _x65_dirty_range(sys, addr, count);
+    return _x65_api_return16(sys, 0);
+}
+
+static uint8_t _x65_api_memcpy(x65_t* sys) {
+    ria816_t* ria = &sys->ria;
+    const uint32_t dst = ria816_api_pop24(ria);
+    const uint32_t src = ria816_api_pop24(ria);
+    const uint16_t count = ria816_api_pop16(ria);
+    if (dst + count > X65_RAM_SIZE || src + count > X65_RAM_SIZE) {
+        errno = EINVAL;
+        return _x65_api_return16(sys, -1);
+    }
+    memmove(&sys->ram[dst], &sys->ram[src], count);
+    cgia_mem_wr_range(&sys->cgia, dst, &sys->ram[dst], count);
+    _x65_dirty_range(sys, dst, count);
+    return _x65_api_return16(sys, 0);
+}
+
+// natively implemented kernel API operations, indexed by operation id
+typedef uint8_t (*_x65_api_op_t)(x65_t* sys);
+static const _x65_api_op_t _x65_api_ops[RIA816_API_NUM_OPS] = {
+    [RIA816_API_OP_LRAND] = _x65_api_lrand,
+    [RIA816_API_OP_CLOCK] = _x65_api_clock,
+    [RIA816_API_OP_CLOCK_GETTIME] = _x65_api_clock_gettime,
+    [RIA816_API_OP_OPEN] = _x65_api_open,
+    [RIA816_API_OP_CLOSE] = _x65_api_close,
+    [RIA816_API_OP_READ_STACK] = _x65_api_read_stack,
+    [RIA816_API_OP_READ_RAM] = _x65_api_read_ram,
+    [RIA816_API_OP_WRITE_STACK] = _x65_api_write_stack,
+    [RIA816_API_OP_WRITE_RAM] = _x65_api_write_ram,
+    [RIA816_API_OP_LSEEK] = _x65_api_lseek,
+    [RIA816_API_OP_MEMSET] = _x65_api_memset,
+    [RIA816_API_OP_MEMCPY] = _x65_api_memcpy,
+};
+
+static uint8_t _x65_api_call(uint8_t op, void* user_data) {
+    x65_t* sys = (x65_t*)user_data;
+    CHIPS_ASSERT(sys);
+    if (!_x65_api_ops[op]) {
+        ria816_api_zxstack(&sys->ria);
+        return RIA816_ERRNO_ENOSYS;
+    }
+    return _x65_api_ops[op](sys);
+}
+
+static uint8_t _x65_fd_rw(uint8_t fd, bool write, uint8_t* data, void* user_data) {
+    x65_t* sys = (x65_t*)user_data;
+    CHIPS_ASSERT(sys && data);
+    if (!sys->fs) {
+        return RIA816_ERRNO_ENODEV;
+    }
+    const int32_t n = write ? hostfs_write(sys->fs, fd, data, 1) : hostfs_read(sys->fs, fd, data, 1);
+    if (n < 0) {
+        return _x65_api_errno(errno);
+    }
+    return (n == 0) ? RIA816_ERRNO_EOF : RIA816_ERRNO_OK;
+}
+
+static inline __attribute__((always_inline)) uint64_t _x65_exec_ticks(
+    x65_t* sys, uint64_t pins, uint32_t num_ticks, const bool track_dirty) {
     if (0 == sys->debug.callback.func) {
         // run without debug callback
         for (uint32_t ticks = 0; ticks < num_ticks; ticks++) {
-            pins = _x65_tick(sys, pins);
+            pins = _x65_tick(sys, pins, track_dirty);
         }
     }
     else {
         // run with debug callback
         for (uint32_t ticks = 0; (ticks < num_ticks) && !(*sys->debug.stopped); ticks++) {
-            pins = _x65_tick(sys, pins);
+            pins = _x65_tick(sys, pins, track_dirty);
             sys->debug.callback.func(sys->debug.callback.user_data, pins);
         }
     }
-    sys->pins = pins;
+    return pins;
+}
+
+uint32_t x65_exec(x65_t* sys, uint32_t micro_seconds) {
+    CHIPS_ASSERT(sys && sys->valid);
+    uint32_t num_ticks = clk_us_to_ticks(X65_FREQUENCY, micro_seconds);
+    if (sys->dirty.enabled) {
+        sys->pins = _x65_exec_ticks(sys, sys->pins, num_ticks, true);
+    }
+    else {
+        sys->pins = _x65_exec_ticks(sys, sys->pins, num_ticks, false);
+    }
     return num_ticks;
 }
 
+void x65_set_dirty_tracking(x65_t* sys, bool enabled) {
+    CHIPS_ASSERT(sys && sys->valid);
+    if (enabled && !sys->dirty.enabled) {
+        x65_clear_dirty_pages(sys);
+    }
+    sys->dirty.enabled = enabled;
+}
+
+bool x65_dirty_page(const x65_t* sys, uint32_t page) {
+    CHIPS_ASSERT(sys && sys->valid && (page < X65_RAM_NUM_PAGES));
+    return 0 != (sys->dirty.map[page >> 3] & (1 << (page & 7)));
+}
+
+void x65_clear_dirty_pages(x65_t* sys) {
+    CHIPS_ASSERT(sys && sys->valid);
+    memset(sys->dirty.map, 0, sizeof(sys->dirty.map));
+}
+
 void x65_key_down(x65_t* sys, int key_code) {
     CHIPS_ASSERT(sys && sys->valid);
     uint8_t m = 0;
@@ -381,6 +914,92 @@ void x65_joystick(x65_t* sys, uint8_t joy1_mask, uint8_t joy2_mask) {
     sys->joy_joy2_mask = joy2_mask;
 }
 
+/*  XEX loading
+
+    A .xex file is a sequence of segments, each with a start and end
+    address followed by the data, optionally preceded by a $FFFF header.
+    A one byte segment at $FFFE selects the bank of the segments after it.
+
+    A segment header of $FFFD-$FFFC (never valid, the start is past the
+    end) marks a packed segment: start and end address of the unpacked
+    data and the 16-bit size of the LZ4 block (see util/lz.h) holding it.
+    Packed segments can't reach into the bank 0 I/O window, they are
+    unpacked straight into RAM. src/tools/xexpack packs and unpacks files.
+
+    The file is validated before anything is written, including the LZ4
+    blocks. Segment data is copied into RAM in one go and the CGIA VRAM
+    caches are refreshed once at the end, only bytes in the bank 0 I/O
+    window go through mem_wr() to reach the chip registers (e.g. the
+    reset vector in the RIA).
+*/
+typedef struct {
+    const uint8_t* ptr;
+    const uint8_t* end;
+    uint8_t bank;  // set by $FFFE segments
+    bool error;
+} _x65_xex_reader_t;
+
+typedef struct {
+    uint8_t bank;
+    uint16_t start_addr;
+    uint16_t end_addr;
+    const uint8_t* data;
+    uint16_t packed_size;  // size of the LZ4 block at data, 0 if not packed
+} _x65_xex_segment_t;
+
+static bool _x65_xex_next(_x65_xex_reader_t* r, _x65_xex_segment_t* seg) {
+    while (r->ptr < r->end) {
+        size_t data_left = (size_t)(r->end - r->ptr);
+        if (data_left >= 2 && r->ptr[0] == 0xff && r->ptr[1] == 0xff) {
+            // skip header
+            r->ptr += 2;
+            data_left -= 2;
+        }
+        if (data_left < 4) {
+            r->error = true;
+            return false;
+        }
+        uint16_t start_addr = r->ptr[1] << 8 | r->ptr[0];
+        uint16_t end_addr = r->ptr[3] << 8 | r->ptr[2];
+        r->ptr += 4;
+        data_left -= 4;
+        uint16_t packed_size = 0;
+        if (start_addr == X65_XEX_LZ && end_addr == X65_XEX_LZ_END) {
+            if (data_left < 6) {
+                r->error = true;
+                return false;
+            }
+            start_addr = r->ptr[1] << 8 | r->ptr[0];
+            end_addr = r->ptr[3] << 8 | r->ptr[2];
+            packed_size = r->ptr[5] << 8 | r->ptr[4];
+            r->ptr += 6;
+            data_left -= 6;
+            if (start_addr > end_addr || packed_size == 0 || data_left < packed_size) {
+                r->error = true;
+                return false;
+            }
+        }
+        else if (start_addr > end_addr || data_left < (size_t)(end_addr - start_addr + 1)) {
+            r->error = true;
+            return false;
+        }
+        else if (start_addr == end_addr && start_addr == X65_XEX_BANK) {
+            r->bank = *r->ptr++;
+            continue;
+        }
+        seg->bank = r->bank;
+        seg->start_addr = start_addr;
+        seg->end_addr = end_addr;
+        seg->data = r->ptr;
+        seg->packed_size = packed_size;
+        r->ptr += packed_size ? packed_size : (end_addr - start_addr + 1);
+        return true;
+    }
+    return false;
+}
+
+static_assert(X65_XEX_IO == X65_IO_BASE, "packed XEX segments must stop at the I/O window");
+
 bool x65_quickload_xex(x65_t* sys, chips_range_t data) {
     CHIPS_ASSERT(sys && sys->valid && data.ptr);
     if (data.size < 2) {
@@ -388,51 +1007,59 @@ bool x65_quickload_xex(x65_t* sys, chips_range_t data) {
     }
     const uint8_t* ptr = (uint8_t*)data.ptr;
 
-    bool reset_lo_loaded = false;
-    bool reset_hi_loaded = false;
-
-    bool load_bank = 0x00;
-
     // $FFFF is required in first block
     if (ptr[0] != 0xff || ptr[1] != 0xff) {
         return false;
     }
 
-    while (ptr < ((uint8_t*)data.ptr + data.size)) {
-        size_t data_left = (uint8_t*)data.ptr + data.size - ptr;
-        if (data_left < 4) {
-            return false;
-        }
-        if (ptr[0] == 0xff && ptr[1] == 0xff) {
-            // skip header
-            ptr += 2;
-            data_left -= 2;
-            if (data_left < 4) {
+    _x65_xex_reader_t reader = { .ptr = ptr, .end = ptr + data.size };
+    _x65_xex_segment_t seg;
+    while (_x65_xex_next(&reader, &seg)) {
+        if (seg.packed_size) {
+            if ((seg.bank == 0 && seg.end_addr >= X65_IO_BASE)
+                || (lz_decompressed_size(seg.data, seg.packed_size) != (size_t)(seg.end_addr - seg.start_addr + 1))) {
                 return false;
             }
         }
+    }
+    if (reader.error) {
+        return false;
+    }
 
-        const uint16_t start_addr = ptr[1] << 8 | ptr[0];
-        ptr += 2;
-        const uint16_t end_addr = ptr[1] << 8 | ptr[0];
-        ptr += 2;
+    bool reset_lo_loaded = false;
+    bool reset_hi_loaded = false;
+    bool ram_loaded = false;
 
-        data_left = (uint8_t*)data.ptr + data.size - ptr;
-        if (data_left < (end_addr - start_addr + 1) || start_addr > end_addr) {
-            return false;
-        }
-        if (start_addr == end_addr && start_addr == 0xFFFE) {
-            load_bank = *ptr++;
+    reader = (_x65_xex_reader_t){ .ptr = ptr, .end = ptr + data.size };
+    while (_x65_xex_next(&reader, &seg)) {
+        uint32_t ram_end = seg.end_addr;
+        if (seg.bank == 0) {
+            if (seg.start_addr <= 0xfffc && seg.end_addr >= 0xfffc) reset_lo_loaded = true;
+            if (seg.start_addr <= 0xfffd && seg.end_addr >= 0xfffd) reset_hi_loaded = true;
+            if (seg.end_addr >= X65_IO_BASE) {
+                const uint16_t io_start = seg.start_addr > X65_IO_BASE ? seg.start_addr : X65_IO_BASE;
+                for (uint32_t addr = io_start; addr <= seg.end_addr; addr++) {
+                    mem_wr(sys, 0, (uint16_t)addr, seg.data[addr - seg.start_addr]);
+                }
+                ram_end = io_start - 1;
+            }
         }
-        else {
-            uint16_t addr = start_addr;
-            while (addr <= end_addr && addr >= start_addr) {
-                if (addr == 0xfffc) reset_lo_loaded = true;
-                if (addr == 0xfffd) reset_hi_loaded = true;
-                mem_wr(sys, load_bank, addr++, *ptr++);
+        if (seg.start_addr <= ram_end) {
+            const uint32_t addr = ((uint32_t)seg.bank << 16) | seg.start_addr;
+            const uint32_t len = ram_end - seg.start_addr + 1;
+            if (seg.packed_size) {
+                lz_decompress(seg.data, seg.packed_size, &sys->ram[addr], len);
             }
+            else {
+                memcpy(&sys->ram[addr], seg.data, len);
+            }
+            _x65_dirty_range(sys, addr, len);
+            ram_loaded = true;
         }
     }
+    if (ram_loaded) {
+        cgia_mirror_vram(&sys->cgia);
+    }
 
     if (reset_lo_loaded && reset_hi_loaded) {
         x65_set_running(sys, true);
@@ -465,29 +1092,747 @@ chips_display_info_t x65_display_info(x65_t* sys) {
     return res;
 }
 
-uint32_t x65_save_snapshot(x65_t* sys, x65_t* dst) {
-    CHIPS_ASSERT(sys && dst);
-    *dst = *sys;
-    chips_debug_snapshot_onsave(&dst->debug);
-    chips_audio_callback_snapshot_onsave(&dst->audio.callback);
-    w65816_snapshot_onsave(&dst->cpu);
-    cgia_snapshot_onsave(&dst->cgia);
-    ymf262_snapshot_onsave(&dst->opl3);
-    return X65_SNAPSHOT_VERSION;
+/* snapshot chunks, bump a chunk version when the layout of the data it holds changes
+
+    THMB: half resolution framebuffer, always the first chunk
+    SYS : x65_t state outside of the chips, required
+    CPU : w65816_t, required
+    RIA : ria816_t, required
+    GPIO: tca6416a_t, required
+    CGIA: cgia_t with the firmware globals, required
+    OPL3: ymf262_t, required
+    MIX : mixer_t, required
+    BEEP: beeper_t[2], required
+    RAM : page bitmap followed by the stored pages, required
+    FB  : framebuffer
+*/
+#define _X65_SNAPSHOT_MAGIC  "X65S"
+#define _X65_CHUNK_SYS_VER   (2)
+#define _X65_CHUNK_CPU_VER   (1)
+#define _X65_CHUNK_RIA_VER   (2)
+#define _X65_CHUNK_GPIO_VER  (1)
+#define _X65_CHUNK_CGIA_VER  (2)
+#define _X65_CHUNK_OPL3_VER  (1)
+#define _X65_CHUNK_MIX_VER   (1)
+#define _X65_CHUNK_BEEP_VER  (1)
+#define _X65_CHUNK_RAM_VER   (1)
+#define _X65_CHUNK_FB_VER    (1)
+#define _X65_CHUNK_THMB_VER  (1)
+#define _X65_SNAPSHOT_MAP_SIZE (X65_RAM_NUM_PAGES / 8)
+static_assert(X65_SNAPSHOT_PREVIEW_SIZE == SNAPFILE_HEADER_SIZE + SNAPFILE_CHUNK_HEADER_SIZE + X65_THUMBNAIL_SIZE_BYTES,
+    "snapshot preview size doesn't match the snapfile layout");
+
+typedef struct {
+    uint64_t pins;
+    ria816_dma_t dma;
+    uint8_t dma_has_data;
+    uint8_t dma_data;
+    uint8_t running;
+    uint8_t joystick_type;
+    uint8_t kbd_joy1_mask;
+    uint8_t kbd_joy2_mask;
+    uint8_t joy_joy1_mask;
+    uint8_t joy_joy2_mask;
+} _x65_snapshot_sys_t;
+
+static void _x65_snapshot_get_sys(const x65_t* sys, _x65_snapshot_sys_t* state) {
+    memset(state, 0, sizeof(*state));
+    state->pins = sys->pins;
+    state->dma = sys->dma.req;
+    state->dma_has_data = sys->dma.has_data;
+    state->dma_data = sys->dma.data;
+    state->running = sys->running;
+    state->joystick_type = (uint8_t)sys->joystick_type;
+    state->kbd_joy1_mask = sys->kbd_joy1_mask;
+    state->kbd_joy2_mask = sys->kbd_joy2_mask;
+    state->joy_joy1_mask = sys->joy_joy1_mask;
+    state->joy_joy2_mask = sys->joy_joy2_mask;
+}
+
+static void _x65_snapshot_set_sys(x65_t* sys, const _x65_snapshot_sys_t* state) {
+    sys->pins = state->pins;
+    sys->dma.req = state->dma;
+    sys->dma.has_data = state->dma_has_data;
+    sys->dma.data = state->dma_data;
+    sys->running = state->running;
+    sys->joystick_type = (x65_joystick_type_t)state->joystick_type;
+    sys->kbd_joy1_mask = state->kbd_joy1_mask;
+    sys->kbd_joy2_mask = state->kbd_joy2_mask;
+    sys->joy_joy1_mask = state->joy_joy1_mask;
+    sys->joy_joy2_mask = state->joy_joy2_mask;
+}
+
+// state of all chips, pointers are zeroed by the snapshot_onsave functions
+typedef struct {
+    _x65_snapshot_sys_t state;
+    w65816_t cpu;
+    ria816_t ria;
+    tca6416a_t gpio;
+    cgia_t cgia;
+    ymf262_t opl3;
+    mixer_t mixer;
+    beeper_t beeper[2];
+} _x65_chips_t;
+
+static void _x65_get_chips(x65_t* sys, _x65_chips_t* chips) {
+    _x65_snapshot_get_sys(sys, &chips->state);
+    chips->cpu = sys->cpu;
+    w65816_snapshot_onsave(&chips->cpu);
+    chips->ria = sys->ria;
+    ria816_snapshot_onsave(&chips->ria);
+    chips->gpio = sys->gpio;
+    cgia_save_globals(&sys->cgia);
+    chips->cgia = sys->cgia;
+    cgia_snapshot_onsave(&chips->cgia);
+    chips->opl3 = sys->opl3;
+    ymf262_snapshot_onsave(&chips->opl3);
+    chips->mixer = sys->mixer;
+    memcpy(chips->beeper, sys->beeper, sizeof(chips->beeper));
+}
+
+// chips is patched in place
+static void _x65_set_chips(x65_t* sys, _x65_chips_t* chips) {
+    _x65_snapshot_set_sys(sys, &chips->state);
+    w65816_snapshot_onload(&chips->cpu, &sys->cpu);
+    sys->cpu = chips->cpu;
+    ria816_snapshot_onload(&chips->ria, &sys->ria);
+    sys->ria = chips->ria;
+    sys->gpio = chips->gpio;
+    cgia_snapshot_onload(&chips->cgia, &sys->cgia);
+    sys->cgia = chips->cgia;
+    if (cgia_load_globals(&sys->cgia)) {
+        // RAM is already restored
+        cgia_mirror_vram(&sys->cgia);
+    }
+    ymf262_snapshot_onload(&chips->opl3, &sys->opl3);
+    sys->opl3 = chips->opl3;
+    sys->mixer = chips->mixer;
+    memcpy(sys->beeper, chips->beeper, sizeof(sys->beeper));
+}
+
+struct x65_frozen_snapshot_t {
+    _x65_chips_t chips;
+    uint32_t fb[CGIA_FRAMEBUFFER_SIZE_BYTES / 4];
+    size_t ram_size;
+    uint8_t ram[];  // page bitmap followed by the non-zero pages
+};
+
+static bool _x65_snapshot_page_used(const x65_t* sys, uint32_t page) {
+    const uint64_t* p = (const uint64_t*)&sys->ram[page * X65_RAM_PAGE_SIZE];
+    for (size_t i = 0; i < X65_RAM_PAGE_SIZE / sizeof(uint64_t); i++) {
+        if (p[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+x65_frozen_snapshot_t* x65_freeze_snapshot(x65_t* sys) {
+    CHIPS_ASSERT(sys && sys->valid);
+    uint8_t map[_X65_SNAPSHOT_MAP_SIZE] = { 0 };
+    uint32_t num_pages = 0;
+    for (uint32_t page = 0; page < X65_RAM_NUM_PAGES; page++) {
+        if (_x65_snapshot_page_used(sys, page)) {
+            map[page >> 3] |= (uint8_t)(1 << (page & 7));
+            num_pages++;
+        }
+    }
+    const size_t ram_size = sizeof(map) + (size_t)num_pages * X65_RAM_PAGE_SIZE;
+    x65_frozen_snapshot_t* frozen = (x65_frozen_snapshot_t*)malloc(sizeof(x65_frozen_snapshot_t) + ram_size);
+    if (!frozen) {
+        return 0;
+    }
+    _x65_get_chips(sys, &frozen->chips);
+    memcpy(frozen->fb, sys->fb, sizeof(frozen->fb));
+    frozen->ram_size = ram_size;
+    memcpy(frozen->ram, map, sizeof(map));
+    uint8_t* dst = frozen->ram + sizeof(map);
+    for (uint32_t page = 0; page < X65_RAM_NUM_PAGES; page++) {
+        if (map[page >> 3] & (1 << (page & 7))) {
+            memcpy(dst, &sys->ram[page * X65_RAM_PAGE_SIZE], X65_RAM_PAGE_SIZE);
+            dst += X65_RAM_PAGE_SIZE;
+        }
+    }
+    return frozen;
+}
+
+// average 2x2 pixel blocks
+static void _x65_snapshot_downscale(const uint32_t* fb, uint32_t* thumb) {
+    for (size_t y = 0; y < X65_THUMBNAIL_HEIGHT; y++) {
+        const uint32_t* src = &fb[y * 2 * CGIA_FRAMEBUFFER_WIDTH];
+        for (size_t x = 0; x < X65_THUMBNAIL_WIDTH; x++) {
+            const uint32_t* p = &src[x * 2];
+            thumb[y * X65_THUMBNAIL_WIDTH + x] =
+                ((p[0] >> 2) & 0x3F3F3F3F) + ((p[1] >> 2) & 0x3F3F3F3F)
+                + ((p[CGIA_FRAMEBUFFER_WIDTH] >> 2) & 0x3F3F3F3F) + ((p[CGIA_FRAMEBUFFER_WIDTH + 1] >> 2) & 0x3F3F3F3F);
+        }
+    }
+}
+
+chips_range_t x65_encode_snapshot(x65_frozen_snapshot_t* frozen) {
+    CHIPS_ASSERT(frozen);
+    const _x65_chips_t* chips = &frozen->chips;
+    snapfile_writer_t w;
+    snapfile_writer_init(&w, _X65_SNAPSHOT_MAGIC);
+    uint32_t* thumb = (uint32_t*)malloc(X65_THUMBNAIL_SIZE_BYTES);
+    if (thumb) {
+        _x65_snapshot_downscale(frozen->fb, thumb);
+        snapfile_write_chunk(&w, "THMB", _X65_CHUNK_THMB_VER, thumb, X65_THUMBNAIL_SIZE_BYTES);
+        free(thumb);
+    }
+    snapfile_write_chunk(&w, "SYS ", _X65_CHUNK_SYS_VER, &chips->state, sizeof(chips->state));
+    snapfile_write_chunk(&w, "CPU ", _X65_CHUNK_CPU_VER, &chips->cpu, sizeof(chips->cpu));
+    snapfile_write_chunk(&w, "RIA ", _X65_CHUNK_RIA_VER, &chips->ria, sizeof(chips->ria));
+    snapfile_write_chunk(&w, "CGIA", _X65_CHUNK_CGIA_VER, &chips->cgia, sizeof(chips->cgia));
+    snapfile_write_chunk(&w, "OPL3", _X65_CHUNK_OPL3_VER, &chips->opl3, sizeof(chips->opl3));
+    snapfile_write_chunk(&w, "GPIO", _X65_CHUNK_GPIO_VER, &chips->gpio, sizeof(chips->gpio));
+    snapfile_write_chunk(&w, "MIX ", _X65_CHUNK_MIX_VER, &chips->mixer, sizeof(chips->mixer));
+    snapfile_write_chunk(&w, "BEEP", _X65_CHUNK_BEEP_VER, chips->beeper, sizeof(chips->beeper));
+    snapfile_write_chunk(&w, "RAM ", _X65_CHUNK_RAM_VER, frozen->ram, frozen->ram_size);
+    snapfile_write_chunk(&w, "FB  ", _X65_CHUNK_FB_VER, frozen->fb, sizeof(frozen->fb));
+    free(frozen);
+    return snapfile_writer_finish(&w);
+}
+
+chips_range_t x65_save_snapshot(x65_t* sys) {
+    CHIPS_ASSERT(sys && sys->valid);
+    x65_frozen_snapshot_t* frozen = x65_freeze_snapshot(sys);
+    if (!frozen) {
+        return (chips_range_t){ 0 };
+    }
+    return x65_encode_snapshot(frozen);
+}
+
+// chunks are decoded here first, the system is only touched if the snapshot is complete
+typedef struct {
+    _x65_chips_t chips;
+    uint8_t* ram;  // page bitmap and pages
+    uint32_t fb[CGIA_FRAMEBUFFER_SIZE_BYTES / 4];
+    bool has_state, has_cpu, has_ria, has_gpio, has_cgia, has_opl3, has_mixer, has_beeper, has_fb;
+} _x65_snapshot_load_t;
+
+// validate RAM chunk, number of pages must match the bitmap
+static bool _x65_snapshot_read_ram(_x65_snapshot_load_t* load, const snapfile_chunk_t* chunk) {
+    if ((load->ram != 0) || (chunk->size < _X65_SNAPSHOT_MAP_SIZE)
+        || (chunk->size > _X65_SNAPSHOT_MAP_SIZE + X65_RAM_SIZE)) {
+        return false;
+    }
+    uint8_t* buf = (uint8_t*)malloc(chunk->size);
+    if (!buf || !snapfile_read_chunk(chunk, buf, chunk->size)) {
+        free(buf);
+        return false;
+    }
+    size_t num_pages = 0;
+    for (size_t i = 0; i < _X65_SNAPSHOT_MAP_SIZE; i++) {
+        num_pages += (size_t)__builtin_popcount(buf[i]);
+    }
+    if (chunk->size != _X65_SNAPSHOT_MAP_SIZE + num_pages * X65_RAM_PAGE_SIZE) {
+        free(buf);
+        return false;
+    }
+    load->ram = buf;
+    return true;
+}
+
+/* decode all chunks of a snapshot
+
+    The chunks are raw chip structs, so a chunk of another version than
+    this build writes can't be restored. Such a snapshot is rejected as a
+    whole, as is one which lacks the state of any chip, so a load never
+    mixes restored chips with live ones. Chunks with unknown ids are
+    skipped.
+*/
+static bool _x65_snapshot_decode(_x65_snapshot_load_t* load, snapfile_reader_t* r) {
+    _x65_chips_t* chips = &load->chips;
+    snapfile_chunk_t chunk;
+    while (snapfile_next_chunk(r, &chunk)) {
+        bool ok = true;
+        if (snapfile_chunk_is(&chunk, "SYS ", _X65_CHUNK_SYS_VER)) {
+            ok = load->has_state = snapfile_read_chunk(&chunk, &chips->state, sizeof(chips->state));
+        }
+        else if (snapfile_chunk_is(&chunk, "CPU ", _X65_CHUNK_CPU_VER)) {
+            ok = load->has_cpu = snapfile_read_chunk(&chunk, &chips->cpu, sizeof(chips->cpu));
+        }
+        else if (snapfile_chunk_is(&chunk, "RIA ", _X65_CHUNK_RIA_VER)) {
+            ok = load->has_ria = snapfile_read_chunk(&chunk, &chips->ria, sizeof(chips->ria));
+        }
+        else if (snapfile_chunk_is(&chunk, "GPIO", _X65_CHUNK_GPIO_VER)) {
+            ok = load->has_gpio = snapfile_read_chunk(&chunk, &chips->gpio, sizeof(chips->gpio));
+        }
+        else if (snapfile_chunk_is(&chunk, "CGIA", _X65_CHUNK_CGIA_VER)) {
+            ok = load->has_cgia = snapfile_read_chunk(&chunk, &chips->cgia, sizeof(chips->cgia));
+        }
+        else if (snapfile_chunk_is(&chunk, "OPL3", _X65_CHUNK_OPL3_VER)) {
+            ok = load->has_opl3 = snapfile_read_chunk(&chunk, &chips->opl3, sizeof(chips->opl3));
+        }
+        else if (snapfile_chunk_is(&chunk, "MIX ", _X65_CHUNK_MIX_VER)) {
+            ok = load->has_mixer = snapfile_read_chunk(&chunk, &chips->mixer, sizeof(chips->mixer));
+        }
+        else if (snapfile_chunk_is(&chunk, "BEEP", _X65_CHUNK_BEEP_VER)) {
+            ok = load->has_beeper = snapfile_read_chunk(&chunk, chips->beeper, sizeof(chips->beeper));
+        }
+        else if (snapfile_chunk_is(&chunk, "RAM ", _X65_CHUNK_RAM_VER)) {
+            ok = _x65_snapshot_read_ram(load, &chunk);
+        }
+        else if (snapfile_chunk_is(&chunk, "FB  ", _X65_CHUNK_FB_VER)) {
+            ok = load->has_fb = snapfile_read_chunk(&chunk, load->fb, sizeof(load->fb));
+        }
+        else {
+            // a known chunk in another layout
+            static const char* known[] = { "SYS ", "CPU ", "RIA ", "GPIO", "CGIA", "OPL3", "MIX ", "BEEP", "RAM ", "FB  " };
+            for (size_t i = 0; i < sizeof(known) / sizeof(known[0]); i++) {
+                ok &= 0 != memcmp(chunk.id, known[i], 4);
+            }
+        }
+        if (!ok) {
+            return false;
+        }
+    }
+    return load->has_state && load->has_cpu && load->has_ria && load->has_gpio && load->has_cgia && load->has_opl3
+           && load->has_mixer && load->has_beeper && load->ram;
+}
+
+bool x65_load_snapshot(x65_t* sys, chips_range_t data) {
+    CHIPS_ASSERT(sys && sys->valid);
+    snapfile_reader_t r;
+    if (!snapfile_reader_init(&r, _X65_SNAPSHOT_MAGIC, data)) {
+        return false;
+    }
+    _x65_snapshot_load_t* load = (_x65_snapshot_load_t*)calloc(1, sizeof(_x65_snapshot_load_t));
+    if (!load) {
+        return false;
+    }
+    if (!_x65_snapshot_decode(load, &r)) {
+        free(load->ram);
+        free(load);
+        return false;
+    }
+
+    // pages which are not stored are zero, they are released instead of written
+    const uint8_t* map = load->ram;
+    const uint8_t* src = map + _X65_SNAPSHOT_MAP_SIZE;
+    guestmem_clear(&sys->mem);
+    for (uint32_t page = 0; page < X65_RAM_NUM_PAGES; page++) {
+        if (map[page >> 3] & (1 << (page & 7))) {
+            memcpy(&sys->ram[page * X65_RAM_PAGE_SIZE], src, X65_RAM_PAGE_SIZE);
+            src += X65_RAM_PAGE_SIZE;
+        }
+    }
+    _x65_dirty_range(sys, 0, X65_RAM_SIZE);
+    if (load->has_fb) {
+        memcpy(sys->fb, load->fb, sizeof(sys->fb));
+    }
+    _x65_set_chips(sys, &load->chips);
+    // the VRAM caches are refreshed from the loaded RAM even if they cache the same banks
+    cgia_mirror_vram(&sys->cgia);
+    free(load->ram);
+    free(load);
+    return true;
+}
+
+bool x65_snapshot_thumbnail(chips_range_t data, chips_range_t thumb) {
+    CHIPS_ASSERT(thumb.ptr && (thumb.size == X65_THUMBNAIL_SIZE_BYTES));
+    snapfile_reader_t r;
+    snapfile_chunk_t chunk;
+    if (snapfile_reader_init(&r, _X65_SNAPSHOT_MAGIC, data) && snapfile_next_chunk(&r, &chunk)
+        && snapfile_chunk_is(&chunk, "THMB", _X65_CHUNK_THMB_VER)) {
+        return snapfile_read_chunk(&chunk, thumb.ptr, thumb.size);
+    }
+    return false;
+}
+
+chips_display_info_t x65_thumbnail_display_info(void* thumb) {
+    CHIPS_ASSERT(thumb);
+    return (chips_display_info_t){
+        .frame = {
+            .dim = {
+                .width = X65_THUMBNAIL_WIDTH,
+                .height = X65_THUMBNAIL_HEIGHT,
+            },
+            .bytes_per_pixel = 4,
+            .buffer = {
+                .ptr = thumb,
+                .size = X65_THUMBNAIL_SIZE_BYTES,
+            }
+        },
+        .screen = {
+            .x = 0,
+            .y = 0,
+            .width = X65_THUMBNAIL_WIDTH,
+            .height = X65_THUMBNAIL_HEIGHT,
+        },
+    };
 }
 
-bool x65_load_snapshot(x65_t* sys, uint32_t version, x65_t* src) {
-    CHIPS_ASSERT(sys && src);
-    if (version != X65_SNAPSHOT_VERSION) {
+/* fork
+
+    The child gets a private copy-on-write mapping of the RAM of sys, and
+    sys gets one of the same memory file (see guestmem.h), so both run,
+    load and are discarded independently. The first fork moves the RAM
+    of sys into the memory file, further ones are cheap until sys writes
+    its RAM again.
+    The chips are copied like for a snapshot, the CGIA firmware globals
+    are swapped in by the instance which runs, see cgia_activate().
+*/
+bool x65_fork(x65_t* sys, x65_t* child, const x65_desc_t* desc) {
+    CHIPS_ASSERT(sys && sys->valid && child && (child != sys) && desc);
+    _x65_chips_t* chips = (_x65_chips_t*)malloc(sizeof(_x65_chips_t));
+    if (!chips) {
+        return false;
+    }
+    if (!x65_init(child, desc)) {
+        free(chips);
+        return false;
+    }
+    guestmem_free(&child->mem);
+    if (!guestmem_fork(&sys->mem, &child->mem)) {
+        free(chips);
+        x65_discard(child);
         return false;
     }
-    static x65_t im;
-    im = *src;
-    chips_debug_snapshot_onload(&im.debug, &sys->debug);
-    chips_audio_callback_snapshot_onload(&im.audio.callback, &sys->audio.callback);
-    w65816_snapshot_onload(&im.cpu, &sys->cpu);
-    cgia_snapshot_onload(&im.cgia, &sys->cgia);
-    ymf262_snapshot_onload(&im.opl3, &sys->opl3);
-    *sys = im;
+    child->ram = child->mem.ptr;
+    _x65_get_chips(sys, chips);
+    _x65_set_chips(child, chips);
+    free(chips);
+    memcpy(child->fb, sys->fb, sizeof(child->fb));
     return true;
 }
+
+/* rewind
+
+    Frames are recorded as backward deltas: a record holds what turns the
+    state of one capture back into the state of the capture before it,
+    the RAM pages written in between and the chip state, both XOR-ed
+    against the newer state and compressed. The live system and a shadow
+    copy of RAM at the last capture act as the keyframe, so a frame costs
+    only the pages it wrote, and the oldest records can be dropped freely
+    when the memory budget is exceeded. Without history, for run-ahead,
+    a capture only copies the written pages to the shadow copy.
+*/
+// record header, followed by the chips delta and num_pages page deltas
+typedef struct {
+    uint32_t size;        // whole record in bytes
+    uint32_t chips_size;  // stored size of chips delta, sizeof(_x65_chips_t) if not compressed
+    uint32_t num_pages;
+} _x65_rewind_record_t;
+
+// page delta header, followed by the delta, X65_RAM_PAGE_SIZE bytes if not compressed
+typedef struct {
+    uint16_t page;
+    uint16_t size;
+} _x65_rewind_page_t;
+
+struct x65_rewind_t {
+    x65_t* sys;
+    bool no_history;
+    size_t budget;
+    size_t used;
+    uint32_t max_frames;
+    uint32_t head;  // slot of the next record
+    uint32_t num_frames;
+    uint8_t** frames;
+    guestmem_t shadow;                // RAM at the last capture
+    _x65_chips_t chips;               // chip state at the last capture
+    _x65_chips_t delta;               // scratch
+    uint8_t page[X65_RAM_PAGE_SIZE];  // scratch
+    uint8_t* buf;
+    size_t buf_capacity;
+    // outputs detached while running ahead
+    struct {
+        bool active;
+        chips_audio_callback_t audio_callback;
+        int sample_pos;
+        chips_debug_t debug;
+        ymf262_write_cb_t write_cb;
+        void* write_user_data;
+        ymf262_worker_t* fm_worker;
+    } ahead;
+};
+
+static void _x65_rewind_xor(uint8_t* dst, const uint8_t* src, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        dst[i] ^= src[i];
+    }
+}
+
+static void _x65_rewind_drop_oldest(x65_rewind_t* rw) {
+    CHIPS_ASSERT(rw->num_frames > 0);
+    const uint32_t tail = (rw->head + rw->max_frames - rw->num_frames) % rw->max_frames;
+    rw->used -= ((const _x65_rewind_record_t*)rw->frames[tail])->size;
+    free(rw->frames[tail]);
+    rw->frames[tail] = 0;
+    rw->num_frames--;
+}
+
+x65_rewind_t* x65_rewind_create(x65_t* sys, const x65_rewind_desc_t* desc) {
+    CHIPS_ASSERT(sys && sys->valid && desc);
+    x65_rewind_t* rw = (x65_rewind_t*)calloc(1, sizeof(x65_rewind_t));
+    if (!rw) {
+        return 0;
+    }
+    rw->sys = sys;
+    rw->no_history = desc->no_history;
+    rw->budget = _X65_DEFAULT(desc->budget, X65_REWIND_DEFAULT_BUDGET);
+    rw->max_frames = desc->no_history ? 1 : _X65_DEFAULT(desc->max_frames, X65_REWIND_DEFAULT_FRAMES);
+    rw->frames = (uint8_t**)calloc(rw->max_frames, sizeof(uint8_t*));
+    if (!rw->frames || !guestmem_alloc(&rw->shadow, X65_RAM_SIZE)) {
+        x65_rewind_destroy(rw);
+        return 0;
+    }
+    x65_rewind_reset(rw);
+    return rw;
+}
+
+void x65_rewind_destroy(x65_rewind_t* rw) {
+    if (rw) {
+        if (rw->frames) {
+            while (rw->num_frames > 0) {
+                _x65_rewind_drop_oldest(rw);
+            }
+        }
+        free(rw->frames);
+        guestmem_free(&rw->shadow);
+        free(rw->buf);
+        free(rw);
+    }
+}
+
+void x65_rewind_reset(x65_rewind_t* rw) {
+    CHIPS_ASSERT(rw && rw->sys->valid);
+    while (rw->num_frames > 0) {
+        _x65_rewind_drop_oldest(rw);
+    }
+    x65_t* sys = rw->sys;
+    // pages which were never written stay uncommitted in both copies
+    guestmem_clear(&rw->shadow);
+    for (uint32_t page = 0; page < X65_RAM_NUM_PAGES; page++) {
+        if (_x65_snapshot_page_used(sys, page)) {
+            const size_t addr = (size_t)page * X65_RAM_PAGE_SIZE;
+            memcpy(&rw->shadow.ptr[addr], &sys->ram[addr], X65_RAM_PAGE_SIZE);
+        }
+    }
+    _x65_get_chips(sys, &rw->chips);
+    x65_clear_dirty_pages(sys);
+    sys->dirty.enabled = true;
+}
+
+void x65_rewind_capture(x65_rewind_t* rw) {
+    CHIPS_ASSERT(rw && rw->sys->valid);
+    x65_t* sys = rw->sys;
+    if (rw->no_history) {
+        for (uint32_t page = 0; page < X65_RAM_NUM_PAGES; page++) {
+            if (sys->dirty.map[page >> 3] & (1 << (page & 7))) {
+                const uint32_t addr = page * X65_RAM_PAGE_SIZE;
+                memcpy(&rw->shadow.ptr[addr], &sys->ram[addr], X65_RAM_PAGE_SIZE);
+            }
+        }
+        x65_clear_dirty_pages(sys);
+        _x65_get_chips(sys, &rw->chips);
+        return;
+    }
+
+    // chip state delta against the last capture, which becomes the current state
+    _x65_get_chips(sys, &rw->delta);
+    uint8_t* delta = (uint8_t*)&rw->delta;
+    uint8_t* chips = (uint8_t*)&rw->chips;
+    for (size_t i = 0; i < sizeof(_x65_chips_t); i++) {
+        const uint8_t cur = delta[i];
+        delta[i] ^= chips[i];
+        chips[i] = cur;
+    }
+
+    uint32_t num_dirty = 0;
+    for (size_t i = 0; i < sizeof(sys->dirty.map); i++) {
+        num_dirty += (uint32_t)__builtin_popcount(sys->dirty.map[i]);
+    }
+    const size_t chips_bound = lz_compress_bound(sizeof(_x65_chips_t));
+    const size_t page_bound = lz_compress_bound(X65_RAM_PAGE_SIZE);
+    const size_t bound = sizeof(_x65_rewind_record_t) + chips_bound
+                       + num_dirty * (sizeof(_x65_rewind_page_t) + page_bound);
+    if (bound > rw->buf_capacity) {
+        uint8_t* buf = (uint8_t*)realloc(rw->buf, bound);
+        if (!buf) {
+            // history can't be continued without this frame
+            x65_rewind_reset(rw);
+            return;
+        }
+        rw->buf = buf;
+        rw->buf_capacity = bound;
+    }
+
+    _x65_rewind_record_t rec = { 0 };
+    uint8_t* p = rw->buf + sizeof(rec);
+    rec.chips_size = (uint32_t)lz_compress(delta, sizeof(_x65_chips_t), p, chips_bound);
+    if ((rec.chips_size == 0) || (rec.chips_size >= sizeof(_x65_chips_t))) {
+        rec.chips_size = sizeof(_x65_chips_t);
+        memcpy(p, delta, sizeof(_x65_chips_t));
+    }
+    p += rec.chips_size;
+
+    for (uint32_t page = 0; page < X65_RAM_NUM_PAGES; page++) {
+        if (0 == (sys->dirty.map[page >> 3] & (1 << (page & 7)))) {
+            continue;
+        }
+        uint8_t* ram = &sys->ram[page * X65_RAM_PAGE_SIZE];
+        uint8_t* shadow = &rw->shadow.ptr[page * X65_RAM_PAGE_SIZE];
+        uint8_t changed = 0;
+        for (size_t i = 0; i < X65_RAM_PAGE_SIZE; i++) {
+            rw->page[i] = ram[i] ^ shadow[i];
+            changed |= rw->page[i];
+        }
+        if (!changed) {
+            // written with the values it already had
+            continue;
+        }
+        memcpy(shadow, ram, X65_RAM_PAGE_SIZE);
+        _x65_rewind_page_t hdr = { .page = (uint16_t)page };
+        uint8_t* data = p + sizeof(hdr);
+        size_t size = lz_compress(rw->page, X65_RAM_PAGE_SIZE, data, page_bound);
+        if ((size == 0) || (size >= X65_RAM_PAGE_SIZE)) {
+            size = X65_RAM_PAGE_SIZE;
+            memcpy(data, rw->page, X65_RAM_PAGE_SIZE);
+        }
+        hdr.size = (uint16_t)size;
+        memcpy(p, &hdr, sizeof(hdr));
+        p += sizeof(hdr) + size;
+        rec.num_pages++;
+    }
+    x65_clear_dirty_pages(sys);
+
+    rec.size = (uint32_t)(p - rw->buf);
+    memcpy(rw->buf, &rec, sizeof(rec));
+    uint8_t* frame = (uint8_t*)malloc(rec.size);
+    if (!frame) {
+        x65_rewind_reset(rw);
+        return;
+    }
+    memcpy(frame, rw->buf, rec.size);
+    if (rw->num_frames == rw->max_frames) {
+        _x65_rewind_drop_oldest(rw);
+    }
+    rw->frames[rw->head] = frame;
+    rw->head = (rw->head + 1) % rw->max_frames;
+    rw->num_frames++;
+    rw->used += rec.size;
+    while ((rw->used > rw->budget) && (rw->num_frames > 1)) {
+        _x65_rewind_drop_oldest(rw);
+    }
+}
+
+// decode a delta stored by x65_rewind_capture()
+static void _x65_rewind_decode(const uint8_t* src, size_t stored_size, uint8_t* dst, size_t size) {
+    if (stored_size == size) {
+        memcpy(dst, src, size);
+    }
+    else {
+        const size_t res = lz_decompress(src, stored_size, dst, size);
+        CHIPS_ASSERT(res == size);
+        (void)res;
+    }
+}
+
+uint32_t x65_rewind(x65_rewind_t* rw, uint32_t num_frames) {
+    CHIPS_ASSERT(rw && rw->sys->valid);
+    x65_t* sys = rw->sys;
+
+    // undo RAM writes since the last capture
+    for (uint32_t page = 0; page < X65_RAM_NUM_PAGES; page++) {
+        if (sys->dirty.map[page >> 3] & (1 << (page & 7))) {
+            const uint32_t addr = page * X65_RAM_PAGE_SIZE;
+            memcpy(&sys->ram[addr], &rw->shadow.ptr[addr], X65_RAM_PAGE_SIZE);
+            cgia_mem_wr_range(&sys->cgia, addr, &sys->ram[addr], X65_RAM_PAGE_SIZE);
+        }
+    }
+    x65_clear_dirty_pages(sys);
+
+    uint32_t n = 0;
+    for (; (n < num_frames) && (rw->num_frames > 0); n++) {
+        rw->head = (rw->head + rw->max_frames - 1) % rw->max_frames;
+        uint8_t* frame = rw->frames[rw->head];
+        rw->frames[rw->head] = 0;
+        rw->num_frames--;
+
+        _x65_rewind_record_t rec;
+        memcpy(&rec, frame, sizeof(rec));
+        rw->used -= rec.size;
+        const uint8_t* p = frame + sizeof(rec);
+        _x65_rewind_decode(p, rec.chips_size, (uint8_t*)&rw->delta, sizeof(_x65_chips_t));
+        _x65_rewind_xor((uint8_t*)&rw->chips, (const uint8_t*)&rw->delta, sizeof(_x65_chips_t));
+        p += rec.chips_size;
+        for (uint32_t i = 0; i < rec.num_pages; i++) {
+            _x65_rewind_page_t hdr;
+            memcpy(&hdr, p, sizeof(hdr));
+            p += sizeof(hdr);
+            _x65_rewind_decode(p, hdr.size, rw->page, X65_RAM_PAGE_SIZE);
+            p += hdr.size;
+            const uint32_t addr = hdr.page * X65_RAM_PAGE_SIZE;
+            _x65_rewind_xor(&rw->shadow.ptr[addr], rw->page, X65_RAM_PAGE_SIZE);
+            memcpy(&sys->ram[addr], &rw->shadow.ptr[addr], X65_RAM_PAGE_SIZE);
+            cgia_mem_wr_range(&sys->cgia, addr, &sys->ram[addr], X65_RAM_PAGE_SIZE);
+        }
+        free(frame);
+    }
+
+    // the chip state is kept unpatched for the next delta
+    rw->delta = rw->chips;
+    _x65_set_chips(sys, &rw->delta);
+    return n;
+}
+
+void x65_run_ahead_begin(x65_rewind_t* rw) {
+    CHIPS_ASSERT(rw && rw->sys->valid && !rw->ahead.active);
+    x65_t* sys = rw->sys;
+    // speculative frames must not be heard, logged to VGM, hit breakpoints or touch host files,
+    // their audio is not even generated
+    rw->ahead.active = true;
+    rw->ahead.audio_callback = sys->audio.callback;
+    rw->ahead.sample_pos = sys->audio.sample_pos;
+    rw->ahead.debug = sys->debug;
+    rw->ahead.write_cb = sys->opl3.write_cb;
+    rw->ahead.write_user_data = sys->opl3.user_data;
+    sys->audio.callback.func = 0;
+    sys->audio.muted = true;
+    sys->debug.callback.func = 0;
+    ymf262_set_write_cb(&sys->opl3, 0, 0);
+    sys->opl3.muted = true;
+    // a threaded FM worker must not see the speculative register writes,
+    // it is detached meanwhile and carries on from where it was
+    rw->ahead.fm_worker = sys->opl3.worker;
+    sys->opl3.worker = 0;
+    hostfs_begin_speculation(sys->fs);
+}
+
+void x65_run_ahead_end(x65_rewind_t* rw) {
+    CHIPS_ASSERT(rw && rw->sys->valid && rw->ahead.active);
+    x65_t* sys = rw->sys;
+    // the framebuffer is not part of the restored state and keeps the last frame
+    x65_rewind(rw, 0);
+
+    hostfs_end_speculation(sys->fs);
+    sys->opl3.worker = rw->ahead.fm_worker;
+    sys->opl3.muted = false;
+    sys->audio.muted = false;
+    sys->audio.callback = rw->ahead.audio_callback;
+    sys->audio.sample_pos = rw->ahead.sample_pos;
+    sys->debug = rw->ahead.debug;
+    ymf262_set_write_cb(&sys->opl3, rw->ahead.write_cb, rw->ahead.write_user_data);
+    rw->ahead.active = false;
+}
+
+void x65_run_ahead(x65_rewind_t* rw, uint32_t num_frames, uint32_t micro_seconds) {
+    x65_run_ahead_begin(rw);
+    for (uint32_t i = 0; i < num_frames; i++) {
+        x65_exec(rw->sys, micro_seconds);
+    }
+    x65_run_ahead_end(rw);
+}
+
+uint32_t x65_rewind_num_frames(const x65_rewind_t* rw) {
+    CHIPS_ASSERT(rw);
+    return rw->num_frames;
+}
+
+size_t x65_rewind_used(const x65_rewind_t* rw) {
+    CHIPS_ASSERT(rw);
+    return rw->used;
+}
@@ -34,6 +34,10 @@
 #include "chips/w65c816s.h"
 #include "chips/ria816.h"
 #include "chips/ymf262.h"
+#include "chips/mixer.h"
+#include "util/guestmem.h"
+#include "util/hostfs.h"
+#include "util/xex.h"
 
 #include <stdint.h>
 #include <stdbool.h>
@@ -44,12 +48,26 @@
 extern "C" {
 #endif
 
-// bump snapshot version when x65_t memory layout changes
-#define X65_SNAPSHOT_VERSION (1)
+// rewind buffer defaults, one minute at 60 Hz
+#define X65_REWIND_DEFAULT_BUDGET (64 * 1024 * 1024)
+#define X65_REWIND_DEFAULT_FRAMES (60 * 60)
+
+// RAM pages for dirty tracking and snapshots
+#define X65_RAM_SIZE      (1 << 24)
+#define X65_RAM_PAGE_SIZE (4096)
+#define X65_RAM_NUM_PAGES (X65_RAM_SIZE / X65_RAM_PAGE_SIZE)
+
+// half resolution snapshot thumbnail, stored first so it can be read without the rest of the snapshot
+#define X65_THUMBNAIL_WIDTH      (CGIA_FRAMEBUFFER_WIDTH / 2)
+#define X65_THUMBNAIL_HEIGHT     (CGIA_FRAMEBUFFER_HEIGHT / 2)
+#define X65_THUMBNAIL_SIZE_BYTES (X65_THUMBNAIL_WIDTH * X65_THUMBNAIL_HEIGHT * 4)
+// leading bytes of a snapshot which are enough for x65_snapshot_thumbnail()
+#define X65_SNAPSHOT_PREVIEW_SIZE (8 + 16 + X65_THUMBNAIL_SIZE_BYTES)
 
 #define X65_FREQUENCY             (7159090)  // clock frequency in Hz
 #define X65_MAX_AUDIO_SAMPLES     (1024)     // max number of audio samples in internal sample buffer
 #define X65_DEFAULT_AUDIO_SAMPLES (128)      // default number of samples in internal sample buffer
+#define X65_AUDIO_CHANNELS        (MIXER_NUM_CHANNELS)  // audio output is interleaved stereo
 
 // X65 joystick types
 typedef enum {
@@ -104,6 +122,7 @@ typedef enum {
 // IO base addresses
 #define X65_IO_BASE        (0xFE00)
 #define X65_IO_MIXER_BASE  (0xFEB0)
+#define X65_IO_MIXER_LEN   (MIXER_NUM_REGS)
 #define X65_IO_YMF825_BASE (0xFEC0)
 #define X65_IO_CGIA_BASE   (0xFF00)
 #define X65_IO_GPIO_BASE   (0xFF80)
@@ -114,18 +133,34 @@ typedef enum {
 typedef struct {
     x65_joystick_type_t joystick_type;  // default is X65_JOYSTICK_NONE
     chips_debug_t debug;                // optional debugging hook
-    chips_audio_desc_t audio;           // audio output options
+    chips_audio_desc_t audio;           // audio output options (callback receives interleaved stereo frames)
+    bool fm_thread;                     // run OPL3 synthesis on a worker thread
+    hostfs_t* fs;                       // optional host directory backing the RIA file API
+    uint32_t api_latency_us;            // emulated duration of RIA kernel API calls (default 0)
+    int uart_buffer_size;               // capacity of RIA UART FIFOs (default RB_BUFFER_SIZE)
+    uint64_t rng_seed;                  // seed of the RIA random number generator
+    bool track_dirty_pages;             // record RAM pages written to, see x65_dirty_page()
+    bool huge_pages;                    // back guest RAM with 2 MB pages where available, see guestmem.h
 } x65_desc_t;
 
 // X65 emulator state
-typedef struct {
+typedef struct x65_t {
     w65816_t cpu;
     ria816_t ria;
     tca6416a_t gpio;
     cgia_t cgia;
     ymf262_t opl3;
+    mixer_t mixer;
+    hostfs_t* fs;
     uint64_t pins;
 
+    // DMA transfer reaching I/O, done by the tick one bus cycle per register access while the CPU waits
+    struct {
+        ria816_dma_t req;  // remaining transfer, advanced as bytes are done
+        bool has_data;     // source byte was read, its destination access is next
+        uint8_t data;
+    } dma;
+
     bool running;  // whether CPU is running or held in RESET state
 
     x65_joystick_type_t joystick_type;
@@ -142,17 +177,40 @@ typedef struct {
         chips_audio_callback_t callback;
         int num_samples;
         int sample_pos;
-        float sample_buffer[X65_MAX_AUDIO_SAMPLES];
+        bool muted;  // no samples are mixed, while running ahead
+        float sample_buffer[X65_MAX_AUDIO_SAMPLES * X65_AUDIO_CHANNELS];  // interleaved stereo frames
     } audio;
 
-    uint8_t ram[1 << 24];  // 16 MBytes of general RAM
+    struct {
+        bool enabled;
+        uint8_t map[X65_RAM_NUM_PAGES / 8];  // one bit per X65_RAM_PAGE_SIZE page
+    } dirty;
+
+    guestmem_t mem;
+    uint8_t* ram;  // 16 MBytes of general RAM, points into mem
     alignas(64) uint32_t fb[CGIA_FRAMEBUFFER_SIZE_BYTES / 4];
 } x65_t;
 
-// initialize a new X65 instance
-void x65_init(x65_t* sys, const x65_desc_t* desc);
+// copy of the system state, see x65_freeze_snapshot()
+typedef struct x65_frozen_snapshot_t x65_frozen_snapshot_t;
+
+// rewind buffer of per-frame state deltas, see x65_rewind_create()
+typedef struct x65_rewind_t x65_rewind_t;
+
+// config parameters for x65_rewind_create()
+typedef struct {
+    size_t budget;        // memory for recorded frames in bytes (default X65_REWIND_DEFAULT_BUDGET)
+    uint32_t max_frames;  // max number of recorded frames (default X65_REWIND_DEFAULT_FRAMES)
+    bool no_history;      // only keep the last capture to go back to, for run-ahead
+} x65_rewind_desc_t;
+
+// initialize a new X65 instance, false if the RAM can't be allocated (sys is not valid then)
+bool x65_init(x65_t* sys, const x65_desc_t* desc);
 // discard X65 instance
 void x65_discard(x65_t* sys);
+// initialize child from desc and give it the state of sys, RAM is shared copy-on-write, false if out of memory
+// (desc.fs should be NULL or a separate hostfs, x65_init() closes its open files)
+bool x65_fork(x65_t* sys, x65_t* child, const x65_desc_t* desc);
 // reset a X65 instance
 void x65_reset(x65_t* sys);
 // start/stop X65 CPU
@@ -161,6 +219,12 @@ void x65_set_running(x65_t* sys, bool running);
 chips_display_info_t x65_display_info(x65_t* sys);
 // tick X65 instance for a given number of microseconds, return number of ticks executed
 uint32_t x65_exec(x65_t* sys, uint32_t micro_seconds);
+// enable/disable recording of written RAM pages, enabling starts with a clean map
+void x65_set_dirty_tracking(x65_t* sys, bool enabled);
+// true if RAM page was written since tracking was enabled or the map was cleared
+bool x65_dirty_page(const x65_t* sys, uint32_t page);
+// clear the dirty page map
+void x65_clear_dirty_pages(x65_t* sys);
 // send a key-down event to the X65
 void x65_key_down(x65_t* sys, int key_code);
 // send a key-up event to the X65
@@ -171,7 +235,7 @@ void x65_set_joystick_type(x65_t* sys, x65_joystick_type_t type);
 x65_joystick_type_t x65_joystick_type(x65_t* sys);
 // set joystick mask (combination of X65_JOYSTICK_*)
 void x65_joystick(x65_t* sys, uint8_t joy1_mask, uint8_t joy2_mask);
-// quickload a .xex file
+// quickload a .xex file, the file is validated before anything is written
 bool x65_quickload_xex(x65_t* sys, chips_range_t data);
 // insert tape as .TAP file (c1530 must be enabled)
 bool x65_insert_tape(x65_t* sys, chips_range_t data);
@@ -185,10 +249,38 @@ void x65_tape_play(x65_t* sys);
 void x65_tape_stop(x65_t* sys);
 // return true if tape motor is on
 bool x65_is_tape_motor_on(x65_t* sys);
-// save a snapshot, patches pointers to zero and offsets, returns snapshot version
-uint32_t x65_save_snapshot(x65_t* sys, x65_t* dst);
-// load a snapshot, returns false if snapshot versions don't match
-bool x65_load_snapshot(x65_t* sys, uint32_t version, x65_t* src);
+// save a chunked, compressed snapshot, release data.ptr with free(), empty range if out of memory
+chips_range_t x65_save_snapshot(x65_t* sys);
+// copy the state for a snapshot without encoding it, NULL if out of memory
+x65_frozen_snapshot_t* x65_freeze_snapshot(x65_t* sys);
+// encode and free a frozen snapshot, can run on any thread, see x65_save_snapshot()
+chips_range_t x65_encode_snapshot(x65_frozen_snapshot_t* frozen);
+// load a snapshot, false if it is corrupt, lacks a chip or has it in another version
+bool x65_load_snapshot(x65_t* sys, chips_range_t data);
+// decode the thumbnail of a snapshot, data may be cut after X65_SNAPSHOT_PREVIEW_SIZE bytes, thumb.size must be X65_THUMBNAIL_SIZE_BYTES
+bool x65_snapshot_thumbnail(chips_range_t data, chips_range_t thumb);
+// display info for a decoded thumbnail
+chips_display_info_t x65_thumbnail_display_info(void* thumb);
+// create a rewind buffer for sys, it takes over dirty page tracking, NULL if out of memory
+x65_rewind_t* x65_rewind_create(x65_t* sys, const x65_rewind_desc_t* desc);
+// destroy a rewind buffer
+void x65_rewind_destroy(x65_rewind_t* rw);
+// drop all recorded frames, call after sys was initialized again
+void x65_rewind_reset(x65_rewind_t* rw);
+// record the current state, call once per frame after x65_exec()
+void x65_rewind_capture(x65_rewind_t* rw);
+// restore the last recorded state and go back num_frames before it, returns number of frames gone back
+uint32_t x65_rewind(x65_rewind_t* rw, uint32_t num_frames);
+// emulate num_frames frames ahead and restore the last recorded state, the framebuffer shows the last one
+void x65_run_ahead(x65_rewind_t* rw, uint32_t num_frames, uint32_t micro_seconds);
+// x65_run_ahead() in steps: detach the outputs, then x65_exec() the frames to run ahead
+void x65_run_ahead_begin(x65_rewind_t* rw);
+// x65_run_ahead() in steps: restore the last recorded state and attach the outputs again
+void x65_run_ahead_end(x65_rewind_t* rw);
+// number of recorded frames
+uint32_t x65_rewind_num_frames(const x65_rewind_t* rw);
+// memory used by recorded frames in bytes
+size_t x65_rewind_used(const x65_rewind_t* rw);
 
 // ---- memory access functions ----------------------------------------------
 /* read a byte at 16-bit address */
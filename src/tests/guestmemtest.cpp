@@ -0,0 +1,124 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest.h"
+
+#include "util/guestmem.h"
+
+#include <cstring>
+
+static const size_t size = 1 << 20;
+
+static bool all_zero(const guestmem_t& mem) {
+    for (size_t i = 0; i < mem.size; i++) {
+        if (mem.ptr[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+TEST_CASE("guestmem alloc") {
+    guestmem_t mem;
+    REQUIRE(guestmem_alloc(&mem, size));
+    CHECK(mem.size == size);
+    CHECK(all_zero(mem));
+    mem.ptr[0] = 1;
+    mem.ptr[size - 1] = 2;
+    uint8_t* ptr = mem.ptr;
+    guestmem_clear(&mem);
+    CHECK(mem.ptr == ptr);
+    CHECK(all_zero(mem));
+    guestmem_free(&mem);
+    CHECK(mem.ptr == nullptr);
+}
+
+TEST_CASE("guestmem fork") {
+    guestmem_t mem;
+    REQUIRE(guestmem_alloc(&mem, size));
+    mem.ptr[0x1000] = 0x11;
+    mem.ptr[0x8000] = 0x22;
+
+    guestmem_t child;
+    REQUIRE(guestmem_fork(&mem, &child));
+    CHECK(child.ptr != mem.ptr);
+    CHECK(memcmp(child.ptr, mem.ptr, size) == 0);
+
+    SUBCASE("writes stay private") {
+        child.ptr[0x1000] = 0x33;
+        child.ptr[0x20000] = 0x44;
+        CHECK(mem.ptr[0x1000] == 0x11);
+        CHECK(mem.ptr[0x20000] == 0);
+
+        guestmem_t sibling;
+        REQUIRE(guestmem_fork(&mem, &sibling));
+        CHECK(sibling.ptr[0x1000] == 0x11);
+        CHECK(sibling.ptr[0x20000] == 0);
+        guestmem_free(&sibling);
+    }
+
+    SUBCASE("clearing a fork") {
+        child.ptr[0x1000] = 0x33;
+        guestmem_clear(&child);
+        CHECK(all_zero(child));
+        CHECK(mem.ptr[0x1000] == 0x11);
+        child.ptr[0x8000] = 0x44;
+        CHECK(mem.ptr[0x8000] == 0x22);
+    }
+
+    SUBCASE("fork of a fork") {
+        child.ptr[0x8000] = 0x55;
+        guestmem_t grandchild;
+        REQUIRE(guestmem_fork(&child, &grandchild));
+        CHECK(memcmp(grandchild.ptr, child.ptr, size) == 0);
+        grandchild.ptr[0x8000] = 0x66;
+        CHECK(child.ptr[0x8000] == 0x55);
+        CHECK(mem.ptr[0x8000] == 0x22);
+        guestmem_free(&grandchild);
+        // the child has memory of its own now, it's independent of mem
+        child.ptr[0x1000] = 0x77;
+        CHECK(mem.ptr[0x1000] == 0x11);
+    }
+
+    guestmem_free(&child);
+    // the original stays valid after its fork is gone
+    CHECK(mem.ptr[0x1000] == 0x11);
+    guestmem_free(&mem);
+}
+
+TEST_CASE("guestmem original stays writable after a fork") {
+    guestmem_t mem;
+    REQUIRE(guestmem_alloc(&mem, size));
+    mem.ptr[0x1000] = 0x11;
+    guestmem_t child;
+    REQUIRE(guestmem_fork(&mem, &child));
+    CHECK(guestmem_fork_is_cheap(&mem));
+    mem.ptr[0x1000] = 0x22;
+    mem.ptr[0x20000] = 0x33;
+    CHECK(child.ptr[0x1000] == 0x11);
+    CHECK(child.ptr[0x20000] == 0);
+    CHECK_FALSE(guestmem_fork_is_cheap(&mem));
+
+    guestmem_t sibling;
+    REQUIRE(guestmem_fork(&mem, &sibling));
+    CHECK(sibling.ptr[0x1000] == 0x22);
+    CHECK(sibling.ptr[0x20000] == 0x33);
+    guestmem_clear(&mem);
+    CHECK(all_zero(mem));
+    CHECK(sibling.ptr[0x1000] == 0x22);
+    CHECK(child.ptr[0x1000] == 0x11);
+    guestmem_free(&sibling);
+    guestmem_free(&child);
+    guestmem_free(&mem);
+}
+
+TEST_CASE("guestmem fork outlives the original") {
+    guestmem_t mem;
+    REQUIRE(guestmem_alloc(&mem, size));
+    mem.ptr[0x1000] = 0x11;
+    guestmem_t child;
+    REQUIRE(guestmem_fork(&mem, &child));
+    guestmem_free(&mem);
+    CHECK(child.ptr[0x1000] == 0x11);
+    child.ptr[0x1000] = 0x22;
+    CHECK(child.ptr[0x1000] == 0x22);
+    guestmem_free(&child);
+}
@@ -0,0 +1,197 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest.h"
+
+#include "util/hostfs.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <unistd.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+// temporary sandbox directory, removed with all its files at the end of each test
+struct temp_dir {
+    string path;
+    temp_dir() {
+        char tmpl[] = "/tmp/hostfstest.XXXXXX";
+        REQUIRE(mkdtemp(tmpl) != nullptr);
+        path = tmpl;
+    }
+    ~temp_dir() {
+        string cmd = "rm -rf '" + path + "'";
+        REQUIRE(system(cmd.c_str()) == 0);
+    }
+    void put(const char* name, const string& data) const {
+        FILE* f = fopen((path + "/" + name).c_str(), "wb");
+        REQUIRE(f != nullptr);
+        REQUIRE(fwrite(data.data(), 1, data.size(), f) == data.size());
+        fclose(f);
+    }
+    string get(const char* name) const {
+        FILE* f = fopen((path + "/" + name).c_str(), "rb");
+        REQUIRE(f != nullptr);
+        string data;
+        char buf[256];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), f)) > 0) data.append(buf, n);
+        fclose(f);
+        return data;
+    }
+};
+
+TEST_CASE("hostfs rejects missing root") {
+    CHECK(hostfs_create("/nonexistent/hostfstest") == nullptr);
+}
+
+TEST_CASE("hostfs mapped read and seek") {
+    temp_dir dir;
+    dir.put("data.bin", "0123456789");
+    hostfs_t* fs = hostfs_create(dir.path.c_str());
+    REQUIRE(fs != nullptr);
+
+    const int fd = hostfs_open(fs, "/data.bin", HOSTFS_O_RDONLY);
+    REQUIRE(fd >= HOSTFS_FIRST_FD);
+    char buf[16] = {};
+    CHECK(hostfs_read(fs, fd, buf, 4) == 4);
+    CHECK(memcmp(buf, "0123", 4) == 0);
+    CHECK(hostfs_lseek(fs, fd, -2, HOSTFS_SEEK_END) == 8);
+    CHECK(hostfs_read(fs, fd, buf, sizeof(buf)) == 2);
+    CHECK(memcmp(buf, "89", 2) == 0);
+    CHECK(hostfs_read(fs, fd, buf, sizeof(buf)) == 0);
+    CHECK(hostfs_lseek(fs, fd, -1, HOSTFS_SEEK_SET) == -1);
+    CHECK(hostfs_write(fs, fd, "x", 1) == -1);
+    CHECK(hostfs_close(fs, fd) == 0);
+    CHECK(hostfs_close(fs, fd) == -1);
+    CHECK(errno == EBADF);
+    hostfs_destroy(fs);
+}
+
+TEST_CASE("hostfs write") {
+    temp_dir dir;
+    hostfs_t* fs = hostfs_create(dir.path.c_str());
+    REQUIRE(fs != nullptr);
+
+    int fd = hostfs_open(fs, "out.txt", HOSTFS_O_WRONLY | HOSTFS_O_CREAT | HOSTFS_O_TRUNC);
+    REQUIRE(fd >= HOSTFS_FIRST_FD);
+    CHECK(hostfs_write(fs, fd, "hello", 5) == 5);
+    CHECK(hostfs_close(fs, fd) == 0);
+    CHECK(dir.get("out.txt") == "hello");
+
+    fd = hostfs_open(fs, "out.txt", HOSTFS_O_WRONLY | HOSTFS_O_APPEND);
+    REQUIRE(fd >= HOSTFS_FIRST_FD);
+    CHECK(hostfs_write(fs, fd, " world", 6) == 6);
+    CHECK(hostfs_close(fs, fd) == 0);
+    CHECK(dir.get("out.txt") == "hello world");
+
+    CHECK(hostfs_open(fs, "out.txt", HOSTFS_O_WRONLY | HOSTFS_O_CREAT | HOSTFS_O_EXCL) == -1);
+    CHECK(errno == EEXIST);
+    hostfs_destroy(fs);
+}
+
+TEST_CASE("hostfs sandbox") {
+    temp_dir dir;
+    dir.put("data.bin", "x");
+    hostfs_t* fs = hostfs_create(dir.path.c_str());
+    REQUIRE(fs != nullptr);
+
+    CHECK(hostfs_open(fs, "../data.bin", HOSTFS_O_RDONLY) == -1);
+    CHECK(errno == EACCES);
+    CHECK(hostfs_open(fs, "sub/../../etc/passwd", HOSTFS_O_RDONLY) == -1);
+    CHECK(errno == EACCES);
+    CHECK(hostfs_open(fs, "/", HOSTFS_O_RDONLY) == -1);
+    CHECK(errno == EISDIR);
+    CHECK(hostfs_open(fs, "missing", HOSTFS_O_RDONLY) == -1);
+    CHECK(errno == ENOENT);
+    CHECK(hostfs_open(fs, "data.bin", 0) == -1);
+    CHECK(errno == EINVAL);
+    hostfs_destroy(fs);
+}
+
+TEST_CASE("hostfs symbolic links stay inside the root") {
+    temp_dir dir;
+    temp_dir outside;
+    outside.put("secret.bin", "secret");
+    REQUIRE(symlink((outside.path + "/secret.bin").c_str(), (dir.path + "/abs.bin").c_str()) == 0);
+    REQUIRE(symlink(outside.path.c_str(), (dir.path + "/out").c_str()) == 0);
+    REQUIRE(mkdir((dir.path + "/sub").c_str(), 0755) == 0);
+    const string rel = "../../" + outside.path.substr(1) + "/secret.bin";
+    REQUIRE(symlink(rel.c_str(), (dir.path + "/sub/rel.bin").c_str()) == 0);
+    REQUIRE(symlink((outside.path + "/new.bin").c_str(), (dir.path + "/dangling.bin").c_str()) == 0);
+    hostfs_t* fs = hostfs_create(dir.path.c_str());
+    REQUIRE(fs != nullptr);
+
+    CHECK(hostfs_open(fs, "abs.bin", HOSTFS_O_RDONLY) == -1);
+    CHECK(hostfs_open(fs, "out/secret.bin", HOSTFS_O_RDONLY) == -1);
+    CHECK(hostfs_open(fs, "sub/rel.bin", HOSTFS_O_RDONLY) == -1);
+    CHECK(hostfs_open(fs, "out/new.bin", HOSTFS_O_WRONLY | HOSTFS_O_CREAT) == -1);
+    CHECK(hostfs_open(fs, "dangling.bin", HOSTFS_O_WRONLY | HOSTFS_O_CREAT) == -1);
+    struct stat st;
+    CHECK(stat((outside.path + "/new.bin").c_str(), &st) != 0);
+    hostfs_destroy(fs);
+}
+
+TEST_CASE("hostfs file table") {
+    temp_dir dir;
+    dir.put("data.bin", "x");
+    hostfs_t* fs = hostfs_create(dir.path.c_str());
+    REQUIRE(fs != nullptr);
+
+    for (int i = 0; i < HOSTFS_MAX_FILES; i++) {
+        CHECK(hostfs_open(fs, "data.bin", HOSTFS_O_RDONLY) == HOSTFS_FIRST_FD + i);
+    }
+    CHECK(hostfs_open(fs, "data.bin", HOSTFS_O_RDONLY) == -1);
+    CHECK(errno == EMFILE);
+    hostfs_close_all(fs);
+    CHECK(hostfs_open(fs, "data.bin", HOSTFS_O_RDONLY) == HOSTFS_FIRST_FD);
+    hostfs_destroy(fs);
+}
+
+TEST_CASE("hostfs speculation") {
+    temp_dir dir;
+    dir.put("data.bin", "0123456789");
+    dir.put("log.txt", "abc");
+    hostfs_t* fs = hostfs_create(dir.path.c_str());
+    REQUIRE(fs != nullptr);
+
+    const int data_fd = hostfs_open(fs, "data.bin", HOSTFS_O_RDONLY);
+    const int log_fd = hostfs_open(fs, "log.txt", HOSTFS_O_RDWR);
+    REQUIRE(data_fd >= HOSTFS_FIRST_FD);
+    REQUIRE(log_fd >= HOSTFS_FIRST_FD);
+    char buf[16] = {};
+    CHECK(hostfs_read(fs, data_fd, buf, 2) == 2);
+    CHECK(hostfs_lseek(fs, log_fd, 0, HOSTFS_SEEK_END) == 3);
+
+    hostfs_begin_speculation(fs);
+    CHECK(hostfs_read(fs, data_fd, buf, 4) == 4);
+    CHECK(memcmp(buf, "2345", 4) == 0);
+    CHECK(hostfs_write(fs, log_fd, "def", 3) == 3);
+    CHECK(hostfs_lseek(fs, log_fd, 0, HOSTFS_SEEK_CUR) == 6);
+    CHECK(hostfs_open(fs, "new.txt", HOSTFS_O_WRONLY | HOSTFS_O_CREAT) == -1);
+    CHECK(errno == EAGAIN);
+    CHECK(hostfs_close(fs, data_fd) == 0);
+    CHECK(hostfs_read(fs, data_fd, buf, 1) == -1);
+    // the freed slot is handed out again
+    const int spec_fd = hostfs_open(fs, "data.bin", HOSTFS_O_RDONLY);
+    CHECK(spec_fd == data_fd);
+    CHECK(hostfs_read(fs, spec_fd, buf, 1) == 1);
+    CHECK(hostfs_open(fs, "log.txt", HOSTFS_O_RDONLY) >= HOSTFS_FIRST_FD);
+    hostfs_end_speculation(fs);
+
+    // the host saw nothing of it
+    CHECK(dir.get("log.txt") == "abc");
+    struct stat st;
+    CHECK(stat((dir.path + "/new.txt").c_str(), &st) == -1);
+    // open files and offsets are back
+    CHECK(hostfs_read(fs, data_fd, buf, 3) == 3);
+    CHECK(memcmp(buf, "234", 3) == 0);
+    CHECK(hostfs_lseek(fs, log_fd, 0, HOSTFS_SEEK_CUR) == 3);
+    CHECK(hostfs_open(fs, "data.bin", HOSTFS_O_RDONLY) == HOSTFS_FIRST_FD + 2);
+    // and the real thing writes again
+    CHECK(hostfs_write(fs, log_fd, "def", 3) == 3);
+    CHECK(dir.get("log.txt") == "abcdef");
+    hostfs_destroy(fs);
+}
@@ -0,0 +1,162 @@
+/**
+ * Standalone OPL3 benchmark: replays a VGM log straight into ymf262_t
+ * as fast as possible, without the CPU or the rest of the system.
+ *
+ * Register writes go through ymf262_tick() pins, the same path the
+ * emulator uses, and the chip is ticked once per output sample.
+ * i.e.:
+ *     build/src/tests/opl3bench -n 10 music.vgm
+ */
+
+#include "chips/ymf262.h"
+#include "util/vgm.h"
+
+#include <argp.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#define BUGS_ADDRESS "https://github.com/X65/emu/issues"
+
+static char args_doc[] = "FILE.vgm";
+static struct argp_option options[] = {
+    { "loops", 'n', "COUNT", 0, "Replay the log COUNT times (default 1)" },
+    { "rate", 'r', "HZ", 0, "Output sample rate (default 44100)" },
+    { "quiet", 'q', 0, 0, "Print only the speed factor" },
+    { 0 }
+};
+
+struct arguments {
+    int loops, rate, quiet;
+    char* file;
+} arguments = { 1, VGM_SAMPLE_RATE, 0, NULL };
+
+static error_t parse_opt(int key, char* arg, struct argp_state* argp_state) {
+    struct arguments* args = argp_state->input;
+
+    switch (key) {
+        case 'n': args->loops = atoi(arg); break;
+        case 'r': args->rate = atoi(arg); break;
+        case 'q': args->quiet = 1; break;
+
+        case ARGP_KEY_ARG:
+            if (argp_state->arg_num >= 1) /* Too many arguments. */
+                argp_usage(argp_state);
+            args->file = arg;
+            break;
+        case ARGP_KEY_END:
+            if (!args->file || args->loops < 1 || args->rate < 1) argp_usage(argp_state);
+            break;
+
+        default: return ARGP_ERR_UNKNOWN;
+    }
+    return 0;
+}
+
+static struct argp argp = { options, parse_opt, args_doc, "OPL3 VGM replay benchmark\vReport bugs to: " BUGS_ADDRESS };
+
+static uint8_t* load_file(const char* filename, size_t* size) {
+    FILE* f = fopen(filename, "rb");
+    if (!f) {
+        fprintf(stderr, "Error: can't open file %s\n", filename);
+        exit(1);
+    }
+    fseek(f, 0, SEEK_END);
+    *size = (size_t)ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t* data = malloc(*size);
+    if (!data || fread(data, 1, *size, f) != *size) {
+        fprintf(stderr, "Error: can't read file %s\n", filename);
+        exit(1);
+    }
+    fclose(f);
+    return data;
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static float checksum = 0.0f;
+
+static void tick(ymf262_t* ymf, uint64_t pins) {
+    if (ymf262_tick(ymf, pins) & YMF262_SAMPLE) {
+        checksum += ymf->samples[0] + ymf->samples[1];
+    }
+}
+
+// write a register through the pins, takes two ticks (address latch and data)
+static void write_reg(ymf262_t* ymf, uint16_t reg, uint8_t data) {
+    const uint64_t bank = (reg & 0x100) ? YMF262_A1 : 0;
+    uint64_t pins = YMF262_CS | bank;
+    YMF262_SET_DATA(pins, (uint8_t)reg);
+    tick(ymf, pins);
+    pins = YMF262_CS | bank | YMF262_A0;
+    YMF262_SET_DATA(pins, data);
+    tick(ymf, pins);
+}
+
+int main(int argc, char* argv[]) {
+    argp_parse(&argp, argc, argv, 0, 0, &arguments);
+
+    size_t size;
+    uint8_t* data = load_file(arguments.file, &size);
+    vgm_reader_t reader;
+    if (!vgm_reader_init(&reader, data, size)) {
+        fprintf(stderr, "Error: %s is not a VGM file\n", arguments.file);
+        return 1;
+    }
+
+    // tick once per output sample, so each tick produces a sample
+    static ymf262_t ymf;
+    ymf262_init(&ymf, &(ymf262_desc_t){ .tick_hz = arguments.rate, .sound_hz = arguments.rate });
+
+    uint64_t num_writes = 0;
+    uint64_t sample_frac = 0;
+    uint64_t ticks_ahead = 0;  // ticks spent on register writes, taken off the next wait
+    const double start = now_sec();
+    for (int loop = 0; loop < arguments.loops; loop++) {
+        vgm_reader_rewind(&reader);
+        vgm_event_t ev;
+        while (vgm_reader_next(&reader, &ev)) {
+            if (ev.type == VGM_EVENT_WRITE) {
+                write_reg(&ymf, ev.reg, ev.data);
+                ticks_ahead += 2;
+                num_writes++;
+            }
+            else {
+                // convert 44100 Hz VGM samples to output rate
+                const uint64_t t = (uint64_t)ev.samples * (uint64_t)arguments.rate + sample_frac;
+                uint64_t n = t / VGM_SAMPLE_RATE;
+                sample_frac = t % VGM_SAMPLE_RATE;
+                const uint64_t skip = n < ticks_ahead ? n : ticks_ahead;
+                n -= skip;
+                ticks_ahead -= skip;
+                for (uint64_t i = 0; i < n; i++) {
+                    tick(&ymf, 0);
+                }
+            }
+        }
+    }
+    const double elapsed = now_sec() - start;
+    const uint64_t num_samples = ymf.ticks;
+    const double audio_sec = (double)num_samples / (double)arguments.rate;
+
+    if (arguments.quiet) {
+        printf("%.2f\n", audio_sec / elapsed);
+    }
+    else {
+        printf("file:      %s (VGM %x.%02x)\n", arguments.file, reader.header.version >> 8, reader.header.version & 0xFF);
+        printf("writes:    %llu\n", (unsigned long long)num_writes);
+        printf("samples:   %llu (%.2f s at %d Hz)\n", (unsigned long long)num_samples, audio_sec, arguments.rate);
+        printf("elapsed:   %.3f s\n", elapsed);
+        printf("speed:     %.2fx realtime, %.1f ns/sample\n", audio_sec / elapsed, elapsed * 1e9 / (double)num_samples);
+        printf("checksum:  %f\n", checksum);
+    }
+    free(data);
+    return 0;
+}
@@ -0,0 +1,185 @@
+/**
+ * Guest RAM benchmark: compares 16 MB guest RAM on normal pages with
+ * guestmem_alloc_huge(), using the access patterns of 24-bit programs,
+ * the debugger and the bulk tools.
+ *
+ * Run it with transparent huge pages enabled (madvise or always in
+ * /sys/kernel/mm/transparent_hugepage/enabled), or with pages reserved
+ * in /proc/sys/vm/nr_hugepages.
+ * i.e.:
+ *     build/src/tests/rambench -n 20000000
+ */
+
+#include "util/guestmem.h"
+
+#include <argp.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define BUGS_ADDRESS "https://github.com/X65/emu/issues"
+
+#define RAM_SIZE (1 << 24)
+
+static struct argp_option options[] = {
+    { "accesses", 'n', "COUNT", 0, "Byte accesses per pattern (default 10000000)" },
+    { "repeat", 'r', "COUNT", 0, "Run each pattern COUNT times, report the best (default 3)" },
+    { 0 }
+};
+
+struct arguments {
+    long accesses;
+    int repeat;
+} arguments = { 10000000, 3 };
+
+static error_t parse_opt(int key, char* arg, struct argp_state* argp_state) {
+    struct arguments* args = argp_state->input;
+
+    switch (key) {
+        case 'n': args->accesses = atol(arg); break;
+        case 'r': args->repeat = atoi(arg); break;
+
+        case ARGP_KEY_ARG: argp_usage(argp_state); break;
+        case ARGP_KEY_END:
+            if (args->accesses < 1 || args->repeat < 1) argp_usage(argp_state);
+            break;
+
+        default: return ARGP_ERR_UNKNOWN;
+    }
+    return 0;
+}
+
+static struct argp argp = { options, parse_opt, 0, "Guest RAM page size benchmark\vReport bugs to: " BUGS_ADDRESS };
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static volatile uint32_t checksum;
+
+// read-modify-write at random 24-bit addresses, like indirect long addressing all over RAM
+static void random_access(uint8_t* ram, long n) {
+    uint32_t x = 12345, sum = 0;
+    for (long i = 0; i < n; i++) {
+        x = x * 1103515245 + 12345;
+        const uint32_t addr = (x >> 4) & (RAM_SIZE - 1);
+        sum += ram[addr];
+        ram[addr] = (uint8_t)sum;
+    }
+    checksum += sum;
+}
+
+// short runs in one bank, then a jump to another, like code calling into data banks
+static void bank_hopping(uint8_t* ram, long n) {
+    uint32_t x = 54321, sum = 0;
+    uint32_t addr = 0;
+    for (long i = 0; i < n; i++) {
+        if ((i & 15) == 0) {
+            x = x * 1103515245 + 12345;
+            addr = ((x >> 8) & 0xFF0000) | ((x >> 16) & 0xFFFF);
+        }
+        sum += ram[addr];
+        addr = (addr & 0xFF0000) | ((addr + 1) & 0xFFFF);
+    }
+    checksum += sum;
+}
+
+// sweep of the whole RAM, like loading or saving a memory image
+static void sequential_copy(uint8_t* ram, long n) {
+    static uint8_t buf[1 << 16];
+    for (long done = 0; done < n; done += (long)sizeof(buf)) {
+        const uint32_t bank = (uint32_t)(done / (long)sizeof(buf)) & 0xFF;
+        memcpy(buf, ram + (bank << 16), sizeof(buf));
+        memcpy(ram + (((bank + 1) & 0xFF) << 16), buf, sizeof(buf));
+    }
+    checksum += buf[0];
+}
+
+typedef struct {
+    const char* name;
+    void (*run)(uint8_t* ram, long n);
+} pattern_t;
+
+static const pattern_t patterns[] = {
+    { "random", random_access },
+    { "bank-hopping", bank_hopping },
+    { "sequential", sequential_copy },
+};
+#define NUM_PATTERNS (sizeof(patterns) / sizeof(patterns[0]))
+
+static const char* pages_name(guestmem_pages_t pages) {
+    switch (pages) {
+        case GUESTMEM_PAGES_HUGE: return "huge";
+        case GUESTMEM_PAGES_TRANSPARENT_HUGE: return "transparent huge";
+        default: return "normal";
+    }
+}
+
+// kB of the mapping at ptr backed by transparent huge pages, -1 if unknown
+static long anon_huge_kb(const uint8_t* ptr) {
+    FILE* f = fopen("/proc/self/smaps", "r");
+    if (!f) {
+        return -1;
+    }
+    char line[256];
+    bool in_mapping = false;
+    long kb = -1;
+    while (fgets(line, sizeof(line), f)) {
+        unsigned long start, end;
+        if (sscanf(line, "%lx-%lx ", &start, &end) == 2) {
+            in_mapping = ((uintptr_t)ptr >= start) && ((uintptr_t)ptr < end);
+        }
+        else if (in_mapping && (sscanf(line, "AnonHugePages: %ld kB", &kb) == 1)) {
+            break;
+        }
+    }
+    fclose(f);
+    return kb;
+}
+
+static void measure(guestmem_t* mem, double* results) {
+    // touch every page up front, first-touch faults are not what's being measured
+    for (size_t i = 0; i < mem->size; i += 4096) {
+        mem->ptr[i] = (uint8_t)i;
+    }
+    for (size_t p = 0; p < NUM_PATTERNS; p++) {
+        double best = 0.0;
+        for (int r = 0; r < arguments.repeat; r++) {
+            const double start = now_sec();
+            patterns[p].run(mem->ptr, arguments.accesses);
+            const double elapsed = now_sec() - start;
+            if ((r == 0) || (elapsed < best)) {
+                best = elapsed;
+            }
+        }
+        results[p] = best * 1e9 / (double)arguments.accesses;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    argp_parse(&argp, argc, argv, 0, 0, &arguments);
+
+    guestmem_t normal, huge;
+    if (!guestmem_alloc(&normal, RAM_SIZE) || !guestmem_alloc_huge(&huge, RAM_SIZE)) {
+        fprintf(stderr, "Error: out of memory\n");
+        return 1;
+    }
+    double normal_ns[NUM_PATTERNS], huge_ns[NUM_PATTERNS];
+    measure(&normal, normal_ns);
+    measure(&huge, huge_ns);
+
+    printf("accesses:  %ld per pattern, best of %d\n", arguments.accesses, arguments.repeat);
+    printf("huge:      %s pages, %ld kB AnonHugePages\n", pages_name(huge.pages), anon_huge_kb(huge.ptr));
+    printf("%-14s %10s %10s %8s\n", "pattern", "normal", "huge", "speedup");
+    for (size_t p = 0; p < NUM_PATTERNS; p++) {
+        printf("%-14s %7.2f ns %7.2f ns %7.2fx\n", patterns[p].name, normal_ns[p], huge_ns[p], normal_ns[p] / huge_ns[p]);
+    }
+    guestmem_free(&huge);
+    guestmem_free(&normal);
+    return 0;
+}
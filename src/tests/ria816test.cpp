@@ -0,0 +1,266 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest.h"
+
+#include "chips/ria816.h"
+
+#include <cstdint>
+#include <cstring>
+
+TEST_CASE("ria816 API stack") {
+    static ria816_t ria;
+    const ria816_desc_t desc = { .tick_hz = 1000000 };
+    ria816_init(&ria, &desc);
+
+    // values pushed high byte first pop low byte first
+    CHECK(ria816_api_push32(&ria, 0x12345678));
+    CHECK(ria816_api_push16(&ria, 0xABCD));
+    CHECK(ria816_api_stack_len(&ria) == 6);
+    CHECK(ria816_api_pop(&ria) == 0xCD);
+    CHECK(ria816_api_pop(&ria) == 0xAB);
+    CHECK(ria816_api_pop32(&ria) == 0x12345678);
+    CHECK(ria816_api_pop(&ria) == 0);
+
+    for (int i = 0; i < RIA816_API_STACK_SIZE; i++) {
+        CHECK(ria816_api_push(&ria, (uint8_t)i));
+    }
+    CHECK_FALSE(ria816_api_push(&ria, 0));
+    ria816_api_zxstack(&ria);
+    CHECK(ria816_api_stack_len(&ria) == 0);
+}
+
+static uint8_t api_stub(uint8_t op, void* user_data) {
+    *(int*)user_data += 1;
+    return op == 0x42 ? RIA816_ERRNO_EIO : RIA816_ERRNO_ENOSYS;
+}
+
+TEST_CASE("ria816 API latency") {
+    static ria816_t ria;
+    int calls = 0;
+    const ria816_desc_t desc = { .tick_hz = 1000000, .api_cb = api_stub, .api_latency = 3, .user_data = &calls };
+    ria816_init(&ria, &desc);
+
+    uint64_t pins = RIA816_CS | RIA816_API_OP;
+    RIA816_SET_DATA(pins, 0x42);
+    ria816_tick(&ria, pins);
+    CHECK(calls == 1);
+    CHECK(ria.reg[RIA816_API_BUSY] == RIA816_API_BUSY_FLAG);
+    CHECK(ria.reg[RIA816_API_ERRNO] == RIA816_ERRNO_OK);
+
+    // a second call while busy is ignored
+    ria816_tick(&ria, pins);
+    CHECK(calls == 1);
+    ria816_tick(&ria, 0);
+    CHECK(ria.reg[RIA816_API_BUSY] == RIA816_API_BUSY_FLAG);
+    ria816_tick(&ria, 0);
+    CHECK(ria.reg[RIA816_API_BUSY] == 0);
+    CHECK(ria.reg[RIA816_API_ERRNO] == RIA816_ERRNO_EIO);
+}
+
+static void timers_write(ria816_t* ria, uint8_t reg, uint8_t data) {
+    uint64_t pins = RIA816_TIMERS_CS | reg;
+    RIA816_SET_DATA(pins, data);
+    ria816_tick(ria, pins);
+}
+
+static uint8_t timers_read(ria816_t* ria, uint8_t reg) {
+    return RIA816_GET_DATA(ria816_tick(ria, RIA816_TIMERS_CS | RIA816_RW | reg));
+}
+
+TEST_CASE("ria816 timers") {
+    static ria816_t ria;
+    const ria816_desc_t desc = { .tick_hz = 1000000 };
+    ria816_init(&ria, &desc);
+
+    // timer A continuous with period 10us, timer B counting its underflows
+    timers_write(&ria, RIA816_TIMERS_TALO, 9);
+    timers_write(&ria, RIA816_TIMERS_TAHI, 0);
+    timers_write(&ria, RIA816_TIMERS_TBLO, 1);
+    timers_write(&ria, RIA816_TIMERS_TBHI, 0);
+    timers_write(&ria, RIA816_TIMERS_ICR, 0x80 | RIA816_TIMERS_ICR_TB);
+    timers_write(&ria, RIA816_TIMERS_CRB, (1 << 6) | (1 << 0));
+    timers_write(&ria, RIA816_TIMERS_CRA, 1 << 0);
+    const uint64_t start = ria.us;
+    CHECK(ria.timers.ta.underflow == start + 10);
+    CHECK(ria.timers.tb.underflow == RIA816_TIMER_IDLE);
+
+    ria816_tick(&ria, 0);
+    ria816_tick(&ria, 0);
+    CHECK(timers_read(&ria, RIA816_TIMERS_TALO) == 6);
+
+    // timer B underflows on the second timer A underflow
+    uint64_t pins = 0;
+    while (!(pins & RIA816_INT0)) {
+        pins = ria816_tick(&ria, 0);
+    }
+    CHECK(ria.us == start + 20);
+    CHECK(ria816_timer_counter(&ria, &ria.timers.ta) == 9);
+    CHECK(timers_read(&ria, RIA816_TIMERS_ICR) == (RIA816_TIMERS_ICR_IRQ | RIA816_TIMERS_ICR_TB | RIA816_TIMERS_ICR_TA));
+    CHECK_FALSE(ria816_tick(&ria, 0) & RIA816_INT0);
+
+    // stopping freezes the counter
+    timers_write(&ria, RIA816_TIMERS_CRA, 0);
+    const uint16_t frozen = ria816_timer_counter(&ria, &ria.timers.ta);
+    for (int i = 0; i < 100; i++) ria816_tick(&ria, 0);
+    CHECK(ria816_timer_counter(&ria, &ria.timers.ta) == frozen);
+    CHECK(ria.timers.next_event == RIA816_TIMER_IDLE);
+
+    // one-shot restart with force load stops after one underflow
+    timers_write(&ria, RIA816_TIMERS_CRA, (1 << 4) | (1 << 3) | (1 << 0));
+    for (int i = 0; i < 8; i++) ria816_tick(&ria, 0);
+    CHECK(timers_read(&ria, RIA816_TIMERS_CRA) == ((1 << 3) | (1 << 0)));
+    CHECK(timers_read(&ria, RIA816_TIMERS_CRA) == (1 << 3));
+    CHECK(ria.timers.ta.underflow == RIA816_TIMER_IDLE);
+}
+
+TEST_CASE("ria816 seeded random numbers") {
+    static ria816_t a, b, c;
+    const ria816_desc_t desc = { .tick_hz = 1000000, .rng_seed = 42 };
+    const ria816_desc_t other = { .tick_hz = 1000000, .rng_seed = 43 };
+    ria816_init(&a, &desc);
+    ria816_init(&b, &desc);
+    ria816_init(&c, &other);
+    bool differs = false;
+    for (int i = 0; i < 16; i++) {
+        const uint32_t r = ria816_rand32(&a);
+        CHECK(ria816_rand32(&b) == r);
+        differs |= ria816_rand32(&c) != r;
+    }
+    CHECK(differs);
+
+    // the generator state is part of the snapshot
+    b = a;
+    CHECK(ria816_rand32(&b) == ria816_rand32(&a));
+}
+
+static void ria_write16(ria816_t* ria, uint8_t reg, uint16_t value) {
+    for (int i = 0; i < 2; i++) {
+        uint64_t pins = RIA816_CS | (uint8_t)(reg + i);
+        RIA816_SET_DATA(pins, (uint8_t)(value >> (i * 8)));
+        ria816_tick(ria, pins);
+    }
+}
+
+static uint16_t ria_read16(ria816_t* ria, uint8_t reg) {
+    const uint8_t lo = RIA816_GET_DATA(ria816_tick(ria, RIA816_CS | RIA816_RW | reg));
+    return lo | (uint16_t)(RIA816_GET_DATA(ria816_tick(ria, RIA816_CS | RIA816_RW | (uint8_t)(reg + 1))) << 8);
+}
+
+static void ria_perf_latch(ria816_t* ria, uint8_t index) {
+    uint64_t pins = RIA816_CS | RIA816_PERF;
+    RIA816_SET_DATA(pins, index);
+    ria816_tick(ria, pins);
+}
+
+static uint8_t ria_perf_read(ria816_t* ria) {
+    return RIA816_GET_DATA(ria816_tick(ria, RIA816_CS | RIA816_RW | RIA816_PERF));
+}
+
+TEST_CASE("ria816 math accelerator") {
+    static ria816_t ria;
+    const ria816_desc_t desc = { .tick_hz = 1000000 };
+    ria816_init(&ria, &desc);
+    CHECK(ria.reg[RIA816_MATH_CTRL] == RIA816_MATH_SIGNED_A);
+
+    // unsigned 32-bit product
+    ria.reg[RIA816_MATH_CTRL] = 0;
+    ria_write16(&ria, RIA816_MATH_OPERA, 0xFFFF);
+    ria_write16(&ria, RIA816_MATH_OPERB, 0xFFFF);
+    CHECK(ria_read16(&ria, RIA816_MATH_MULAB) == 0x0001);
+    CHECK(ria_read16(&ria, RIA816_MATH_HI) == 0xFFFE);
+
+    // signed product
+    ria.reg[RIA816_MATH_CTRL] = RIA816_MATH_SIGNED_A | RIA816_MATH_SIGNED_B;
+    CHECK(ria_read16(&ria, RIA816_MATH_MULAB) == 0x0001);
+    CHECK(ria_read16(&ria, RIA816_MATH_HI) == 0x0000);
+
+    // the dividend high word writes must leave the latched performance counters alone
+    ria_perf_latch(&ria, RIA816_PERF_IRQS);
+    const auto perf = ria.perf;
+
+    // signed 32/16 divide, remainder takes the dividend sign
+    ria.reg[RIA816_MATH_CTRL] = RIA816_MATH_SIGNED_A | RIA816_MATH_SIGNED_B | RIA816_MATH_DIV32;
+    ria_write16(&ria, RIA816_MATH_HI, 0xFFFE);  // -100000
+    ria_write16(&ria, RIA816_MATH_OPERA, 0x7960);
+    ria_write16(&ria, RIA816_MATH_OPERB, 7);
+    CHECK(ria_read16(&ria, RIA816_MATH_DIVAB) == (uint16_t)-14285);
+    CHECK(ria_read16(&ria, RIA816_MATH_HI) == (uint16_t)-5);
+    CHECK_FALSE(ria.reg[RIA816_MATH_CTRL] & RIA816_MATH_OVERFLOW);
+
+    // unsigned quotient overflow and division by zero
+    ria.reg[RIA816_MATH_CTRL] = RIA816_MATH_DIV32;
+    ria_write16(&ria, RIA816_MATH_HI, 0x0001);
+    ria_write16(&ria, RIA816_MATH_OPERA, 0x0000);
+    ria_write16(&ria, RIA816_MATH_OPERB, 1);
+    CHECK(ria_read16(&ria, RIA816_MATH_DIVAB) == 0xFFFF);
+    CHECK(ria.reg[RIA816_MATH_CTRL] & RIA816_MATH_OVERFLOW);
+    ria_write16(&ria, RIA816_MATH_OPERB, 3);
+    CHECK(ria_read16(&ria, RIA816_MATH_DIVAB) == 21845);
+    CHECK(ria_read16(&ria, RIA816_MATH_HI) == 1);
+    CHECK_FALSE(ria.reg[RIA816_MATH_CTRL] & RIA816_MATH_OVERFLOW);
+    ria_write16(&ria, RIA816_MATH_OPERB, 0);
+    CHECK(ria_read16(&ria, RIA816_MATH_DIVAB) == 0xFFFF);
+    CHECK(ria.reg[RIA816_MATH_CTRL] & RIA816_MATH_OVERFLOW);
+
+    CHECK(ria.perf.pos == perf.pos);
+    CHECK(memcmp(ria.perf.latch, perf.latch, sizeof(perf.latch)) == 0);
+    // and latching doesn't change the math registers
+    ria_write16(&ria, RIA816_MATH_HI, 0x1234);
+    ria_perf_latch(&ria, RIA816_PERF_CYCLES);
+    CHECK(RIA816_REG16(ria.reg, RIA816_MATH_HI) == 0x1234);
+    CHECK(ria_read16(&ria, RIA816_MATH_HI) == 0);  // still the low word of the last dividend
+    CHECK(ria.reg[RIA816_MATH_CTRL] & RIA816_MATH_OVERFLOW);
+}
+
+TEST_CASE("ria816 performance counters") {
+    static ria816_t ria;
+    const ria816_desc_t desc = { .tick_hz = 1000000 };
+    ria816_init(&ria, &desc);
+
+    for (int i = 0; i < 300; i++) {
+        ria816_tick(&ria, (i % 3 == 0) ? RIA816_SYNC : 0);
+    }
+    ria816_tick(&ria, RIA816_INTACK);
+
+    ria_perf_latch(&ria, RIA816_PERF_CYCLES);
+    uint8_t bytes[RIA816_PERF_NUM_COUNTERS * RIA816_PERF_COUNTER_SIZE];
+    for (auto& b : bytes) {
+        b = ria_perf_read(&ria);
+    }
+    // latched at the write, the reads don't change the values
+    CHECK(bytes[0] == 302 % 256);
+    CHECK(bytes[1] == 302 / 256);
+    CHECK(bytes[6] == 100);
+    CHECK(bytes[12] == 1);
+    CHECK(ria_perf_read(&ria) == 0);
+}
+
+TEST_CASE("ria816 performance counters and 32-bit divide interleaved") {
+    static ria816_t ria;
+    const ria816_desc_t desc = { .tick_hz = 1000000 };
+    ria816_init(&ria, &desc);
+    for (int i = 0; i < 10; i++) {
+        ria816_tick(&ria, RIA816_SYNC);
+    }
+
+    // 0x00FF0000 / 0x100, the dividend high byte is a counter index past the last one
+    ria.reg[RIA816_MATH_CTRL] = RIA816_MATH_DIV32;
+    ria_write16(&ria, RIA816_MATH_HI, 0x00FF);
+    ria_perf_latch(&ria, RIA816_PERF_INSTRUCTIONS);
+    ria_write16(&ria, RIA816_MATH_OPERA, 0x0000);
+    ria_write16(&ria, RIA816_MATH_OPERB, 0x0100);
+    CHECK(ria_perf_read(&ria) == 10);
+    CHECK(ria_read16(&ria, RIA816_MATH_DIVAB) == 0xFF00);
+    CHECK(ria_read16(&ria, RIA816_MATH_HI) == 0);
+    CHECK_FALSE(ria.reg[RIA816_MATH_CTRL] & RIA816_MATH_OVERFLOW);
+    CHECK(ria_perf_read(&ria) == 0);
+    // a latch between the operand writes and the divide doesn't change the dividend
+    ria_write16(&ria, RIA816_MATH_HI, 0x0001);
+    ria_write16(&ria, RIA816_MATH_OPERA, 0x0005);
+    // the latch write is counted before it latches
+    const uint64_t cycles = ria.perf.counter[RIA816_PERF_CYCLES] + 1;
+    ria_perf_latch(&ria, RIA816_PERF_CYCLES);
+    CHECK(ria_read16(&ria, RIA816_MATH_DIVAB) == 0x0100);
+    CHECK(ria_read16(&ria, RIA816_MATH_HI) == 5);
+    CHECK(ria_perf_read(&ria) == (uint8_t)cycles);
+    CHECK(ria_perf_read(&ria) == (uint8_t)(cycles >> 8));
+}
@@ -0,0 +1,114 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest.h"
+
+#include "util/lz.h"
+#include "util/snapfile.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using namespace std;
+
+// mix of runs, repeated patterns and noise
+static vector<uint8_t> test_data(size_t size) {
+    vector<uint8_t> data(size);
+    uint32_t x = 12345;
+    for (size_t i = 0; i < size; i++) {
+        x = x * 1103515245 + 12345;
+        if ((i / 1024) % 3 == 0) {
+            data[i] = 0;
+        }
+        else if ((i / 1024) % 3 == 1) {
+            data[i] = (uint8_t)(i % 7);
+        }
+        else {
+            data[i] = (uint8_t)(x >> 16);
+        }
+    }
+    return data;
+}
+
+TEST_CASE("lz roundtrip") {
+    for (size_t size : { 0, 1, 12, 13, 100, 65536, 300000 }) {
+        const vector<uint8_t> src = test_data(size);
+        vector<uint8_t> packed(lz_compress_bound(size));
+        const size_t packed_size = lz_compress(src.data(), size, packed.data(), packed.size());
+        REQUIRE(packed_size > 0);
+        CHECK(lz_decompressed_size(packed.data(), packed_size) == size);
+        vector<uint8_t> out(size + 1);
+        REQUIRE(lz_decompress(packed.data(), packed_size, out.data(), out.size()) == size);
+        CHECK(memcmp(out.data(), src.data(), size) == 0);
+    }
+
+    SUBCASE("runs compress") {
+        const vector<uint8_t> zeros(65536, 0);
+        vector<uint8_t> packed(lz_compress_bound(zeros.size()));
+        CHECK(lz_compress(zeros.data(), zeros.size(), packed.data(), packed.size()) < 512);
+    }
+
+    SUBCASE("corrupt input is rejected") {
+        const vector<uint8_t> src = test_data(65536);
+        vector<uint8_t> packed(lz_compress_bound(src.size()));
+        const size_t packed_size = lz_compress(src.data(), src.size(), packed.data(), packed.size());
+        vector<uint8_t> out(src.size());
+        CHECK(lz_decompress(packed.data(), packed_size / 2, out.data(), out.size()) == LZ_ERROR);
+        CHECK(lz_decompress(packed.data(), packed_size, out.data(), out.size() / 2) == LZ_ERROR);
+        CHECK(lz_decompressed_size(packed.data(), packed_size / 2) == LZ_ERROR);
+    }
+}
+
+TEST_CASE("snapfile chunks") {
+    const vector<uint8_t> ram = test_data(200000);
+    const uint32_t regs[4] = { 1, 2, 3, 4 };
+
+    snapfile_writer_t w;
+    snapfile_writer_init(&w, "TEST");
+    snapfile_write_chunk(&w, "REGS", 1, regs, sizeof(regs));
+    snapfile_write_chunk(&w, "NEW ", 7, regs, sizeof(regs));
+    snapfile_write_chunk(&w, "RAM ", 2, ram.data(), ram.size());
+    chips_range_t data = snapfile_writer_finish(&w);
+    REQUIRE(data.ptr != nullptr);
+    CHECK(data.size < ram.size());
+
+    SUBCASE("known chunks are read, others skipped") {
+        snapfile_reader_t r;
+        REQUIRE(snapfile_reader_init(&r, "TEST", data));
+        snapfile_chunk_t chunk;
+        uint32_t regs_in[4] = {};
+        vector<uint8_t> ram_in(ram.size());
+        int num_read = 0;
+        int num_chunks = 0;
+        while (snapfile_next_chunk(&r, &chunk)) {
+            num_chunks++;
+            if (snapfile_chunk_is(&chunk, "REGS", 1)) {
+                CHECK(snapfile_read_chunk(&chunk, regs_in, sizeof(regs_in)));
+                num_read++;
+            }
+            else if (snapfile_chunk_is(&chunk, "RAM ", 2)) {
+                CHECK_FALSE(snapfile_read_chunk(&chunk, ram_in.data(), ram_in.size() - 1));
+                CHECK(snapfile_read_chunk(&chunk, ram_in.data(), ram_in.size()));
+                num_read++;
+            }
+        }
+        CHECK(num_chunks == 3);
+        CHECK(num_read == 2);
+        CHECK(memcmp(regs_in, regs, sizeof(regs)) == 0);
+        CHECK(ram_in == ram);
+    }
+
+    SUBCASE("wrong magic and truncated files") {
+        snapfile_reader_t r;
+        CHECK_FALSE(snapfile_reader_init(&r, "XXXX", data));
+        chips_range_t truncated = { data.ptr, data.size - 1 };
+        REQUIRE(snapfile_reader_init(&r, "TEST", truncated));
+        snapfile_chunk_t chunk;
+        int num_chunks = 0;
+        while (snapfile_next_chunk(&r, &chunk)) {
+            num_chunks++;
+        }
+        CHECK(num_chunks == 2);
+    }
+
+    free(data.ptr);
+}
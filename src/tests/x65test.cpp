@@ -0,0 +1,677 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest.h"
+
+#define CHIPS_IMPL
+#include "chips/chips_common.h"
+#include "chips/w65c816s.h"
+#include "chips/clk.h"
+#include "chips/beeper.h"
+#undef CHIPS_IMPL
+#include "systems/x65.h"
+#include "util/lz.h"
+#include "util/snapfile.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <string>
+#include <utility>
+#include <vector>
+#include <unistd.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+// 16 MB RAM is allocated by x65_init(), the rest is too big for the stack
+static x65_t sys;
+
+// program at $0200 writing RIA registers in order, then counting in $10 forever
+static void boot(const vector<pair<uint8_t, uint8_t>>& ria_writes, const x65_desc_t& desc = {}) {
+    REQUIRE(x65_init(&sys, &desc));
+    uint16_t pc = 0x0200;
+    auto put = [&](uint8_t b) { mem_wr(&sys, 0, pc++, b); };
+    for (auto [reg, data] : ria_writes) {
+        put(0xA9);  // LDA #data
+        put(data);
+        put(0x8D);  // STA $FFC0+reg
+        put((uint8_t)(X65_IO_RIA_BASE + reg));
+        put((uint8_t)(X65_IO_RIA_BASE >> 8));
+    }
+    put(0xE6);  // INC $10
+    put(0x10);
+    put(0x80);  // BRA -4
+    put(0xFC);
+    mem_wr16(&sys, 0, 0xFFFC, 0x0200);
+    x65_set_running(&sys, true);
+}
+
+// RIA register writes setting up a transfer, the count register starts it
+static vector<pair<uint8_t, uint8_t>> dma(uint32_t src, int8_t src_step, uint32_t dst, int8_t dst_step, uint8_t count) {
+    return {
+        { RIA816_DMA_ADDRSRC, (uint8_t)src },
+        { RIA816_DMA_ADDRSRC + 1, (uint8_t)(src >> 8) },
+        { RIA816_DMA_ADDRSRC + 2, (uint8_t)(src >> 16) },
+        { RIA816_DMA_STEPSRC, (uint8_t)src_step },
+        { RIA816_DMA_ADDRDST, (uint8_t)dst },
+        { RIA816_DMA_ADDRDST + 1, (uint8_t)(dst >> 8) },
+        { RIA816_DMA_ADDRDST + 2, (uint8_t)(dst >> 16) },
+        { RIA816_DMA_STEPDST, (uint8_t)dst_step },
+        { RIA816_DMA_COUNT, count },
+    };
+}
+
+TEST_CASE("x65 DMA RAM to RAM") {
+    SUBCASE("overlapping forward copy") {
+        boot(dma(0x010000, 1, 0x010010, 1, 0x40));
+        for (uint32_t i = 0; i < 0x50; i++) sys.ram[0x010000 + i] = (uint8_t)i;
+        x65_exec(&sys, 100);
+        CHECK(sys.ria.reg[RIA816_DMA_DMAERR] == RIA816_DMA_OK);
+        for (uint32_t i = 0; i < 0x40; i++) CHECK(sys.ram[0x010010 + i] == (uint8_t)i);
+        CHECK(RIA816_REG24(sys.ria.reg, RIA816_DMA_ADDRSRC) == 0x010040);
+        CHECK(RIA816_REG24(sys.ria.reg, RIA816_DMA_ADDRDST) == 0x010050);
+        x65_discard(&sys);
+    }
+    SUBCASE("overlapping backward copy") {
+        boot(dma(0x010010, 1, 0x010000, 1, 0x40));
+        for (uint32_t i = 0; i < 0x50; i++) sys.ram[0x010000 + i] = (uint8_t)i;
+        x65_exec(&sys, 100);
+        for (uint32_t i = 0; i < 0x40; i++) CHECK(sys.ram[0x010000 + i] == (uint8_t)(i + 0x10));
+        x65_discard(&sys);
+    }
+    SUBCASE("strided gather") {
+        boot(dma(0x020000, 2, 0x030000, -1, 8));
+        for (uint32_t i = 0; i < 16; i++) sys.ram[0x020000 + i] = (uint8_t)(0xA0 + i);
+        x65_exec(&sys, 100);
+        for (uint32_t i = 0; i < 8; i++) CHECK(sys.ram[0x030000 - i] == (uint8_t)(0xA0 + 2 * i));
+        x65_discard(&sys);
+    }
+    SUBCASE("range wrapping the address space") {
+        boot(dma(0xFFFFF0, 1, 0x010000, 1, 0x20));
+        x65_exec(&sys, 100);
+        CHECK(sys.ria.reg[RIA816_DMA_DMAERR] == RIA816_DMA_ERR_RANGE);
+        CHECK(RIA816_REG24(sys.ria.reg, RIA816_DMA_ADDRSRC) == 0xFFFFF0);
+        x65_discard(&sys);
+    }
+}
+
+TEST_CASE("x65 DMA and I/O") {
+    SUBCASE("RAM to registers and back") {
+        boot(dma(0x010000, 1, X65_IO_MIXER_BASE, 1, X65_IO_MIXER_LEN));
+        for (uint32_t i = 0; i < X65_IO_MIXER_LEN; i++) sys.ram[0x010000 + i] = (uint8_t)(0x30 + i);
+        x65_exec(&sys, 100);
+        CHECK(sys.ria.reg[RIA816_DMA_DMAERR] == RIA816_DMA_OK);
+        for (uint32_t i = 0; i < X65_IO_MIXER_LEN; i++) CHECK(sys.mixer.reg[i] == (uint8_t)(0x30 + i));
+        // RAM behind the I/O window is not written
+        CHECK(sys.ram[X65_IO_MIXER_BASE] == 0);
+        x65_discard(&sys);
+
+        boot(dma(X65_IO_MIXER_BASE, 1, 0x020000, 1, X65_IO_MIXER_LEN));
+        for (uint32_t i = 0; i < X65_IO_MIXER_LEN; i++) sys.mixer.reg[i] = (uint8_t)(0x50 + i);
+        x65_exec(&sys, 100);
+        for (uint32_t i = 0; i < X65_IO_MIXER_LEN; i++) CHECK(sys.ram[0x020000 + i] == (uint8_t)(0x50 + i));
+        x65_discard(&sys);
+    }
+    SUBCASE("unreachable registers") {
+        // the second source byte is a RIA register
+        boot(dma(X65_IO_RIA_BASE - 1, 1, X65_IO_MIXER_BASE, 1, 2));
+        sys.mixer.reg[0] = 0x12;
+        x65_exec(&sys, 100);
+        CHECK(sys.ria.reg[RIA816_DMA_DMAERR] == RIA816_DMA_ERR_IO);
+        // nothing was transferred
+        CHECK(sys.mixer.reg[0] == 0x12);
+        x65_discard(&sys);
+    }
+    SUBCASE("register accesses take bus cycles from the CPU") {
+        // the same program with a RAM and an I/O destination, the counting loop runs 2 instructions in 8 cycles
+        boot(dma(0x010000, 1, 0x020000, 1, 0));
+        x65_exec(&sys, 1000);
+        const uint64_t ram_instructions = sys.ria.perf.counter[RIA816_PERF_INSTRUCTIONS];
+        const uint64_t ram_cycles = sys.ria.perf.counter[RIA816_PERF_CYCLES];
+        x65_discard(&sys);
+
+        boot(dma(0x010000, 1, X65_IO_MIXER_BASE, 0, 0));
+        x65_exec(&sys, 1000);
+        CHECK(sys.dma.req.count == 0);
+        CHECK(sys.ria.perf.counter[RIA816_PERF_CYCLES] == ram_cycles);
+        const uint64_t stalled = ram_instructions - sys.ria.perf.counter[RIA816_PERF_INSTRUCTIONS];
+        CHECK(stalled >= 256 / 4 - 1);
+        CHECK(stalled <= 256 / 4 + 1);
+        x65_discard(&sys);
+    }
+}
+
+// number of RAM pages in the dirty page map
+static uint32_t num_dirty_pages() {
+    uint32_t n = 0;
+    for (uint32_t page = 0; page < X65_RAM_NUM_PAGES; page++) {
+        n += x65_dirty_page(&sys, page) ? 1 : 0;
+    }
+    return n;
+}
+
+// boot with dirty page tracking, the map starts clean after the program is written
+static void boot_tracked(const vector<pair<uint8_t, uint8_t>>& ria_writes) {
+    x65_desc_t desc = {};
+    desc.track_dirty_pages = true;
+    boot(ria_writes, desc);
+    x65_clear_dirty_pages(&sys);
+}
+
+// RIA register writes pushing a value of size bytes to the API stack, high byte first
+static void api_push(vector<pair<uint8_t, uint8_t>>& writes, uint32_t value, int size) {
+    while (size--) {
+        writes.push_back({ RIA816_API_STACK, (uint8_t)(value >> (8 * size)) });
+    }
+}
+
+TEST_CASE("x65 dirty page tracking") {
+    SUBCASE("mem_wr") {
+        boot_tracked({});
+        mem_wr(&sys, 0x12, 0x3456, 0x01);
+        CHECK(x65_dirty_page(&sys, 0x123));
+        CHECK(num_dirty_pages() == 1);
+        x65_set_dirty_tracking(&sys, false);
+        mem_wr(&sys, 0x12, 0x4456, 0x01);
+        CHECK_FALSE(x65_dirty_page(&sys, 0x124));
+        x65_discard(&sys);
+    }
+    SUBCASE("CPU writes") {
+        boot_tracked({});
+        x65_exec(&sys, 100);
+        // the counter at $10
+        CHECK(x65_dirty_page(&sys, 0x000));
+        CHECK(num_dirty_pages() == 1);
+        x65_discard(&sys);
+    }
+    SUBCASE("DMA") {
+        boot_tracked(dma(0x010000, 1, 0x020FF8, 1, 0x10));
+        x65_exec(&sys, 100);
+        CHECK(sys.ria.reg[RIA816_DMA_DMAERR] == RIA816_DMA_OK);
+        CHECK(x65_dirty_page(&sys, 0x020));
+        CHECK(x65_dirty_page(&sys, 0x021));
+        CHECK_FALSE(x65_dirty_page(&sys, 0x010));
+        CHECK(num_dirty_pages() == 3);
+        x65_discard(&sys);
+    }
+    SUBCASE("API memset and memcpy") {
+        vector<pair<uint8_t, uint8_t>> writes;
+        api_push(writes, 2, 2);         // count
+        api_push(writes, 0x5A, 1);      // value
+        api_push(writes, 0x030FFF, 3);  // addr
+        writes.push_back({ RIA816_API_OP, RIA816_API_OP_MEMSET });
+        api_push(writes, 0x1001, 2);    // count
+        api_push(writes, 0x030FFF, 3);  // src
+        api_push(writes, 0x040000, 3);  // dst
+        writes.push_back({ RIA816_API_OP, RIA816_API_OP_MEMCPY });
+        boot_tracked(writes);
+        x65_exec(&sys, 100);
+        CHECK(sys.ram[0x031000] == 0x5A);
+        CHECK(sys.ram[0x040001] == 0x5A);
+        CHECK(x65_dirty_page(&sys, 0x030));
+        CHECK(x65_dirty_page(&sys, 0x031));
+        CHECK(x65_dirty_page(&sys, 0x040));
+        CHECK(x65_dirty_page(&sys, 0x041));
+        CHECK(num_dirty_pages() == 5);
+        x65_discard(&sys);
+    }
+    SUBCASE("snapshot load") {
+        boot_tracked({});
+        chips_range_t snapshot = x65_save_snapshot(&sys);
+        REQUIRE(snapshot.ptr);
+        x65_clear_dirty_pages(&sys);
+        CHECK(x65_load_snapshot(&sys, snapshot));
+        CHECK(num_dirty_pages() == X65_RAM_NUM_PAGES);
+        free(snapshot.ptr);
+        x65_discard(&sys);
+    }
+    SUBCASE("XEX loader") {
+        boot_tracked({});
+        const uint8_t xex[] = {
+            0xFF, 0xFF,                          // header
+            0x00, 0x20, 0x01, 0x20, 0x11, 0x22,  // $2000-$2001
+            0xFE, 0xFF, 0xFE, 0xFF, 0x03,        // bank 3
+            0xFF, 0x1F, 0x00, 0x20, 0x33, 0x44,  // $1FFF-$2000
+        };
+        CHECK(x65_quickload_xex(&sys, { (void*)xex, sizeof(xex) }));
+        CHECK(sys.ram[0x032000] == 0x44);
+        CHECK(x65_dirty_page(&sys, 0x002));
+        CHECK(x65_dirty_page(&sys, 0x031));
+        CHECK(x65_dirty_page(&sys, 0x032));
+        CHECK(num_dirty_pages() == 3);
+        x65_discard(&sys);
+    }
+}
+
+// RAM pages and CPU state to compare after going back in time
+struct rewind_state_t {
+    vector<uint8_t> pages;
+    w65816_t cpu;
+};
+
+static const uint32_t rewind_pages[] = {
+    0x000,  // the counter at $10
+    0x100,  // filled with one value each frame, the delta compresses
+    0x101,  // random bytes, the delta is stored as it is
+    0x102,  // rewritten with the values it already had
+};
+
+static rewind_state_t rewind_state() {
+    rewind_state_t state = { {}, sys.cpu };
+    for (uint32_t page : rewind_pages) {
+        const uint8_t* ptr = &sys.ram[page * X65_RAM_PAGE_SIZE];
+        state.pages.insert(state.pages.end(), ptr, ptr + X65_RAM_PAGE_SIZE);
+    }
+    return state;
+}
+
+static bool rewind_state_equal(const rewind_state_t& state) {
+    const rewind_state_t cur = rewind_state();
+    return (cur.pages == state.pages) && (0 == memcmp(&cur.cpu, &state.cpu, sizeof(w65816_t)));
+}
+
+// run a frame and write the test pages through the bus
+static void rewind_frame(uint32_t frame, uint32_t& rnd) {
+    x65_exec(&sys, 1000);
+    for (uint32_t i = 0; i < X65_RAM_PAGE_SIZE; i++) {
+        rnd = rnd * 1103515245 + 12345;
+        mem_wr(&sys, 0x10, (uint16_t)(0x0000 + i), (uint8_t)frame);
+        mem_wr(&sys, 0x10, (uint16_t)(0x1000 + i), (uint8_t)(rnd >> 16));
+        mem_wr(&sys, 0x10, (uint16_t)(0x2000 + i), sys.ram[0x102000 + i]);
+    }
+}
+
+TEST_CASE("x65 rewind") {
+    boot({});
+    for (uint32_t i = 0; i < X65_RAM_PAGE_SIZE; i++) sys.ram[0x102000 + i] = (uint8_t)(i * 7);
+    const x65_rewind_desc_t rw_desc = {};
+    x65_rewind_t* rw = x65_rewind_create(&sys, &rw_desc);
+    REQUIRE(rw);
+
+    const int num_frames = 8;
+    vector<rewind_state_t> states = { rewind_state() };
+    uint32_t rnd = 1;
+    for (int f = 1; f <= num_frames; f++) {
+        rewind_frame((uint32_t)f, rnd);
+        x65_rewind_capture(rw);
+        states.push_back(rewind_state());
+    }
+    CHECK(x65_rewind_num_frames(rw) == num_frames);
+    CHECK(states[1].pages != states[2].pages);
+
+    SUBCASE("back to the last capture") {
+        // frames which were not captured yet are dropped
+        rewind_frame(0xFF, rnd);
+        CHECK(x65_rewind(rw, 0) == 0);
+        CHECK(rewind_state_equal(states[num_frames]));
+    }
+    SUBCASE("frame by frame") {
+        size_t used = x65_rewind_used(rw);
+        for (int f = num_frames - 1; f >= 0; f--) {
+            CHECK(x65_rewind(rw, 1) == 1);
+            CHECK(rewind_state_equal(states[(size_t)f]));
+            CHECK(x65_rewind_used(rw) < used);
+            used = x65_rewind_used(rw);
+        }
+        CHECK(x65_rewind(rw, 1) == 0);
+        CHECK(x65_rewind_used(rw) == 0);
+        CHECK(rewind_state_equal(states[0]));
+    }
+    SUBCASE("going on after going back") {
+        CHECK(x65_rewind(rw, 3) == 3);
+        CHECK(rewind_state_equal(states[num_frames - 3]));
+        // the history continues from the restored state
+        rewind_frame(0x80, rnd);
+        x65_rewind_capture(rw);
+        const rewind_state_t branched = rewind_state();
+        rewind_frame(0x81, rnd);
+        x65_rewind_capture(rw);
+        CHECK(x65_rewind(rw, 1) == 1);
+        CHECK(rewind_state_equal(branched));
+        CHECK(x65_rewind(rw, 2) == 2);
+        CHECK(rewind_state_equal(states[num_frames - 4]));
+    }
+    SUBCASE("run-ahead leaves the state as it was") {
+        x65_run_ahead(rw, 2, 1000);
+        CHECK(rewind_state_equal(states[num_frames]));
+        CHECK(x65_rewind_num_frames(rw) == num_frames);
+    }
+    x65_rewind_destroy(rw);
+    x65_discard(&sys);
+}
+
+TEST_CASE("x65 run-ahead without rewind history") {
+    boot({});
+    x65_rewind_desc_t rw_desc = {};
+    rw_desc.no_history = true;
+    x65_rewind_t* rw = x65_rewind_create(&sys, &rw_desc);
+    REQUIRE(rw);
+    uint32_t rnd = 1;
+    for (int f = 1; f <= 4; f++) {
+        rewind_frame((uint32_t)f, rnd);
+        x65_rewind_capture(rw);
+    }
+    CHECK(x65_rewind_num_frames(rw) == 0);
+    CHECK(x65_rewind_used(rw) == 0);
+    const rewind_state_t captured = rewind_state();
+
+    x65_run_ahead_begin(rw);
+    CHECK(sys.opl3.muted);
+    rewind_frame(0xFF, rnd);
+    x65_exec(&sys, 1000);
+    const uint64_t sample_index = sys.opl3.sample_index;
+    x65_run_ahead_end(rw);
+    CHECK(sample_index > sys.opl3.sample_index);
+    CHECK_FALSE(sys.opl3.muted);
+    CHECK_FALSE(sys.audio.muted);
+    CHECK(rewind_state_equal(captured));
+    // only the last capture can be gone back to
+    rewind_frame(0x80, rnd);
+    CHECK(x65_rewind(rw, 1) == 0);
+    CHECK(rewind_state_equal(captured));
+    x65_rewind_destroy(rw);
+    x65_discard(&sys);
+}
+
+TEST_CASE("x65 run-ahead keeps host files as they were") {
+    char dir[] = "/tmp/x65test.XXXXXX";
+    REQUIRE(mkdtemp(dir) != nullptr);
+    const string path = string(dir) + "/log.txt";
+    hostfs_t* fs = hostfs_create(dir);
+    REQUIRE(fs);
+
+    // the program writes "ab" once to the first file, x65_init() closes all files so it is opened after
+    const int fd = HOSTFS_FIRST_FD;
+    vector<pair<uint8_t, uint8_t>> writes = {
+        { RIA816_API_STACK, 'b' },
+        { RIA816_API_STACK, 'a' },
+        { RIA816_API_STACK, (uint8_t)fd },
+        { RIA816_API_OP, RIA816_API_OP_WRITE_STACK },
+    };
+    x65_desc_t desc = {};
+    desc.fs = fs;
+    boot(writes, desc);
+    REQUIRE(hostfs_open(fs, "log.txt", HOSTFS_O_WRONLY | HOSTFS_O_CREAT) == fd);
+    const x65_rewind_desc_t rw_desc = {};
+    x65_rewind_t* rw = x65_rewind_create(&sys, &rw_desc);
+    REQUIRE(rw);
+    x65_run_ahead(rw, 1, 1000);
+    CHECK(hostfs_lseek(fs, fd, 0, HOSTFS_SEEK_CUR) == 0);
+    x65_exec(&sys, 1000);
+    CHECK(hostfs_lseek(fs, fd, 0, HOSTFS_SEEK_CUR) == 2);
+    x65_rewind_capture(rw);
+    x65_run_ahead(rw, 1, 1000);
+    CHECK(hostfs_lseek(fs, fd, 0, HOSTFS_SEEK_CUR) == 2);
+    x65_rewind_destroy(rw);
+    x65_discard(&sys);
+    hostfs_destroy(fs);
+
+    struct stat st;
+    CHECK(stat(path.c_str(), &st) == 0);
+    CHECK(st.st_size == 2);
+    unlink(path.c_str());
+    rmdir(dir);
+}
+
+// copy of a snapshot with chunk id written as version, or left out for version 0
+static chips_range_t rewrite_snapshot(chips_range_t data, const char* id, uint16_t version) {
+    snapfile_reader_t r;
+    REQUIRE(snapfile_reader_init(&r, "X65S", data));
+    snapfile_writer_t w;
+    snapfile_writer_init(&w, "X65S");
+    snapfile_chunk_t chunk;
+    while (snapfile_next_chunk(&r, &chunk)) {
+        vector<uint8_t> payload(chunk.size);
+        REQUIRE(snapfile_read_chunk(&chunk, payload.data(), payload.size()));
+        if (memcmp(chunk.id, id, 4) != 0) {
+            snapfile_write_chunk(&w, chunk.id, chunk.version, payload.data(), payload.size());
+        }
+        else if (version != 0) {
+            snapfile_write_chunk(&w, chunk.id, version, payload.data(), payload.size());
+        }
+    }
+    return snapfile_writer_finish(&w);
+}
+
+TEST_CASE("x65 snapshot load restores all chips or nothing") {
+    boot({});
+    x65_exec(&sys, 1000);
+    const chips_range_t snapshot = x65_save_snapshot(&sys);
+    REQUIRE(snapshot.ptr);
+    x65_exec(&sys, 1000);
+    const uint8_t counter = sys.ram[0x10];
+    const uint16_t pc = sys.cpu.PC;
+    for (const char* id : { "CPU ", "RIA ", "GPIO", "CGIA", "OPL3", "MIX ", "BEEP", "RAM " }) {
+        CAPTURE(id);
+        for (uint16_t version : { 0, 99 }) {
+            const chips_range_t changed = rewrite_snapshot(snapshot, id, version);
+            REQUIRE(changed.ptr);
+            CHECK_FALSE(x65_load_snapshot(&sys, changed));
+            CHECK(sys.ram[0x10] == counter);
+            CHECK(sys.cpu.PC == pc);
+            free(changed.ptr);
+        }
+    }
+    // chunks the load doesn't use are skipped in any version
+    const chips_range_t unknown = rewrite_snapshot(snapshot, "THMB", 99);
+    REQUIRE(unknown.ptr);
+    CHECK(x65_load_snapshot(&sys, unknown));
+    CHECK(sys.ram[0x10] != counter);
+    free(unknown.ptr);
+    free(snapshot.ptr);
+    x65_discard(&sys);
+}
+
+// read FM frames until the worker has nothing more to render
+static int drain_fm() {
+    float frames[2 * 256];
+    int num_frames = 0;
+    for (int idle = 0; idle < 20;) {
+        const int n = ymf262_read_samples(&sys.opl3, frames, 256);
+        num_frames += n;
+        if (n == 0) {
+            idle++;
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+        else {
+            idle = 0;
+        }
+    }
+    return num_frames;
+}
+
+TEST_CASE("x65 rewind keeps the FM worker running") {
+    x65_desc_t desc = {};
+    desc.fm_thread = true;
+    boot({}, desc);
+    REQUIRE(sys.opl3.worker);
+    const ymf262_worker_t* worker = sys.opl3.worker;
+    const x65_rewind_desc_t rw_desc = {};
+    x65_rewind_t* rw = x65_rewind_create(&sys, &rw_desc);
+    REQUIRE(rw);
+    for (int f = 0; f < 4; f++) {
+        x65_exec(&sys, 1000);
+        x65_rewind_capture(rw);
+    }
+    drain_fm();
+    const uint64_t sample_index = sys.opl3.sample_index;
+    CHECK(x65_rewind(rw, 2) == 2);
+    CHECK(sys.opl3.sample_index < sample_index);
+    x65_run_ahead(rw, 1, 1000);
+    CHECK(sys.opl3.worker == worker);
+    // a restarted worker would start over with a ring of silence
+    CHECK(drain_fm() == 0);
+    // and the output goes on from where it was
+    x65_exec(&sys, 1000);
+    CHECK(drain_fm() > 0);
+    x65_rewind_destroy(rw);
+    x65_discard(&sys);
+}
+
+TEST_CASE("x65 parent and fork run independently") {
+    static x65_t child;
+    boot({});
+    x65_exec(&sys, 1000);
+    const chips_range_t snapshot = x65_save_snapshot(&sys);
+    REQUIRE(snapshot.ptr);
+    const x65_desc_t desc = {};
+    REQUIRE(x65_fork(&sys, &child, &desc));
+    const uint8_t counter = mem_rd(&sys, 0, 0x10);
+    CHECK(mem_rd(&child, 0, 0x10) == counter);
+
+    // RAM is copy-on-write on both sides
+    CHECK(x65_exec(&sys, 1000) > 0);
+    CHECK(mem_rd(&sys, 0, 0x10) != counter);
+    CHECK(mem_rd(&child, 0, 0x10) == counter);
+    mem_wr(&sys, 0, 0x2000, 0xAA);
+    CHECK(mem_rd(&child, 0, 0x2000) != 0xAA);
+    CHECK(x65_exec(&child, 1000) > 0);
+    CHECK(mem_rd(&sys, 0, 0x2000) == 0xAA);
+    const uint8_t xex[] = { 0xFF, 0xFF, 0x00, 0x03, 0x00, 0x03, 0xEA };
+    CHECK(x65_quickload_xex(&sys, (chips_range_t){ .ptr = (void*)xex, .size = sizeof(xex) }));
+    CHECK(mem_rd(&sys, 0, 0x300) == 0xEA);
+    CHECK(mem_rd(&child, 0, 0x300) != 0xEA);
+    CHECK(x65_load_snapshot(&sys, snapshot));
+    CHECK(mem_rd(&sys, 0, 0x2000) != 0xAA);
+
+    // the parent can go first, and a fork of the changed parent gets its RAM as it is now
+    static x65_t sibling;
+    mem_wr(&sys, 0, 0x2000, 0x55);
+    REQUIRE(x65_fork(&sys, &sibling, &desc));
+    x65_discard(&sys);
+    CHECK(mem_rd(&sibling, 0, 0x2000) == 0x55);
+    CHECK(mem_rd(&child, 0, 0x2000) != 0x55);
+    CHECK(x65_exec(&child, 1000) > 0);
+    CHECK(x65_exec(&sibling, 1000) > 0);
+    x65_discard(&sibling);
+    x65_discard(&child);
+    free(snapshot.ptr);
+}
+
+static void xex_put16(vector<uint8_t>& xex, uint16_t value) {
+    xex.push_back((uint8_t)value);
+    xex.push_back((uint8_t)(value >> 8));
+}
+
+static void xex_segment(vector<uint8_t>& xex, uint16_t start, const vector<uint8_t>& data) {
+    xex_put16(xex, start);
+    xex_put16(xex, (uint16_t)(start + data.size() - 1));
+    xex.insert(xex.end(), data.begin(), data.end());
+}
+
+static void xex_bank(vector<uint8_t>& xex, uint8_t bank) {
+    xex_segment(xex, X65_XEX_BANK, { bank });
+}
+
+static void xex_packed_segment(vector<uint8_t>& xex, uint16_t start, const vector<uint8_t>& data) {
+    vector<uint8_t> packed(lz_compress_bound(data.size()));
+    packed.resize(lz_compress(data.data(), data.size(), packed.data(), packed.size()));
+    REQUIRE(packed.size() > 0);
+    xex_put16(xex, X65_XEX_LZ);
+    xex_put16(xex, X65_XEX_LZ_END);
+    xex_put16(xex, start);
+    xex_put16(xex, (uint16_t)(start + data.size() - 1));
+    xex_put16(xex, (uint16_t)packed.size());
+    xex.insert(xex.end(), packed.begin(), packed.end());
+}
+
+static bool quickload(const vector<uint8_t>& xex) {
+    return x65_quickload_xex(&sys, (chips_range_t){ .ptr = (void*)xex.data(), .size = xex.size() });
+}
+
+static vector<uint8_t> pattern(size_t size, uint8_t seed) {
+    vector<uint8_t> data(size);
+    for (size_t i = 0; i < size; i++) {
+        data[i] = (uint8_t)(seed + (i / 7));
+    }
+    return data;
+}
+
+TEST_CASE("x65 XEX loader") {
+    boot({});
+    const vector<uint8_t> data = pattern(0x1000, 0x40);
+    vector<uint8_t> xex = { 0xFF, 0xFF };
+
+    SUBCASE("plain and banked segments") {
+        xex_segment(xex, 0x1000, { 1, 2, 3 });
+        xex_bank(xex, 2);
+        xex_segment(xex, 0x2000, data);
+        // a $FFFF header may start any segment
+        xex_put16(xex, 0xFFFF);
+        xex_segment(xex, 0x3000, { 4 });
+        CHECK(quickload(xex));
+        CHECK(mem_rd(&sys, 0, 0x1000) == 1);
+        CHECK(mem_rd(&sys, 0, 0x1002) == 3);
+        CHECK(memcmp(&sys.ram[0x022000], data.data(), data.size()) == 0);
+        CHECK(mem_rd(&sys, 0, 0x2000) == 0);
+        CHECK(mem_rd(&sys, 2, 0x3000) == 4);
+    }
+    SUBCASE("packed segments") {
+        xex_packed_segment(xex, 0x1000, data);
+        xex_bank(xex, 3);
+        xex_packed_segment(xex, 0xF000, data);
+        REQUIRE(xex.size() < 2 * data.size());
+        CHECK(quickload(xex));
+        CHECK(memcmp(&sys.ram[0x001000], data.data(), data.size()) == 0);
+        CHECK(memcmp(&sys.ram[0x03F000], data.data(), data.size()) == 0);
+    }
+    SUBCASE("segments reaching the I/O window") {
+        // RAM up to $FEFF, CGIA registers from $FF00, the reset vector in the RIA
+        xex_segment(xex, 0xFEFE, { 0x11, 0x22, 0x33, 0x44 });
+        xex_segment(xex, 0xFFFC, { 0x00, 0x80 });
+        CHECK(quickload(xex));
+        CHECK(sys.ram[0xFEFE] == 0x11);
+        CHECK(sys.ram[0xFEFF] == 0x22);
+        CHECK(sys.cgia.regs[0] == 0x33);
+        CHECK(sys.cgia.regs[1] == 0x44);
+        CHECK(sys.ram[0xFF00] == 0);
+        CHECK(sys.ria.reg[RIA816_CPU_E_RESETB] == 0x00);
+        CHECK(sys.ria.reg[RIA816_CPU_E_RESETB + 1] == 0x80);
+    }
+    SUBCASE("the I/O window is only in bank 0") {
+        xex_bank(xex, 1);
+        xex_packed_segment(xex, 0xF000, data);
+        CHECK(quickload(xex));
+        CHECK(memcmp(&sys.ram[0x01F000], data.data(), data.size()) == 0);
+    }
+    SUBCASE("malformed files are rejected before anything is written") {
+        // a valid segment first, it must not be loaded either
+        xex_segment(xex, 0x1000, { 1, 2, 3 });
+        SUBCASE("no $FFFF header") {
+            xex.erase(xex.begin(), xex.begin() + 2);
+        }
+        SUBCASE("truncated segment header") {
+            xex_put16(xex, 0x2000);
+            xex.push_back(0x20);
+        }
+        SUBCASE("truncated segment") {
+            xex_segment(xex, 0x2000, { 1, 2, 3, 4 });
+            xex.pop_back();
+        }
+        SUBCASE("end before start") {
+            xex_put16(xex, 0x2001);
+            xex_put16(xex, 0x2000);
+            xex.push_back(0);
+        }
+        SUBCASE("truncated packed segment") {
+            xex_packed_segment(xex, 0x2000, data);
+            xex.pop_back();
+        }
+        SUBCASE("corrupt packed segment") {
+            // an empty block for a 4 KB segment
+            xex_put16(xex, X65_XEX_LZ);
+            xex_put16(xex, X65_XEX_LZ_END);
+            xex_put16(xex, 0x2000);
+            xex_put16(xex, 0x2FFF);
+            xex_put16(xex, 1);
+            xex.push_back(0x00);
+        }
+        SUBCASE("packed segment reaching the I/O window") {
+            xex_packed_segment(xex, 0xF000, pattern(X65_XEX_IO - 0xF000 + 1, 0));
+        }
+        CHECK_FALSE(quickload(xex));
+        CHECK(mem_rd(&sys, 0, 0x1000) == 0);
+        CHECK(mem_rd(&sys, 0, 0x2000) == 0);
+    }
+    x65_discard(&sys);
+}
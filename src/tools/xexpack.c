@@ -0,0 +1,209 @@
+/**
+ * Packs the segments of a .xex file into LZ4 blocks, or unpacks them
+ * again for tools which only know plain segments.
+ *
+ * Packed segments start with a $FFFD-$FFFC header, followed by the start
+ * and end address of the unpacked data and the size of the LZ4 block,
+ * see x65_quickload_xex(). Bank selections are kept, bytes in the bank 0
+ * I/O window stay plain, and segments which don't get smaller are kept
+ * as they are.
+ * i.e.:
+ *     build/src/tools/xexpack -v -o roms/MODE6_packed.xex roms/MODE6_Farfar-perso1.xex
+ */
+
+#include "util/lz.h"
+#include "util/xex.h"
+
+#include <argp.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#define BUGS_ADDRESS "https://github.com/X65/emu/issues"
+
+// smaller segments are not worth a block header
+#define XEX_MIN_PACK_SIZE (64)
+
+static char args_doc[] = "FILE.xex";
+static struct argp_option options[] = {
+    { "output", 'o', "FILE", 0, "Write the result to FILE" },
+    { "unpack", 'd', 0, 0, "Unpack all segments instead" },
+    { "verbose", 'v', 0, 0, "Print each segment" },
+    { 0 }
+};
+
+struct arguments {
+    int unpack, verbose;
+    char* input;
+    char* output;
+} arguments = { 0, 0, NULL, NULL };
+
+static error_t parse_opt(int key, char* arg, struct argp_state* argp_state) {
+    struct arguments* args = argp_state->input;
+
+    switch (key) {
+        case 'o': args->output = arg; break;
+        case 'd': args->unpack = 1; break;
+        case 'v': args->verbose = 1; break;
+
+        case ARGP_KEY_ARG:
+            if (argp_state->arg_num >= 1) /* Too many arguments. */
+                argp_usage(argp_state);
+            args->input = arg;
+            break;
+        case ARGP_KEY_END:
+            if (!args->input || !args->output) argp_usage(argp_state);
+            break;
+
+        default: return ARGP_ERR_UNKNOWN;
+    }
+    return 0;
+}
+
+static struct argp argp = { options, parse_opt, args_doc, "X65 XEX segment packer\vReport bugs to: " BUGS_ADDRESS };
+
+static uint8_t* load_file(const char* filename, size_t* size) {
+    FILE* f = fopen(filename, "rb");
+    if (!f) {
+        fprintf(stderr, "Error: can't open file %s\n", filename);
+        exit(1);
+    }
+    fseek(f, 0, SEEK_END);
+    *size = (size_t)ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t* data = malloc(*size ? *size : 1);
+    if (!data || fread(data, 1, *size, f) != *size) {
+        fprintf(stderr, "Error: can't read file %s\n", filename);
+        exit(1);
+    }
+    fclose(f);
+    return data;
+}
+
+static void fail(const char* msg) {
+    fprintf(stderr, "Error: %s: %s\n", arguments.input, msg);
+    exit(1);
+}
+
+static FILE* out;
+static size_t out_size;
+
+static void put16(uint16_t v) {
+    fputc(v & 0xFF, out);
+    fputc(v >> 8, out);
+    out_size += 2;
+}
+
+static void put_plain(uint8_t bank, uint16_t start, uint16_t end, const uint8_t* data) {
+    put16(start);
+    put16(end);
+    out_size += fwrite(data, 1, (size_t)(end - start + 1), out);
+    if (arguments.verbose) {
+        printf("  %02X:%04X-%04X  %5u bytes\n", bank, start, end, end - start + 1);
+    }
+}
+
+// packs the segment if that makes it smaller
+static void put_segment(uint8_t bank, uint16_t start, uint16_t end, const uint8_t* data) {
+    const size_t len = (size_t)(end - start + 1);
+    if (arguments.unpack || (len < XEX_MIN_PACK_SIZE)) {
+        put_plain(bank, start, end, data);
+        return;
+    }
+    static uint8_t packed[0x10000 + 0x10000 / 255 + 16];
+    const size_t packed_size = lz_compress(data, len, packed, sizeof(packed));
+    if ((packed_size == 0) || (packed_size > 0xFFFF) || (packed_size + 6 >= len)) {
+        put_plain(bank, start, end, data);
+        return;
+    }
+    put16(X65_XEX_LZ);
+    put16(X65_XEX_LZ_END);
+    put16(start);
+    put16(end);
+    put16((uint16_t)packed_size);
+    out_size += fwrite(packed, 1, packed_size, out);
+    if (arguments.verbose) {
+        printf("  %02X:%04X-%04X  %5zu bytes packed to %zu\n", bank, start, end, len, packed_size);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    argp_parse(&argp, argc, argv, 0, 0, &arguments);
+
+    size_t size;
+    uint8_t* data = load_file(arguments.input, &size);
+    if (size < 2 || data[0] != 0xFF || data[1] != 0xFF) {
+        fail("not a XEX file");
+    }
+    out = fopen(arguments.output, "wb");
+    if (!out) {
+        fprintf(stderr, "Error: can't create file %s\n", arguments.output);
+        return 1;
+    }
+    put16(0xFFFF);
+
+    static uint8_t unpacked[0x10000];
+    const uint8_t* ptr = data;
+    const uint8_t* end = data + size;
+    uint8_t bank = 0;
+    while (ptr < end) {
+        if ((end - ptr) >= 2 && ptr[0] == 0xFF && ptr[1] == 0xFF) {
+            ptr += 2;
+        }
+        if ((end - ptr) < 4) {
+            fail("truncated segment header");
+        }
+        uint16_t start_addr = ptr[1] << 8 | ptr[0];
+        uint16_t end_addr = ptr[3] << 8 | ptr[2];
+        ptr += 4;
+        const uint8_t* seg = ptr;
+        if (start_addr == X65_XEX_LZ && end_addr == X65_XEX_LZ_END) {
+            // already packed, unpack it and pack it again
+            if ((end - ptr) < 6) {
+                fail("truncated packed segment header");
+            }
+            start_addr = ptr[1] << 8 | ptr[0];
+            end_addr = ptr[3] << 8 | ptr[2];
+            const size_t packed_size = (size_t)(ptr[5] << 8 | ptr[4]);
+            ptr += 6;
+            const size_t len = (size_t)(end_addr - start_addr + 1);
+            if ((start_addr > end_addr) || ((size_t)(end - ptr) < packed_size)
+                || (lz_decompress(ptr, packed_size, unpacked, len) != len)) {
+                fail("corrupt packed segment");
+            }
+            ptr += packed_size;
+            seg = unpacked;
+        }
+        else {
+            if ((start_addr > end_addr) || ((size_t)(end - ptr) < (size_t)(end_addr - start_addr + 1))) {
+                fail("truncated segment");
+            }
+            ptr += end_addr - start_addr + 1;
+            if (start_addr == end_addr && start_addr == X65_XEX_BANK) {
+                bank = seg[0];
+                put_plain(bank, start_addr, end_addr, seg);
+                continue;
+            }
+        }
+        if ((bank == 0) && (end_addr >= X65_XEX_IO)) {
+            // registers have to be written one by one, only the RAM part is packed
+            if (start_addr < X65_XEX_IO) {
+                put_segment(bank, start_addr, X65_XEX_IO - 1, seg);
+                seg += X65_XEX_IO - start_addr;
+                start_addr = X65_XEX_IO;
+            }
+            put_plain(bank, start_addr, end_addr, seg);
+        }
+        else {
+            put_segment(bank, start_addr, end_addr, seg);
+        }
+    }
+    if (fclose(out) != 0) {
+        fprintf(stderr, "Error: can't write file %s\n", arguments.output);
+        return 1;
+    }
+    printf("%s: %zu -> %zu bytes (%.1f%%)\n", arguments.output, size, out_size, 100.0 * (double)out_size / (double)size);
+    free(data);
+    return 0;
+}
@@ -290,6 +290,9 @@ struct ExampleAppConsole {
             for (int i = first > 0 ? first : 0; i < History.Size; i++)
                 AddLog("%3d: %s\n", i, History[i]);
         }
+        else if (!win->rx) {
+            AddLog("# UART is connected to the host\n");
+        }
         else {
             const char* s = command_line;
             while (*s) {
@@ -367,7 +370,7 @@ void ui_console_discard(ui_console_t* win) {
 void ui_console_process_tx(ui_console_t* win) {
     // Pull characters from tx buffer
     uint8_t data;
-    while (rb_get(win->tx, &data)) {
+    while (win->tx && rb_get(win->tx, &data)) {
         console.AddChar(data);
     }
 }
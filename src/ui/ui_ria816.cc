@@ -36,8 +36,18 @@ void ui_ria816_discard(ui_ria816_t* win) {
     win->valid = false;
 }
 
+// microseconds until the next scheduled underflow
+static void _ui_ria816_draw_underflow(const ria816_t* ria, const ria816_timer_t* t) {
+    if (t->underflow == RIA816_TIMER_IDLE) {
+        ImGui::Text("---");
+    }
+    else {
+        ImGui::Text("%" PRIu64 "us", t->underflow - ria->us);
+    }
+}
+
 static void _ui_ria816_m6526_draw_state(ui_ria816_t* win) {
-    const m6526_t* cia = &win->ria->cia;
+    const ria816_timers_t* cia = &win->ria->timers;
     if (ImGui::BeginTable("##cia_timers", 3)) {
         ImGui::TableSetupColumn("", ImGuiTableColumnFlags_WidthFixed, 72);
         ImGui::TableSetupColumn("Timer A", ImGuiTableColumnFlags_WidthFixed, 80);
@@ -52,9 +62,9 @@ static void _ui_ria816_m6526_draw_state(ui_ria816_t* win) {
         ImGui::TableNextColumn();
         ImGui::Text("Counter");
         ImGui::TableNextColumn();
-        ImGui::Text("%04X", cia->ta.counter);
+        ImGui::Text("%04X", ria816_timer_counter(win->ria, &cia->ta));
         ImGui::TableNextColumn();
-        ImGui::Text("%04X", cia->tb.counter);
+        ImGui::Text("%04X", ria816_timer_counter(win->ria, &cia->tb));
         ImGui::TableNextColumn();
         ImGui::Text("Control");
         ImGui::TableNextColumn();
@@ -121,23 +131,17 @@ static void _ui_ria816_m6526_draw_state(ui_ria816_t* win) {
         ImGui::TableNextColumn();
         ImGui::Text("---");
         ImGui::TableNextColumn();
-        ImGui::Text("Bit");
-        ImGui::TableNextColumn();
-        ImGui::Text("%s", cia->ta.t_bit ? "ON" : "OFF");
-        ImGui::TableNextColumn();
-        ImGui::Text("%s", cia->tb.t_bit ? "ON" : "OFF");
-        ImGui::TableNextColumn();
-        ImGui::Text("Out");
+        ImGui::Text("Underflow");
         ImGui::TableNextColumn();
-        ImGui::Text("%s", cia->ta.t_out ? "ON" : "OFF");
+        _ui_ria816_draw_underflow(win->ria, &cia->ta);
         ImGui::TableNextColumn();
-        ImGui::Text("%s", cia->tb.t_out ? "ON" : "OFF");
+        _ui_ria816_draw_underflow(win->ria, &cia->tb);
         ImGui::TableNextColumn();
         ImGui::EndTable();
     }
     ImGui::SeparatorText("Timer Interrupt");
-    ui_util_b8("Mask:   ", cia->intr.imr);
-    ui_util_b8("Control:", cia->intr.icr);
+    ui_util_b8("Mask:   ", cia->imr);
+    ui_util_b8("Control:", cia->icr);
 }
 
 static void _ui_ria816_draw_state(ui_ria816_t* win) {
@@ -197,6 +201,10 @@ static void _ui_ria816_draw_state(ui_ria816_t* win) {
         ImGui::EndTable();
         ImGui::Text("Time: %016" PRIX64, ria->us);
     }
+    ImGui::SeparatorText("Performance Counters");
+    ImGui::Text("Cycles:       %" PRIu64, ria->perf.counter[RIA816_PERF_CYCLES]);
+    ImGui::Text("Instructions: %" PRIu64, ria->perf.counter[RIA816_PERF_INSTRUCTIONS]);
+    ImGui::Text("IRQs:         %" PRIu64, ria->perf.counter[RIA816_PERF_IRQS]);
 }
 
 void ui_ria816_draw(ui_ria816_t* win) {
@@ -99,6 +99,9 @@ static void _ui_x65_draw_menu(ui_x65_t* ui) {
             ImGui::EndMenu();
         }
         if (ImGui::BeginMenu("Tools")) {
+            if (ui->audio_capture_cb && ImGui::MenuItem("Record Audio", 0, ui->audio_capture)) {
+                ui->audio_capture = ui->audio_capture_cb(!ui->audio_capture);
+            }
             ImGui::MenuItem("About...", NULL, &ui->show_about);
             ui_util_options_menu();
             ImGui::EndMenu();
@@ -435,6 +438,8 @@ void ui_x65_init(ui_x65_t* ui, const ui_x65_desc_t* ui_desc) {
     CHIPS_ASSERT(ui_desc->boot_cb);
     ui->x65 = ui_desc->x65;
     ui->boot_cb = ui_desc->boot_cb;
+    ui->audio_capture_cb = ui_desc->audio_capture_cb;
+    ui->audio_capture = false;
     ui_snapshot_init(&ui->snapshot, &ui_desc->snapshot);
     ui->show_about = false;
     int x = 20, y = 20, dx = 10, dy = 10;
@@ -499,8 +504,10 @@ void ui_x65_init(ui_x65_t* ui, const ui_x65_desc_t* ui_desc) {
     {
         ui_console_desc_t desc = { 0 };
         desc.title = "RIA UART";
-        desc.rx = &ui->x65->ria.uart_rx;
-        desc.tx = &ui->x65->ria.uart_tx;
+        if (!ui_desc->uart_bridged) {
+            desc.rx = &ui->x65->ria.uart_rx;
+            desc.tx = &ui->x65->ria.uart_tx;
+        }
         desc.x = x;
         desc.y = y;
         ui_console_init(&ui->ria_uart, &desc);
@@ -534,7 +541,7 @@ void ui_x65_init(ui_x65_t* ui, const ui_x65_desc_t* ui_desc) {
         ui_audio_desc_t desc = { 0 };
         desc.title = "Audio Output";
         desc.sample_buffer = ui->x65->audio.sample_buffer;
-        desc.num_samples = ui->x65->audio.num_samples;
+        desc.num_samples = ui->x65->audio.num_samples * X65_AUDIO_CHANNELS;
         desc.x = x;
         desc.y = y;
         ui_audio_init(&ui->audio, &desc);
@@ -619,7 +626,7 @@ void ui_x65_draw(ui_x65_t* ui, const ui_x65_frame_t* frame) {
     CHIPS_ASSERT(ui && ui->x65 && frame);
     _ui_x65_draw_menu(ui);
     _ui_x65_draw_about(ui);
-    ui_audio_draw(&ui->audio, ui->x65->audio.sample_pos);
+    ui_audio_draw(&ui->audio, ui->x65->audio.sample_pos * X65_AUDIO_CHANNELS);
     ui_display_draw(&ui->display, &frame->display);
     ui_w65816_draw(&ui->cpu);
     ui_ria816_draw(&ui->ria);
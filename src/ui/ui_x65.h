@@ -82,12 +82,16 @@ extern "C" {
 
 // reboot callback
 typedef void (*ui_x65_boot_cb)(x65_t* sys);
+// audio capture start/stop callback, returns true if capture is running
+typedef bool (*ui_x65_audio_capture_cb)(bool start);
 
 // setup params for ui_x65_init()
 typedef struct {
-    x65_t* x65;                              // pointer to x65_t instance to track
-    ui_x65_boot_cb boot_cb;                  // reboot callback function
-    ui_dbg_texture_callbacks_t dbg_texture;  // texture create/update/destroy callbacks
+    x65_t* x65;                                // pointer to x65_t instance to track
+    ui_x65_boot_cb boot_cb;                    // reboot callback function
+    ui_x65_audio_capture_cb audio_capture_cb;  // optional audio capture start/stop callback
+    bool uart_bridged;                         // RIA UART is connected to the host, detach the console
+    ui_dbg_texture_callbacks_t dbg_texture;    // texture create/update/destroy callbacks
     ui_dbg_debug_callbacks_t dbg_debug;
     ui_dbg_keys_desc_t dbg_keys;  // user-defined hotkeys for ui_dbg_t
     ui_snapshot_desc_t snapshot;  // snapshot UI setup params
@@ -98,6 +102,8 @@ typedef struct {
     x65_t* x65;
     int dbg_scanline;
     ui_x65_boot_cb boot_cb;
+    ui_x65_audio_capture_cb audio_capture_cb;
+    bool audio_capture;
     ui_w65816_t cpu;
     ui_ria816_t ria;
     ui_tca6416a_t gpio;
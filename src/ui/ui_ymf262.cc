@@ -40,6 +40,19 @@ static void _ui_ymf262_draw_state(ui_ymf262_t* win) {
     const float cw = 28.0f;
     ImGui::Text("Bank0 Addr Latch: %04X", win->opl3->addr[0]);
     ImGui::Text("Bank1 Addr Latch: %04X", win->opl3->addr[1]);
+    ImGui::Text("Status:           %02X", win->opl3->status);
+    for (int t = 0; t < YMF262_NUM_TIMERS; t++) {
+        if (win->opl3->timer[t].expire_tick == YMF262_TIMER_STOPPED) {
+            ImGui::Text("Timer %d:          %02X stopped", t + 1, win->opl3->timer[t].value);
+        }
+        else {
+            ImGui::Text(
+                "Timer %d:          %02X overflow in %llu ticks",
+                t + 1,
+                win->opl3->timer[t].value,
+                (unsigned long long)(win->opl3->timer[t].expire_tick - win->opl3->ticks));
+        }
+    }
     if (ImGui::CollapsingHeader("Wave Generator", ImGuiTreeNodeFlags_DefaultOpen)) {
         if (ImGui::BeginTable("##opl3_channels", 19)) {
             ImGui::TableSetupColumn("", ImGuiTableColumnFlags_WidthFixed, cw0);
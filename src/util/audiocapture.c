@@ -0,0 +1,282 @@
+#include "./audiocapture.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#ifndef CHIPS_ASSERT
+    #include <assert.h>
+    #define CHIPS_ASSERT(c) assert(c)
+#endif
+
+#define _AUDIO_CAPTURE_DEFAULT(val, def) (((val) != 0) ? (val) : (def))
+
+#if defined(__EMSCRIPTEN__)
+
+audio_capture_t* audio_capture_open(const audio_capture_desc_t* desc) {
+    (void)desc;
+    return NULL;
+}
+void audio_capture_close(audio_capture_t* cap) {
+    (void)cap;
+}
+void audio_capture_push(const float* samples, int num_samples, void* user_data) {
+    (void)samples;
+    (void)num_samples;
+    (void)user_data;
+}
+chips_audio_callback_t audio_capture_callback(audio_capture_t* cap) {
+    return (chips_audio_callback_t){ .func = audio_capture_push, .user_data = cap };
+}
+audio_capture_stats_t audio_capture_stats(const audio_capture_t* cap) {
+    (void)cap;
+    return (audio_capture_stats_t){ 0 };
+}
+
+#else  // native platforms
+
+    #include <stdatomic.h>
+    #include <pthread.h>
+    #include <time.h>
+
+typedef struct {
+    int num_frames;
+    float* samples;
+} _audio_capture_block_t;
+
+struct audio_capture_t {
+    FILE* fp;
+    char* file_buf;
+    audio_capture_format_t format;
+    bool raw;
+    int sample_rate;
+    int num_channels;
+    int block_frames;
+    chips_audio_callback_t chain;
+
+    // single-producer/single-consumer ring of sample blocks
+    int num_blocks;
+    _audio_capture_block_t* blocks;
+    float* block_storage;
+    int16_t* convert_buf;
+    atomic_uint head;  // next block to be filled by producer
+    atomic_uint tail;  // next block to be written by consumer
+
+    pthread_t thread;
+    atomic_bool quit;
+
+    atomic_uint_fast64_t frames_written;
+    atomic_uint_fast64_t blocks_written;
+    atomic_uint_fast64_t blocks_dropped;
+    atomic_bool io_error;
+};
+
+static void _audio_capture_write_le16(uint8_t* p, uint16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void _audio_capture_write_le32(uint8_t* p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static int _audio_capture_bytes_per_sample(const audio_capture_t* cap) {
+    return (cap->format == AUDIO_CAPTURE_FORMAT_F32) ? 4 : 2;
+}
+
+// write the canonical 44-byte WAV header, data_size is patched on close
+static bool _audio_capture_write_wav_header(audio_capture_t* cap, uint32_t data_size) {
+    const int bps = _audio_capture_bytes_per_sample(cap);
+    uint8_t hdr[44];
+    memcpy(&hdr[0], "RIFF", 4);
+    _audio_capture_write_le32(&hdr[4], 36 + data_size);
+    memcpy(&hdr[8], "WAVE", 4);
+    memcpy(&hdr[12], "fmt ", 4);
+    _audio_capture_write_le32(&hdr[16], 16);
+    _audio_capture_write_le16(&hdr[20], (cap->format == AUDIO_CAPTURE_FORMAT_F32) ? 3 : 1);
+    _audio_capture_write_le16(&hdr[22], (uint16_t)cap->num_channels);
+    _audio_capture_write_le32(&hdr[24], (uint32_t)cap->sample_rate);
+    _audio_capture_write_le32(&hdr[28], (uint32_t)(cap->sample_rate * cap->num_channels * bps));
+    _audio_capture_write_le16(&hdr[32], (uint16_t)(cap->num_channels * bps));
+    _audio_capture_write_le16(&hdr[34], (uint16_t)(bps * 8));
+    memcpy(&hdr[36], "data", 4);
+    _audio_capture_write_le32(&hdr[40], data_size);
+    return fwrite(hdr, sizeof(hdr), 1, cap->fp) == 1;
+}
+
+static void _audio_capture_write_block(audio_capture_t* cap, const _audio_capture_block_t* blk) {
+    const size_t num_samples = (size_t)blk->num_frames * (size_t)cap->num_channels;
+    size_t written;
+    if (cap->format == AUDIO_CAPTURE_FORMAT_F32) {
+        written = fwrite(blk->samples, sizeof(float), num_samples, cap->fp);
+    }
+    else {
+        for (size_t i = 0; i < num_samples; i++) {
+            float s = blk->samples[i];
+            s = (s > 1.0f) ? 1.0f : ((s < -1.0f) ? -1.0f : s);
+            cap->convert_buf[i] = (int16_t)(s * 32767.0f);
+        }
+        written = fwrite(cap->convert_buf, sizeof(int16_t), num_samples, cap->fp);
+    }
+    if (written != num_samples) {
+        atomic_store(&cap->io_error, true);
+    }
+    atomic_fetch_add(&cap->frames_written, (uint_fast64_t)blk->num_frames);
+    atomic_fetch_add(&cap->blocks_written, 1);
+}
+
+// drain the ring buffer, returns number of blocks written
+static int _audio_capture_drain(audio_capture_t* cap) {
+    int num_written = 0;
+    unsigned tail = atomic_load_explicit(&cap->tail, memory_order_relaxed);
+    const unsigned head = atomic_load_explicit(&cap->head, memory_order_acquire);
+    while (tail != head) {
+        _audio_capture_write_block(cap, &cap->blocks[tail % (unsigned)cap->num_blocks]);
+        tail++;
+        atomic_store_explicit(&cap->tail, tail, memory_order_release);
+        num_written++;
+    }
+    return num_written;
+}
+
+static void* _audio_capture_thread(void* arg) {
+    audio_capture_t* cap = (audio_capture_t*)arg;
+    while (!atomic_load(&cap->quit)) {
+        if (_audio_capture_drain(cap) == 0) {
+            // nothing to do, the producer must never wait on us, so just poll
+            const struct timespec ts = { .tv_sec = 0, .tv_nsec = 2 * 1000 * 1000 };
+            nanosleep(&ts, NULL);
+        }
+    }
+    _audio_capture_drain(cap);
+    return NULL;
+}
+
+static void _audio_capture_free(audio_capture_t* cap) {
+    if (cap->fp) {
+        fclose(cap->fp);
+    }
+    free(cap->file_buf);
+    free(cap->blocks);
+    free(cap->block_storage);
+    free(cap->convert_buf);
+    free(cap);
+}
+
+audio_capture_t* audio_capture_open(const audio_capture_desc_t* desc) {
+    CHIPS_ASSERT(desc && desc->path);
+    CHIPS_ASSERT(desc->sample_rate > 0);
+    audio_capture_t* cap = (audio_capture_t*)calloc(1, sizeof(audio_capture_t));
+    if (!cap) {
+        return NULL;
+    }
+    cap->format = desc->format;
+    cap->raw = desc->raw;
+    cap->sample_rate = desc->sample_rate;
+    cap->num_channels = _AUDIO_CAPTURE_DEFAULT(desc->num_channels, 1);
+    cap->num_blocks = _AUDIO_CAPTURE_DEFAULT(desc->num_blocks, AUDIO_CAPTURE_DEFAULT_BLOCKS);
+    cap->block_frames = _AUDIO_CAPTURE_DEFAULT(desc->block_frames, AUDIO_CAPTURE_DEFAULT_BLOCK_FRAMES);
+    cap->chain = desc->chain;
+    atomic_init(&cap->head, 0);
+    atomic_init(&cap->tail, 0);
+    atomic_init(&cap->quit, false);
+    atomic_init(&cap->frames_written, 0);
+    atomic_init(&cap->blocks_written, 0);
+    atomic_init(&cap->blocks_dropped, 0);
+    atomic_init(&cap->io_error, false);
+
+    const size_t block_samples = (size_t)cap->block_frames * (size_t)cap->num_channels;
+    cap->blocks = (_audio_capture_block_t*)calloc((size_t)cap->num_blocks, sizeof(_audio_capture_block_t));
+    cap->block_storage = (float*)malloc((size_t)cap->num_blocks * block_samples * sizeof(float));
+    cap->convert_buf = (int16_t*)malloc(block_samples * sizeof(int16_t));
+    cap->file_buf = (char*)malloc(AUDIO_CAPTURE_FILE_BUFFER_SIZE);
+    if (!cap->blocks || !cap->block_storage || !cap->convert_buf || !cap->file_buf) {
+        _audio_capture_free(cap);
+        return NULL;
+    }
+    for (int i = 0; i < cap->num_blocks; i++) {
+        cap->blocks[i].samples = cap->block_storage + (size_t)i * block_samples;
+    }
+
+    cap->fp = fopen(desc->path, "wb");
+    if (!cap->fp) {
+        _audio_capture_free(cap);
+        return NULL;
+    }
+    setvbuf(cap->fp, cap->file_buf, _IOFBF, AUDIO_CAPTURE_FILE_BUFFER_SIZE);
+    if (!cap->raw && !_audio_capture_write_wav_header(cap, 0)) {
+        _audio_capture_free(cap);
+        return NULL;
+    }
+    if (0 != pthread_create(&cap->thread, NULL, _audio_capture_thread, cap)) {
+        _audio_capture_free(cap);
+        return NULL;
+    }
+    return cap;
+}
+
+void audio_capture_close(audio_capture_t* cap) {
+    if (!cap) {
+        return;
+    }
+    atomic_store(&cap->quit, true);
+    pthread_join(cap->thread, NULL);
+    if (!cap->raw) {
+        // patch RIFF and data chunk sizes
+        const uint64_t data_size = atomic_load(&cap->frames_written) * (uint64_t)cap->num_channels
+                                   * (uint64_t)_audio_capture_bytes_per_sample(cap);
+        if (0 == fseek(cap->fp, 0, SEEK_SET)) {
+            _audio_capture_write_wav_header(cap, data_size > 0xFFFFFFD0 ? 0xFFFFFFD0 : (uint32_t)data_size);
+        }
+    }
+    _audio_capture_free(cap);
+}
+
+void audio_capture_push(const float* samples, int num_samples, void* user_data) {
+    audio_capture_t* cap = (audio_capture_t*)user_data;
+    CHIPS_ASSERT(cap && samples);
+    int frames_left = num_samples;
+    const float* src = samples;
+    while (frames_left > 0) {
+        const int num_frames = frames_left < cap->block_frames ? frames_left : cap->block_frames;
+        const unsigned head = atomic_load_explicit(&cap->head, memory_order_relaxed);
+        const unsigned tail = atomic_load_explicit(&cap->tail, memory_order_acquire);
+        if ((head - tail) >= (unsigned)cap->num_blocks) {
+            // writer thread fell behind, drop the block instead of waiting
+            atomic_fetch_add(&cap->blocks_dropped, 1);
+        }
+        else {
+            _audio_capture_block_t* blk = &cap->blocks[head % (unsigned)cap->num_blocks];
+            memcpy(blk->samples, src, (size_t)num_frames * (size_t)cap->num_channels * sizeof(float));
+            blk->num_frames = num_frames;
+            atomic_store_explicit(&cap->head, head + 1, memory_order_release);
+        }
+        src += num_frames * cap->num_channels;
+        frames_left -= num_frames;
+    }
+    if (cap->chain.func) {
+        cap->chain.func(samples, num_samples, cap->chain.user_data);
+    }
+}
+
+chips_audio_callback_t audio_capture_callback(audio_capture_t* cap) {
+    CHIPS_ASSERT(cap);
+    return (chips_audio_callback_t){ .func = audio_capture_push, .user_data = cap };
+}
+
+audio_capture_stats_t audio_capture_stats(const audio_capture_t* cap) {
+    if (!cap) {
+        return (audio_capture_stats_t){ 0 };
+    }
+    audio_capture_t* c = (audio_capture_t*)cap;
+    return (audio_capture_stats_t){
+        .frames_written = atomic_load(&c->frames_written),
+        .blocks_written = atomic_load(&c->blocks_written),
+        .blocks_dropped = atomic_load(&c->blocks_dropped),
+        .io_error = atomic_load(&c->io_error),
+    };
+}
+
+#endif
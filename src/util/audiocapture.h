@@ -0,0 +1,81 @@
+#pragma once
+/*
+    audiocapture.h -- stream emulator audio output to a WAV or raw PCM file
+
+    The capture sink has the same signature as chips_audio_callback_t, so it
+    can be plugged directly into a system's audio output, optionally chained
+    to the regular audio playback callback:
+
+    ~~~C
+    audio_capture_t* cap = audio_capture_open(&(audio_capture_desc_t){
+        .path = "out.wav",
+        .format = AUDIO_CAPTURE_FORMAT_S16,
+        .sample_rate = 44100,
+        .num_channels = 2,
+        .chain = { .func = push_audio },
+    });
+    desc.audio.callback = audio_capture_callback(cap);
+    ...
+    audio_capture_close(cap);
+    ~~~
+
+    Sample blocks are copied into a lock-free ring buffer and written to disk
+    by a background thread, so audio_capture_push() never blocks the emulation.
+    If the writer thread falls behind and the ring buffer is full, the block is
+    dropped and counted in audio_capture_stats().
+
+    Not available on the web platform (no threads), audio_capture_open()
+    returns NULL there.
+*/
+#include "chips/chips_common.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AUDIO_CAPTURE_DEFAULT_BLOCKS       (1024)  // number of blocks in ring buffer
+#define AUDIO_CAPTURE_DEFAULT_BLOCK_FRAMES (1024)  // max number of sample frames in a block
+#define AUDIO_CAPTURE_FILE_BUFFER_SIZE     (1 << 20)
+
+typedef enum {
+    AUDIO_CAPTURE_FORMAT_S16,  // 16-bit signed integer PCM
+    AUDIO_CAPTURE_FORMAT_F32,  // 32-bit IEEE float PCM
+} audio_capture_format_t;
+
+typedef struct {
+    const char* path;               // output file path
+    audio_capture_format_t format;  // sample format in file
+    bool raw;                       // write headerless raw PCM instead of WAV
+    int sample_rate;                // sample rate in Hz
+    int num_channels;               // number of interleaved channels (default 1)
+    int num_blocks;                 // ring buffer size in blocks (default AUDIO_CAPTURE_DEFAULT_BLOCKS)
+    int block_frames;               // max frames per block (default AUDIO_CAPTURE_DEFAULT_BLOCK_FRAMES)
+    chips_audio_callback_t chain;   // optional callback to forward samples to
+} audio_capture_desc_t;
+
+typedef struct {
+    uint64_t frames_written;  // sample frames written to file
+    uint64_t blocks_written;  // number of blocks written to file
+    uint64_t blocks_dropped;  // number of blocks dropped because writer fell behind
+    bool io_error;            // writing to file failed
+} audio_capture_stats_t;
+
+typedef struct audio_capture_t audio_capture_t;
+
+// open output file and start the writer thread, returns NULL on failure
+audio_capture_t* audio_capture_open(const audio_capture_desc_t* desc);
+// flush pending blocks, finalize file header and free the capture
+void audio_capture_close(audio_capture_t* cap);
+// audio sink, user_data is the audio_capture_t*, never blocks
+void audio_capture_push(const float* samples, int num_samples, void* user_data);
+// get a chips_audio_callback_t pointing to the capture sink
+chips_audio_callback_t audio_capture_callback(audio_capture_t* cap);
+// get capture statistics
+audio_capture_stats_t audio_capture_stats(const audio_capture_t* cap);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
@@ -0,0 +1,317 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+    #define _GNU_SOURCE  // memfd_create()
+#endif
+#include "./guestmem.h"
+
+#include <stdlib.h>
+#include <string.h>
+#ifndef CHIPS_ASSERT
+    #include <assert.h>
+    #define CHIPS_ASSERT(c) assert(c)
+#endif
+
+#if defined(_WIN32)
+    #include <windows.h>
+#elif !defined(__EMSCRIPTEN__)
+    #include <unistd.h>
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #define _GUESTMEM_USE_MMAP
+    #if defined(__linux__)
+        #define _GUESTMEM_USE_MEMFD
+    #endif
+    #if !defined(MAP_ANONYMOUS)
+        #define MAP_ANONYMOUS MAP_ANON
+    #endif
+#endif
+
+#define _GUESTMEM_PAGE_SIZE (4096)
+
+static bool _guestmem_page_used(const uint8_t* ptr, size_t len) {
+    if (len < _GUESTMEM_PAGE_SIZE) {
+        return true;
+    }
+    const uint64_t* p = (const uint64_t*)ptr;
+    for (size_t i = 0; i < _GUESTMEM_PAGE_SIZE / sizeof(uint64_t); i++) {
+        if (p[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+#define _GUESTMEM_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+// demand-zero pages, nothing is committed until a page is written (huge pages on Windows are committed right away)
+static uint8_t* _guestmem_map_zero(uint8_t* addr, size_t size, guestmem_pages_t pages) {
+    #if defined(_WIN32)
+    DWORD type = addr ? MEM_COMMIT : (MEM_RESERVE | MEM_COMMIT);
+    if (pages == GUESTMEM_PAGES_HUGE) {
+        type |= MEM_LARGE_PAGES;
+    }
+    return (uint8_t*)VirtualAlloc(addr, size, type, PAGE_READWRITE);
+    #elif defined(_GUESTMEM_USE_MMAP)
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | (addr ? MAP_FIXED : 0);
+    #if defined(__linux__)
+    if (pages == GUESTMEM_PAGES_HUGE) {
+        flags |= MAP_HUGETLB;
+    }
+    else if ((pages == GUESTMEM_PAGES_TRANSPARENT_HUGE) && !addr) {
+        // over-allocate to get a huge page aligned range, the kernel only backs aligned 2 MB ranges with huge pages
+        uint8_t* ptr = (uint8_t*)mmap(0, size + _GUESTMEM_HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, flags, -1, 0);
+        if (ptr == (uint8_t*)MAP_FAILED) {
+            return 0;
+        }
+        const size_t misalign = (uintptr_t)ptr & (_GUESTMEM_HUGE_PAGE_SIZE - 1);
+        const size_t head = misalign ? (_GUESTMEM_HUGE_PAGE_SIZE - misalign) : 0;
+        if (head) {
+            munmap(ptr, head);
+        }
+        munmap(ptr + head + size, _GUESTMEM_HUGE_PAGE_SIZE - head);
+        ptr += head;
+        if (madvise(ptr, size, MADV_HUGEPAGE) != 0) {
+            munmap(ptr, size);
+            return 0;
+        }
+        return ptr;
+    }
+    #endif
+    void* ptr = mmap(addr, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (ptr == MAP_FAILED) {
+        return 0;
+    }
+    #if defined(__linux__)
+    if (pages == GUESTMEM_PAGES_TRANSPARENT_HUGE) {
+        madvise(ptr, size, MADV_HUGEPAGE);
+    }
+    #endif
+    return (uint8_t*)ptr;
+    #else
+    (void)addr;
+    (void)pages;
+    return (uint8_t*)calloc(1, size);
+    #endif
+}
+
+#if defined(_GUESTMEM_USE_MEMFD)
+static int _guestmem_create_file(size_t size) {
+    const int fd = memfd_create("guestmem", MFD_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    // the file is sparse, unwritten pages read as zero
+    if (ftruncate(fd, (off_t)size) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* True if mem is a private mapping of its memory file without pages of
+   its own, the file then holds its contents. Pages written since the
+   mapping was made are anonymous copies, which /proc/self/pagemap tells
+   apart: present without the file-page bit (61), or swapped (62).
+*/
+static bool _guestmem_file_is_current(const guestmem_t* mem) {
+    if (mem->kind != GUESTMEM_KIND_COW) {
+        return false;
+    }
+    const int fd = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    bool current = true;
+    uint64_t entries[512];
+    const size_t num_pages = (mem->size + _GUESTMEM_PAGE_SIZE - 1) / _GUESTMEM_PAGE_SIZE;
+    const off_t first = (off_t)(((uintptr_t)mem->ptr / _GUESTMEM_PAGE_SIZE) * sizeof(uint64_t));
+    for (size_t i = 0; current && (i < num_pages); i += 512) {
+        const size_t n = (num_pages - i) < 512 ? (num_pages - i) : 512;
+        const ssize_t len = (ssize_t)(n * sizeof(uint64_t));
+        if (pread(fd, entries, (size_t)len, first + (off_t)(i * sizeof(uint64_t))) != len) {
+            current = false;
+            break;
+        }
+        for (size_t j = 0; j < n; j++) {
+            const uint64_t e = entries[j];
+            if ((e & (1ULL << 62)) || ((e & (1ULL << 63)) && !(e & (1ULL << 61)))) {
+                current = false;
+                break;
+            }
+        }
+    }
+    close(fd);
+    return current;
+}
+
+// move the contents into a new memory file and map it privately in place, the file doesn't change afterwards
+static bool _guestmem_move_to_file(guestmem_t* mem) {
+    const int fd = _guestmem_create_file(mem->size);
+    if (fd < 0) {
+        return false;
+    }
+    for (size_t offset = 0; offset < mem->size; offset += _GUESTMEM_PAGE_SIZE) {
+        const size_t len = (mem->size - offset) < _GUESTMEM_PAGE_SIZE ? (mem->size - offset) : _GUESTMEM_PAGE_SIZE;
+        if (_guestmem_page_used(mem->ptr + offset, len)) {
+            if (pwrite(fd, mem->ptr + offset, len, (off_t)offset) != (ssize_t)len) {
+                close(fd);
+                return false;
+            }
+        }
+    }
+    void* ptr = mmap(mem->ptr, mem->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0);
+    if (ptr == MAP_FAILED) {
+        // the old mapping is gone if MAP_FIXED failed half-way, nothing sensible left to do
+        close(fd);
+        CHIPS_ASSERT(false);
+        return false;
+    }
+    if (mem->fd >= 0) {
+        close(mem->fd);
+    }
+    mem->fd = fd;
+    mem->kind = GUESTMEM_KIND_COW;
+    mem->pages = GUESTMEM_PAGES_NORMAL;
+    return true;
+}
+#endif
+
+static bool _guestmem_alloc(guestmem_t* mem, size_t size, guestmem_pages_t pages) {
+    CHIPS_ASSERT(mem && (size > 0));
+    memset(mem, 0, sizeof(*mem));
+    mem->fd = -1;
+    mem->size = size;
+    mem->pages = pages;
+    mem->ptr = _guestmem_map_zero(0, size, pages);
+    #if defined(_WIN32) || defined(_GUESTMEM_USE_MMAP)
+    mem->kind = GUESTMEM_KIND_MAPPED;
+    #else
+    mem->kind = GUESTMEM_KIND_HEAP;
+    #endif
+    return mem->ptr != 0;
+}
+
+bool guestmem_alloc(guestmem_t* mem, size_t size) {
+    return _guestmem_alloc(mem, size, GUESTMEM_PAGES_NORMAL);
+}
+
+bool guestmem_alloc_huge(guestmem_t* mem, size_t size) {
+    CHIPS_ASSERT(mem && (size > 0));
+    #if defined(_WIN32)
+    // needs the "Lock pages in memory" privilege
+    const size_t large_page_size = GetLargePageMinimum();
+    if (large_page_size && ((size % large_page_size) == 0) && _guestmem_alloc(mem, size, GUESTMEM_PAGES_HUGE)) {
+        return true;
+    }
+    #elif defined(__linux__)
+    // reserved pages from /proc/sys/vm/nr_hugepages first, then transparent huge pages
+    if (((size % _GUESTMEM_HUGE_PAGE_SIZE) == 0) && _guestmem_alloc(mem, size, GUESTMEM_PAGES_HUGE)) {
+        return true;
+    }
+    if (_guestmem_alloc(mem, size, GUESTMEM_PAGES_TRANSPARENT_HUGE)) {
+        return true;
+    }
+    #endif
+    return guestmem_alloc(mem, size);
+}
+
+void guestmem_free(guestmem_t* mem) {
+    CHIPS_ASSERT(mem);
+    if (mem->ptr) {
+        #if defined(_WIN32)
+        VirtualFree(mem->ptr, 0, MEM_RELEASE);
+        #elif defined(_GUESTMEM_USE_MMAP)
+        munmap(mem->ptr, mem->size);
+        if (mem->fd >= 0) {
+            close(mem->fd);
+        }
+        #else
+        free(mem->ptr);
+        #endif
+    }
+    memset(mem, 0, sizeof(*mem));
+    mem->fd = -1;
+}
+
+void guestmem_clear(guestmem_t* mem) {
+    CHIPS_ASSERT(mem && mem->ptr);
+    switch (mem->kind) {
+        #if defined(_WIN32)
+        case GUESTMEM_KIND_MAPPED:
+            // decommitted pages come back zeroed, large pages can't be decommitted
+            if (mem->pages != GUESTMEM_PAGES_HUGE) {
+                VirtualFree(mem->ptr, mem->size, MEM_DECOMMIT);
+                if (_guestmem_map_zero(mem->ptr, mem->size, mem->pages)) {
+                    return;
+                }
+            }
+            break;
+        #elif defined(_GUESTMEM_USE_MMAP)
+        case GUESTMEM_KIND_MAPPED:
+            #if defined(__linux__)
+            // private anonymous pages read as zero again after MADV_DONTNEED
+            if (madvise(mem->ptr, mem->size, MADV_DONTNEED) == 0) {
+                return;
+            }
+            #endif
+            if (_guestmem_map_zero(mem->ptr, mem->size, mem->pages)) {
+                return;
+            }
+            break;
+        #endif
+        #if defined(_GUESTMEM_USE_MEMFD)
+        case GUESTMEM_KIND_COW:
+            // detach from the memory file, the private pages go with the old mapping
+            if (_guestmem_map_zero(mem->ptr, mem->size, GUESTMEM_PAGES_NORMAL)) {
+                close(mem->fd);
+                mem->fd = -1;
+                mem->kind = GUESTMEM_KIND_MAPPED;
+                return;
+            }
+            break;
+        #endif
+        default: break;
+    }
+    memset(mem->ptr, 0, mem->size);
+}
+
+bool guestmem_fork_is_cheap(const guestmem_t* mem) {
+    CHIPS_ASSERT(mem);
+    #if defined(_GUESTMEM_USE_MEMFD)
+    return _guestmem_file_is_current(mem);
+    #else
+    return false;
+    #endif
+}
+
+bool guestmem_fork(guestmem_t* mem, guestmem_t* child) {
+    CHIPS_ASSERT(mem && mem->ptr && child && (mem != child));
+    #if defined(_GUESTMEM_USE_MEMFD)
+    memset(child, 0, sizeof(*child));
+    child->fd = -1;
+    child->size = mem->size;
+    if (_guestmem_file_is_current(mem) || _guestmem_move_to_file(mem)) {
+        const int fd = dup(mem->fd);
+        if (fd >= 0) {
+            void* ptr = mmap(NULL, mem->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+            if (ptr != MAP_FAILED) {
+                child->ptr = (uint8_t*)ptr;
+                child->fd = fd;
+                child->kind = GUESTMEM_KIND_COW;
+                return true;
+            }
+            close(fd);
+        }
+    }
+    #endif
+    // copy only the pages in use, the others stay uncommitted in the child
+    if (!guestmem_alloc(child, mem->size)) {
+        return false;
+    }
+    for (size_t offset = 0; offset < mem->size; offset += _GUESTMEM_PAGE_SIZE) {
+        const size_t len = (mem->size - offset) < _GUESTMEM_PAGE_SIZE ? (mem->size - offset) : _GUESTMEM_PAGE_SIZE;
+        if (_guestmem_page_used(mem->ptr + offset, len)) {
+            memcpy(child->ptr + offset, mem->ptr + offset, len);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,83 @@
+#pragma once
+/*
+    guestmem.h -- lazily committed guest RAM with cheap copy-on-write forks
+
+    Memory comes from anonymous page mappings (VirtualAlloc on Windows),
+    so pages only take physical memory once they are written, and reading
+    untouched pages is free. guestmem_clear() hands all pages back to the
+    OS instead of writing zeros.
+
+    On Linux the first guestmem_fork() moves the contents into an
+    anonymous memory file (memfd), writing only the pages in use, and maps
+    it privately in place. Children map the same file privately, so pages
+    are only duplicated when one side writes them, and the file itself
+    never changes: the memory that was forked and its children can be
+    written, cleared and freed independently. Forking again costs a few
+    syscalls as long as the memory wasn't written since, otherwise its
+    contents first move into a new memory file.
+
+    On other platforms forks are copies of the pages in use. On the web
+    platform the memory is a plain heap allocation.
+
+    guestmem_alloc_huge() backs the memory with 2 MB pages to save TLB
+    misses on scattered accesses. It tries reserved huge pages first
+    (MAP_HUGETLB, or MEM_LARGE_PAGES on Windows), then transparent huge
+    pages (MADV_HUGEPAGE), and falls back to normal pages. Huge pages are
+    committed 2 MB at a time, and forks use normal pages.
+
+    ~~~C
+    guestmem_t ram, child;
+    guestmem_alloc(&ram, 1 << 24);
+    ...
+    if (guestmem_fork(&ram, &child)) {
+        child.ptr[0x1000] = 0xEA;  // ram.ptr[0x1000] is unchanged, and the other way round
+        ...
+        guestmem_free(&child);
+    }
+    guestmem_free(&ram);
+    ~~~
+*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    GUESTMEM_KIND_HEAP,    // calloc'ed
+    GUESTMEM_KIND_MAPPED,  // anonymous demand-zero pages
+    GUESTMEM_KIND_COW,     // private copy-on-write mapping of fd, the file doesn't change
+} guestmem_kind_t;
+
+typedef enum {
+    GUESTMEM_PAGES_NORMAL,
+    GUESTMEM_PAGES_TRANSPARENT_HUGE,  // advised to use huge pages, the kernel may not
+    GUESTMEM_PAGES_HUGE,              // reserved huge pages
+} guestmem_pages_t;
+
+typedef struct {
+    uint8_t* ptr;
+    size_t size;
+    guestmem_kind_t kind;
+    guestmem_pages_t pages;
+    int fd;  // backing memory file, -1 if none
+} guestmem_t;
+
+// allocate size bytes of zeroed memory, false if out of memory
+bool guestmem_alloc(guestmem_t* mem, size_t size);
+// like guestmem_alloc() but on huge pages where available, see pages for what was used
+bool guestmem_alloc_huge(guestmem_t* mem, size_t size);
+// release the memory
+void guestmem_free(guestmem_t* mem);
+// zero the memory by releasing its pages, ptr stays the same
+void guestmem_clear(guestmem_t* mem);
+// initialize child with a copy of mem, false if out of memory
+bool guestmem_fork(guestmem_t* mem, guestmem_t* child);
+// true if guestmem_fork() of mem only creates a mapping
+bool guestmem_fork_is_cheap(const guestmem_t* mem);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
@@ -0,0 +1,506 @@
+#include "./hostfs.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#ifndef CHIPS_ASSERT
+    #include <assert.h>
+    #define CHIPS_ASSERT(c) assert(c)
+#endif
+
+#if defined(__EMSCRIPTEN__)
+
+hostfs_t* hostfs_create(const char* root) {
+    (void)root;
+    return NULL;
+}
+void hostfs_destroy(hostfs_t* fs) {
+    (void)fs;
+}
+void hostfs_close_all(hostfs_t* fs) {
+    (void)fs;
+}
+int hostfs_open(hostfs_t* fs, const char* path, int flags) {
+    (void)fs;
+    (void)path;
+    (void)flags;
+    errno = ENOSYS;
+    return -1;
+}
+int hostfs_close(hostfs_t* fs, int fd) {
+    (void)fs;
+    (void)fd;
+    errno = EBADF;
+    return -1;
+}
+int32_t hostfs_read(hostfs_t* fs, int fd, void* dst, uint32_t count) {
+    (void)fs;
+    (void)fd;
+    (void)dst;
+    (void)count;
+    errno = EBADF;
+    return -1;
+}
+int32_t hostfs_write(hostfs_t* fs, int fd, const void* src, uint32_t count) {
+    (void)fs;
+    (void)fd;
+    (void)src;
+    (void)count;
+    errno = EBADF;
+    return -1;
+}
+int64_t hostfs_lseek(hostfs_t* fs, int fd, int64_t offset, int whence) {
+    (void)fs;
+    (void)fd;
+    (void)offset;
+    (void)whence;
+    errno = EBADF;
+    return -1;
+}
+void hostfs_begin_speculation(hostfs_t* fs) {
+    (void)fs;
+}
+void hostfs_end_speculation(hostfs_t* fs) {
+    (void)fs;
+}
+
+#else  // native platforms
+
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/stat.h>
+    #if !defined(_WIN32)
+        #include <sys/mman.h>
+        #define _HOSTFS_USE_MMAP
+        #define _HOSTFS_USE_ROOT_FD
+    #endif
+    #if defined(__linux__) && __has_include(<linux/openat2.h>)
+        #include <linux/openat2.h>
+        #include <sys/syscall.h>
+        #if defined(SYS_openat2)
+            #define _HOSTFS_USE_OPENAT2
+        #endif
+    #endif
+    #ifndef O_CLOEXEC
+        #define O_CLOEXEC (0)
+    #endif
+    #ifndef O_BINARY
+        #define O_BINARY (0)
+    #endif
+
+    #define _HOSTFS_MAX_PATH (4096)
+
+typedef struct {
+    bool used;
+    int host_fd;         // -1 for mapped files
+    const uint8_t* map;  // mapped file contents (read-only files)
+    uint64_t size;       // size of mapped file
+    uint64_t pos;        // read position in mapped file
+    bool speculative;    // opened while speculating
+} _hostfs_file_t;
+
+struct hostfs_t {
+    char* root;
+    int root_fd;  // directory the guest paths are opened beneath
+    _hostfs_file_t files[HOSTFS_MAX_FILES];
+    // file table and host file offsets when the speculation began
+    bool speculating;
+    _hostfs_file_t saved_files[HOSTFS_MAX_FILES];
+    off_t saved_offsets[HOSTFS_MAX_FILES];
+};
+
+hostfs_t* hostfs_create(const char* root) {
+    CHIPS_ASSERT(root);
+    struct stat st;
+    if (stat(root, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        return NULL;
+    }
+    hostfs_t* fs = (hostfs_t*)calloc(1, sizeof(hostfs_t));
+    if (!fs) {
+        return NULL;
+    }
+    fs->root = strdup(root);
+    if (!fs->root) {
+        free(fs);
+        return NULL;
+    }
+    // strip trailing path separators, except for the filesystem root itself
+    size_t len = strlen(fs->root);
+    while (len > 1 && fs->root[len - 1] == '/') {
+        fs->root[--len] = 0;
+    }
+    fs->root_fd = -1;
+    #if defined(_HOSTFS_USE_ROOT_FD)
+    fs->root_fd = open(fs->root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fs->root_fd < 0) {
+        free(fs->root);
+        free(fs);
+        return NULL;
+    }
+    #endif
+    return fs;
+}
+
+void hostfs_destroy(hostfs_t* fs) {
+    if (!fs) {
+        return;
+    }
+    hostfs_end_speculation(fs);
+    hostfs_close_all(fs);
+    if (fs->root_fd >= 0) {
+        close(fs->root_fd);
+    }
+    free(fs->root);
+    free(fs);
+}
+
+static _hostfs_file_t* _hostfs_file(hostfs_t* fs, int fd) {
+    CHIPS_ASSERT(fs);
+    const int idx = fd - HOSTFS_FIRST_FD;
+    if (idx < 0 || idx >= HOSTFS_MAX_FILES || !fs->files[idx].used) {
+        errno = EBADF;
+        return NULL;
+    }
+    return &fs->files[idx];
+}
+
+static void _hostfs_release(_hostfs_file_t* f) {
+    #if defined(_HOSTFS_USE_MMAP)
+    if (f->map) {
+        munmap((void*)f->map, (size_t)f->size);
+    }
+    #endif
+    if (f->host_fd >= 0) {
+        close(f->host_fd);
+    }
+    memset(f, 0, sizeof(*f));
+}
+
+// files which were open when the speculation began stay open on the host
+static void _hostfs_close_file(hostfs_t* fs, _hostfs_file_t* f) {
+    if (fs->speculating && !f->speculative) {
+        f->used = false;
+    }
+    else {
+        _hostfs_release(f);
+    }
+}
+
+void hostfs_close_all(hostfs_t* fs) {
+    if (!fs) {
+        return;
+    }
+    for (int i = 0; i < HOSTFS_MAX_FILES; i++) {
+        if (fs->files[i].used) {
+            _hostfs_close_file(fs, &fs->files[i]);
+        }
+    }
+}
+
+/* Check a guest path, returns it relative to the root directory, or NULL
+   if it has ".." components or backslashes.
+*/
+static const char* _hostfs_rel_path(const char* path) {
+    while (*path == '/') {
+        path++;
+    }
+    const char* p = path;
+    while (*p) {
+        const char* sep = strchr(p, '/');
+        const size_t len = sep ? (size_t)(sep - p) : strlen(p);
+        if (len == 2 && p[0] == '.' && p[1] == '.') {
+            errno = EACCES;
+            return NULL;
+        }
+        if (memchr(p, '\\', len)) {
+            // not a separator on POSIX, but one on Windows hosts
+            errno = EACCES;
+            return NULL;
+        }
+        p += len;
+        while (*p == '/') {
+            p++;
+        }
+    }
+    return *path ? path : ".";
+}
+
+    #if defined(_HOSTFS_USE_ROOT_FD)
+/* Open a path relative to the root directory without leaving it.
+
+   Symbolic links must not lead out of the root either. openat2() resolves
+   the whole path beneath the root directory, so links inside it work.
+   Where it is not available (older kernels, other systems) every component
+   is opened with O_NOFOLLOW instead, and no links are followed at all.
+*/
+static int _hostfs_open_beneath(const hostfs_t* fs, const char* rel, int oflags) {
+        #if defined(_HOSTFS_USE_OPENAT2)
+    struct open_how how = {
+        .flags = (uint64_t)(oflags | O_CLOEXEC),
+        .mode = (oflags & O_CREAT) ? 0644 : 0,
+        .resolve = RESOLVE_BENEATH | RESOLVE_NO_MAGICLINKS,
+    };
+    const int beneath_fd = (int)syscall(SYS_openat2, fs->root_fd, rel, &how, sizeof(how));
+    // sandboxes may refuse unknown syscalls with EPERM
+    if (beneath_fd >= 0 || (errno != ENOSYS && errno != EPERM)) {
+        return beneath_fd;
+    }
+        #endif
+    char buf[_HOSTFS_MAX_PATH];
+    const size_t len = strlen(rel);
+    if (len >= sizeof(buf)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    memcpy(buf, rel, len + 1);
+    int dir_fd = fs->root_fd;
+    char* name = buf;
+    char* sep;
+    while ((sep = strchr(name, '/')) != NULL) {
+        *sep = 0;
+        const int next_fd = openat(dir_fd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (dir_fd != fs->root_fd) {
+            close(dir_fd);
+        }
+        if (next_fd < 0) {
+            return -1;
+        }
+        dir_fd = next_fd;
+        name = sep + 1;
+        while (*name == '/') {
+            name++;
+        }
+    }
+    const int fd = openat(dir_fd, *name ? name : ".", oflags | O_NOFOLLOW | O_CLOEXEC, 0644);
+    if (dir_fd != fs->root_fd) {
+        const int err = errno;
+        close(dir_fd);
+        errno = err;
+    }
+    return fd;
+}
+    #endif
+
+int hostfs_open(hostfs_t* fs, const char* path, int flags) {
+    CHIPS_ASSERT(fs && path);
+    int idx = 0;
+    while (idx < HOSTFS_MAX_FILES && fs->files[idx].used) {
+        idx++;
+    }
+    if (idx == HOSTFS_MAX_FILES) {
+        errno = EMFILE;
+        return -1;
+    }
+    int oflags = O_BINARY;
+    switch (flags & HOSTFS_O_RDWR) {
+        case HOSTFS_O_RDONLY: oflags |= O_RDONLY; break;
+        case HOSTFS_O_WRONLY: oflags |= O_WRONLY; break;
+        case HOSTFS_O_RDWR: oflags |= O_RDWR; break;
+        default: errno = EINVAL; return -1;
+    }
+    if (fs->speculating && ((flags & HOSTFS_O_RDWR) != HOSTFS_O_RDONLY)) {
+        errno = EAGAIN;
+        return -1;
+    }
+    if (flags & HOSTFS_O_CREAT) oflags |= O_CREAT;
+    if (flags & HOSTFS_O_TRUNC) oflags |= O_TRUNC;
+    if (flags & HOSTFS_O_APPEND) oflags |= O_APPEND;
+    if (flags & HOSTFS_O_EXCL) oflags |= O_EXCL;
+
+    const char* rel_path = _hostfs_rel_path(path);
+    if (!rel_path) {
+        return -1;
+    }
+    #if defined(_HOSTFS_USE_ROOT_FD)
+    const int host_fd = _hostfs_open_beneath(fs, rel_path, oflags);
+    #else
+    char host_path[_HOSTFS_MAX_PATH];
+    const int n = snprintf(host_path, sizeof(host_path), "%s/%s", fs->root, rel_path);
+    if (n < 0 || (size_t)n >= sizeof(host_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    const int host_fd = open(host_path, oflags, 0644);
+    #endif
+    if (host_fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(host_fd, &st) != 0) {
+        close(host_fd);
+        return -1;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        close(host_fd);
+        errno = S_ISDIR(st.st_mode) ? EISDIR : EACCES;
+        return -1;
+    }
+
+    _hostfs_file_t* f = &fs->files[idx];
+    memset(f, 0, sizeof(*f));
+    f->used = true;
+    f->host_fd = host_fd;
+    f->speculative = fs->speculating;
+    #if defined(_HOSTFS_USE_MMAP)
+    if ((flags & HOSTFS_O_RDWR) == HOSTFS_O_RDONLY) {
+        // read-only files are served from a private mapping, the descriptor is not needed anymore
+        f->size = (uint64_t)st.st_size;
+        if (f->size > 0) {
+            void* map = mmap(NULL, (size_t)f->size, PROT_READ, MAP_PRIVATE, host_fd, 0);
+            if (map == MAP_FAILED) {
+                const int err = errno;
+                close(host_fd);
+                memset(f, 0, sizeof(*f));
+                errno = err;
+                return -1;
+            }
+            f->map = (const uint8_t*)map;
+        }
+        close(host_fd);
+        f->host_fd = -1;
+    }
+    #endif
+    return HOSTFS_FIRST_FD + idx;
+}
+
+int hostfs_close(hostfs_t* fs, int fd) {
+    _hostfs_file_t* f = _hostfs_file(fs, fd);
+    if (!f) {
+        return -1;
+    }
+    _hostfs_close_file(fs, f);
+    return 0;
+}
+
+int32_t hostfs_read(hostfs_t* fs, int fd, void* dst, uint32_t count) {
+    CHIPS_ASSERT(dst || count == 0);
+    _hostfs_file_t* f = _hostfs_file(fs, fd);
+    if (!f) {
+        return -1;
+    }
+    if (count > INT32_MAX) {
+        count = INT32_MAX;
+    }
+    if (f->host_fd < 0) {
+        // mapped file
+        if (f->pos >= f->size) {
+            return 0;
+        }
+        const uint64_t avail = f->size - f->pos;
+        const uint32_t n = (avail < count) ? (uint32_t)avail : count;
+        memcpy(dst, f->map + f->pos, n);
+        f->pos += n;
+        return (int32_t)n;
+    }
+    uint32_t total = 0;
+    while (total < count) {
+        const ssize_t n = read(f->host_fd, (uint8_t*)dst + total, count - total);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return total ? (int32_t)total : -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        total += (uint32_t)n;
+    }
+    return (int32_t)total;
+}
+
+int32_t hostfs_write(hostfs_t* fs, int fd, const void* src, uint32_t count) {
+    CHIPS_ASSERT(src || count == 0);
+    _hostfs_file_t* f = _hostfs_file(fs, fd);
+    if (!f) {
+        return -1;
+    }
+    if (f->host_fd < 0) {
+        errno = EBADF;
+        return -1;
+    }
+    if (count > INT32_MAX) {
+        count = INT32_MAX;
+    }
+    if (fs->speculating) {
+        // only the file offset moves, like after a successful write
+        return (lseek(f->host_fd, (off_t)count, SEEK_CUR) < 0) ? -1 : (int32_t)count;
+    }
+    uint32_t total = 0;
+    while (total < count) {
+        const ssize_t n = write(f->host_fd, (const uint8_t*)src + total, count - total);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return total ? (int32_t)total : -1;
+        }
+        total += (uint32_t)n;
+    }
+    return (int32_t)total;
+}
+
+int64_t hostfs_lseek(hostfs_t* fs, int fd, int64_t offset, int whence) {
+    _hostfs_file_t* f = _hostfs_file(fs, fd);
+    if (!f) {
+        return -1;
+    }
+    if (f->host_fd >= 0) {
+        int host_whence;
+        switch (whence) {
+            case HOSTFS_SEEK_SET: host_whence = SEEK_SET; break;
+            case HOSTFS_SEEK_CUR: host_whence = SEEK_CUR; break;
+            case HOSTFS_SEEK_END: host_whence = SEEK_END; break;
+            default: errno = EINVAL; return -1;
+        }
+        return (int64_t)lseek(f->host_fd, (off_t)offset, host_whence);
+    }
+    int64_t base;
+    switch (whence) {
+        case HOSTFS_SEEK_SET: base = 0; break;
+        case HOSTFS_SEEK_CUR: base = (int64_t)f->pos; break;
+        case HOSTFS_SEEK_END: base = (int64_t)f->size; break;
+        default: errno = EINVAL; return -1;
+    }
+    if (base + offset < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    f->pos = (uint64_t)(base + offset);
+    return (int64_t)f->pos;
+}
+
+void hostfs_begin_speculation(hostfs_t* fs) {
+    if (!fs) {
+        return;
+    }
+    CHIPS_ASSERT(!fs->speculating);
+    memcpy(fs->saved_files, fs->files, sizeof(fs->files));
+    for (int i = 0; i < HOSTFS_MAX_FILES; i++) {
+        const _hostfs_file_t* f = &fs->files[i];
+        fs->saved_offsets[i] = (f->used && (f->host_fd >= 0)) ? lseek(f->host_fd, 0, SEEK_CUR) : 0;
+    }
+    fs->speculating = true;
+}
+
+void hostfs_end_speculation(hostfs_t* fs) {
+    if (!fs || !fs->speculating) {
+        return;
+    }
+    for (int i = 0; i < HOSTFS_MAX_FILES; i++) {
+        if (fs->files[i].used && fs->files[i].speculative) {
+            _hostfs_release(&fs->files[i]);
+        }
+    }
+    memcpy(fs->files, fs->saved_files, sizeof(fs->files));
+    for (int i = 0; i < HOSTFS_MAX_FILES; i++) {
+        const _hostfs_file_t* f = &fs->files[i];
+        if (f->used && (f->host_fd >= 0) && (fs->saved_offsets[i] >= 0)) {
+            lseek(f->host_fd, fs->saved_offsets[i], SEEK_SET);
+        }
+    }
+    fs->speculating = false;
+}
+
+#endif
@@ -0,0 +1,90 @@
+#pragma once
+/*
+    hostfs.h -- sandboxed host directory file access for guest programs
+
+    All guest paths are resolved relative to a root directory on the host.
+    Leading slashes are ignored and paths containing ".." components are
+    rejected, and files are opened beneath a handle of the root directory,
+    so symbolic links can't lead a guest outside of it either (on hosts
+    without openat2() symbolic links are not followed at all).
+
+    Files opened read-only are memory-mapped, reads and seeks are then
+    plain memory copies without any syscalls, and hostfs_read() can copy
+    straight into the guest RAM array. Writable files use regular file
+    descriptor I/O.
+
+    ~~~C
+    hostfs_t* fs = hostfs_create("games/data");
+    int fd = hostfs_open(fs, "level1.bin", HOSTFS_O_RDONLY);
+    if (fd >= 0) {
+        hostfs_read(fs, fd, &sys->ram[0x10000], 0x8000);
+        hostfs_close(fs, fd);
+    }
+    ...
+    hostfs_destroy(fs);
+    ~~~
+
+    Functions return -1 on failure and set errno, like their POSIX
+    counterparts. File descriptor numbers are small integers starting at
+    HOSTFS_FIRST_FD (0..2 are left for the standard streams).
+
+    Between hostfs_begin_speculation() and hostfs_end_speculation() the
+    guest runs frames which are thrown away again (run-ahead), nothing it
+    does may reach the host. Reads and seeks work as usual, writes report
+    success without writing, opening a file for writing fails with EAGAIN
+    and closing a file keeps it open on the host. Ending the speculation
+    closes the files opened since and restores the file table and all
+    file offsets.
+
+    Not available on the web platform, hostfs_create() returns NULL there.
+*/
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HOSTFS_MAX_FILES (16)  // number of simultaneously open files
+#define HOSTFS_FIRST_FD  (3)   // lowest file descriptor number handed out
+
+// open flags, same values as cc65's fcntl.h
+#define HOSTFS_O_RDONLY (0x01)
+#define HOSTFS_O_WRONLY (0x02)
+#define HOSTFS_O_RDWR   (0x03)
+#define HOSTFS_O_CREAT  (0x10)
+#define HOSTFS_O_TRUNC  (0x20)
+#define HOSTFS_O_APPEND (0x40)
+#define HOSTFS_O_EXCL   (0x80)
+
+// lseek whence values
+#define HOSTFS_SEEK_SET (0)
+#define HOSTFS_SEEK_CUR (1)
+#define HOSTFS_SEEK_END (2)
+
+typedef struct hostfs_t hostfs_t;
+
+// create a file system rooted at an existing host directory, returns NULL on failure
+hostfs_t* hostfs_create(const char* root);
+// close all files and free the file system
+void hostfs_destroy(hostfs_t* fs);
+// close all open files (on guest reset)
+void hostfs_close_all(hostfs_t* fs);
+// open a file, returns file descriptor or -1
+int hostfs_open(hostfs_t* fs, const char* path, int flags);
+// close a file, returns 0 or -1
+int hostfs_close(hostfs_t* fs, int fd);
+// read up to count bytes into dst, returns number of bytes read or -1
+int32_t hostfs_read(hostfs_t* fs, int fd, void* dst, uint32_t count);
+// write count bytes from src, returns number of bytes written or -1
+int32_t hostfs_write(hostfs_t* fs, int fd, const void* src, uint32_t count);
+// reposition file offset, returns new offset or -1
+int64_t hostfs_lseek(hostfs_t* fs, int fd, int64_t offset, int whence);
+// start running frames which will be thrown away, fs may be NULL
+void hostfs_begin_speculation(hostfs_t* fs);
+// go back to the files and offsets from hostfs_begin_speculation(), fs may be NULL
+void hostfs_end_speculation(hostfs_t* fs);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
@@ -0,0 +1,185 @@
+#include "./lz.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#define _LZ_HASH_BITS (12)
+#define _LZ_MIN_MATCH (4)
+#define _LZ_MAX_OFFSET (65535)
+// LZ4 block rules: last match starts at least 12 bytes before the end, last 5 bytes are literals
+#define _LZ_MATCH_LIMIT (12)
+#define _LZ_LAST_LITERALS (5)
+
+static inline uint32_t _lz_read32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t _lz_hash(uint32_t v) {
+    return (v * 2654435761u) >> (32 - _LZ_HASH_BITS);
+}
+
+// length continuation bytes, for lengths which don't fit into the token nibble
+static inline uint8_t* _lz_write_length(uint8_t* op, size_t len) {
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+size_t lz_compress_bound(size_t size) {
+    return size + size / 255 + 16;
+}
+
+size_t lz_compress(const void* src, size_t src_size, void* dst, size_t dst_capacity) {
+    const uint8_t* base = (const uint8_t*)src;
+    const uint8_t* end = base + src_size;
+    const uint8_t* anchor = base;
+    uint8_t* const op_start = (uint8_t*)dst;
+    uint8_t* op = op_start;
+    uint8_t* const op_end = op + dst_capacity;
+
+    if (src_size > _LZ_MATCH_LIMIT) {
+        uint32_t table[1 << _LZ_HASH_BITS];
+        memset(table, 0, sizeof(table));
+        const uint8_t* const match_limit = end - _LZ_MATCH_LIMIT;
+        const uint8_t* const copy_limit = end - _LZ_LAST_LITERALS;
+        const uint8_t* ip = base;
+        uint32_t misses = 0;
+        while (ip < match_limit) {
+            const uint32_t seq = _lz_read32(ip);
+            const uint32_t h = _lz_hash(seq);
+            const uint8_t* ref = base + table[h];
+            table[h] = (uint32_t)(ip - base);
+            if ((ref >= ip) || ((ip - ref) > _LZ_MAX_OFFSET) || (_lz_read32(ref) != seq)) {
+                // skip faster through data which doesn't compress
+                ip += 1 + (misses++ >> 6);
+                continue;
+            }
+            misses = 0;
+            const uint8_t* mp = ip + _LZ_MIN_MATCH;
+            const uint8_t* rp = ref + _LZ_MIN_MATCH;
+            while ((mp < copy_limit) && (*mp == *rp)) {
+                mp++;
+                rp++;
+            }
+            const size_t lit = (size_t)(ip - anchor);
+            const size_t mlen = (size_t)(mp - ip) - _LZ_MIN_MATCH;
+            if ((size_t)(op_end - op) < (1 + lit / 255 + 1 + lit + 2 + mlen / 255 + 1)) {
+                return 0;
+            }
+            uint8_t* token = op++;
+            *token = (uint8_t)(((lit >= 15 ? 15 : lit) << 4) | (mlen >= 15 ? 15 : mlen));
+            if (lit >= 15) {
+                op = _lz_write_length(op, lit - 15);
+            }
+            memcpy(op, anchor, lit);
+            op += lit;
+            const size_t offset = (size_t)(ip - ref);
+            *op++ = (uint8_t)offset;
+            *op++ = (uint8_t)(offset >> 8);
+            if (mlen >= 15) {
+                op = _lz_write_length(op, mlen - 15);
+            }
+            ip = anchor = mp;
+        }
+    }
+
+    // trailing literals
+    const size_t lit = (size_t)(end - anchor);
+    if ((size_t)(op_end - op) < (1 + lit / 255 + 1 + lit)) {
+        return 0;
+    }
+    *op++ = (uint8_t)((lit >= 15 ? 15 : lit) << 4);
+    if (lit >= 15) {
+        op = _lz_write_length(op, lit - 15);
+    }
+    memcpy(op, anchor, lit);
+    op += lit;
+    return (size_t)(op - op_start);
+}
+
+// read length continuation bytes, false if input ends
+static inline bool _lz_read_length(const uint8_t** ip, const uint8_t* ip_end, size_t* len) {
+    uint8_t b;
+    do {
+        if (*ip >= ip_end) {
+            return false;
+        }
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255);
+    return true;
+}
+
+// decode a block, or only validate it and count the output bytes if dst is 0
+static inline size_t _lz_decode(const void* src, size_t src_size, uint8_t* dst, size_t dst_capacity) {
+    const uint8_t* ip = (const uint8_t*)src;
+    const uint8_t* const ip_end = ip + src_size;
+    size_t pos = 0;
+
+    for (;;) {
+        if (ip >= ip_end) {
+            return LZ_ERROR;
+        }
+        const uint8_t token = *ip++;
+        size_t lit = token >> 4;
+        if ((lit == 15) && !_lz_read_length(&ip, ip_end, &lit)) {
+            return LZ_ERROR;
+        }
+        if ((lit > (size_t)(ip_end - ip)) || (lit > (dst_capacity - pos))) {
+            return LZ_ERROR;
+        }
+        if (dst) {
+            memcpy(dst + pos, ip, lit);
+        }
+        ip += lit;
+        pos += lit;
+        if (ip == ip_end) {
+            // last sequence has no match
+            break;
+        }
+        if ((ip_end - ip) < 2) {
+            return LZ_ERROR;
+        }
+        const size_t offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        if ((offset == 0) || (offset > pos)) {
+            return LZ_ERROR;
+        }
+        size_t mlen = token & 15;
+        if ((mlen == 15) && !_lz_read_length(&ip, ip_end, &mlen)) {
+            return LZ_ERROR;
+        }
+        mlen += _LZ_MIN_MATCH;
+        if (mlen > (dst_capacity - pos)) {
+            return LZ_ERROR;
+        }
+        if (dst) {
+            uint8_t* op = dst + pos;
+            const uint8_t* ref = op - offset;
+            if (offset >= mlen) {
+                memcpy(op, ref, mlen);
+            }
+            else {
+                // overlapping match repeats the last offset bytes
+                for (size_t i = 0; i < mlen; i++) {
+                    op[i] = ref[i];
+                }
+            }
+        }
+        pos += mlen;
+    }
+    return pos;
+}
+
+size_t lz_decompress(const void* src, size_t src_size, void* dst, size_t dst_capacity) {
+    return _lz_decode(src, src_size, (uint8_t*)dst, dst_capacity);
+}
+
+size_t lz_decompressed_size(const void* src, size_t src_size) {
+    return _lz_decode(src, src_size, 0, LZ_ERROR);
+}
@@ -0,0 +1,40 @@
+#pragma once
+/*
+    lz.h -- fast LZ77 compression in the LZ4 block format
+
+    Greedy single-pass compressor with a small hash table, meant for
+    data which is compressed and decompressed often (snapshots), where
+    speed matters more than ratio. The output is a raw LZ4 block (no
+    frame header), so it can be inspected or produced with the lz4 tools.
+
+    ~~~C
+    uint8_t* dst = malloc(lz_compress_bound(size));
+    size_t packed = lz_compress(src, size, dst, lz_compress_bound(size));
+    ...
+    if (lz_decompress(dst, packed, out, size) != size) {
+        // corrupt data
+    }
+    ~~~
+*/
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// returned by lz_decompress() for malformed input
+#define LZ_ERROR (SIZE_MAX)
+
+// worst case compressed size of size bytes
+size_t lz_compress_bound(size_t size);
+// compress src into dst, returns compressed size, or 0 if it doesn't fit into dst_capacity
+size_t lz_compress(const void* src, size_t src_size, void* dst, size_t dst_capacity);
+// decompress src into dst, returns decompressed size or LZ_ERROR
+size_t lz_decompress(const void* src, size_t src_size, void* dst, size_t dst_capacity);
+// validate src without decompressing it, returns decompressed size or LZ_ERROR
+size_t lz_decompressed_size(const void* src, size_t src_size);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
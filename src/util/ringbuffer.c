@@ -1,6 +1,15 @@
 #include "./ringbuffer.h"
 
+#include <string.h>
+
 void rb_init(ring_buffer_t* rb) {
+    rb_init_size(rb, RB_BUFFER_SIZE);
+}
+
+void rb_init_size(ring_buffer_t* rb, size_t size) {
+    if (size < 2) size = RB_BUFFER_SIZE;
+    if (size > RB_MAX_BUFFER_SIZE) size = RB_MAX_BUFFER_SIZE;
+    rb->size = size;
     rb->head = 0;
     rb->tail = 0;
 }
@@ -10,7 +19,7 @@ bool rb_is_empty(const ring_buffer_t* rb) {
 }
 
 bool rb_is_full(const ring_buffer_t* rb) {
-    return ((rb->head + 1) % RB_BUFFER_SIZE) == rb->tail;
+    return ((rb->head + 1) % rb->size) == rb->tail;
 }
 
 bool rb_put(ring_buffer_t* rb, uint8_t data) {
@@ -18,7 +27,7 @@ bool rb_put(ring_buffer_t* rb, uint8_t data) {
         return false;
     }
     rb->buffer[rb->head] = data;
-    rb->head = (rb->head + 1) % RB_BUFFER_SIZE;
+    rb->head = (rb->head + 1) % rb->size;
     return true;
 }
 
@@ -27,6 +36,45 @@ bool rb_get(ring_buffer_t* rb, uint8_t* data) {
         return false;
     }
     *data = rb->buffer[rb->tail];
-    rb->tail = (rb->tail + 1) % RB_BUFFER_SIZE;
+    rb->tail = (rb->tail + 1) % rb->size;
     return true;
 }
+
+size_t rb_count(const ring_buffer_t* rb) {
+    return (rb->head + rb->size - rb->tail) % rb->size;
+}
+
+size_t rb_free(const ring_buffer_t* rb) {
+    return rb->size - 1 - rb_count(rb);
+}
+
+size_t rb_write(ring_buffer_t* rb, const uint8_t* src, size_t len) {
+    const size_t free = rb_free(rb);
+    if (len > free) len = free;
+    // at most two contiguous chunks
+    const size_t first = (rb->size - rb->head) < len ? (rb->size - rb->head) : len;
+    memcpy(&rb->buffer[rb->head], src, first);
+    memcpy(&rb->buffer[0], src + first, len - first);
+    rb->head = (rb->head + len) % rb->size;
+    return len;
+}
+
+size_t rb_peek(const ring_buffer_t* rb, uint8_t* dst, size_t len) {
+    const size_t count = rb_count(rb);
+    if (len > count) len = count;
+    const size_t first = (rb->size - rb->tail) < len ? (rb->size - rb->tail) : len;
+    memcpy(dst, &rb->buffer[rb->tail], first);
+    memcpy(dst + first, &rb->buffer[0], len - first);
+    return len;
+}
+
+size_t rb_skip(ring_buffer_t* rb, size_t len) {
+    const size_t count = rb_count(rb);
+    if (len > count) len = count;
+    rb->tail = (rb->tail + len) % rb->size;
+    return len;
+}
+
+size_t rb_read(ring_buffer_t* rb, uint8_t* dst, size_t len) {
+    return rb_skip(rb, rb_peek(rb, dst, len));
+}
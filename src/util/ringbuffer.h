@@ -3,23 +3,38 @@
 #include <stdint.h>
 #include <stdbool.h>
 
-#define RB_BUFFER_SIZE 128
+#define RB_BUFFER_SIZE     128        // default capacity
+#define RB_MAX_BUFFER_SIZE (1 << 12)  // max capacity, stored inline so it adds to snapshots of the owner
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 typedef struct {
-    uint8_t buffer[RB_BUFFER_SIZE];
+    uint8_t buffer[RB_MAX_BUFFER_SIZE];
+    size_t size;  // usable capacity is size-1
     size_t head;
     size_t tail;
 } ring_buffer_t;
 
 void rb_init(ring_buffer_t* rb);
+void rb_init_size(ring_buffer_t* rb, size_t size);
 bool rb_is_empty(const ring_buffer_t* rb);
 bool rb_is_full(const ring_buffer_t* rb);
 bool rb_put(ring_buffer_t* rb, uint8_t data);
 bool rb_get(ring_buffer_t* rb, uint8_t* data);
+// number of bytes stored
+size_t rb_count(const ring_buffer_t* rb);
+// number of bytes which can be stored
+size_t rb_free(const ring_buffer_t* rb);
+// bulk put up to len bytes, returns number of bytes stored
+size_t rb_write(ring_buffer_t* rb, const uint8_t* src, size_t len);
+// bulk get up to len bytes, returns number of bytes retrieved
+size_t rb_read(ring_buffer_t* rb, uint8_t* dst, size_t len);
+// copy up to len bytes without removing them, returns number of bytes copied
+size_t rb_peek(const ring_buffer_t* rb, uint8_t* dst, size_t len);
+// remove up to len bytes, returns number of bytes removed
+size_t rb_skip(ring_buffer_t* rb, size_t len);
 
 #ifdef __cplusplus
 } /* extern "C" */
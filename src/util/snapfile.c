@@ -0,0 +1,159 @@
+#include "./snapfile.h"
+#include "./lz.h"
+
+#include <stdlib.h>
+#include <string.h>
+#ifndef CHIPS_ASSERT
+    #include <assert.h>
+    #define CHIPS_ASSERT(c) assert(c)
+#endif
+
+#define _SNAPFILE_FLAG_LZ (1 << 0)
+
+static void _snapfile_put16(uint8_t* p, uint16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void _snapfile_put32(uint8_t* p, uint32_t v) {
+    _snapfile_put16(p, (uint16_t)v);
+    _snapfile_put16(p + 2, (uint16_t)(v >> 16));
+}
+
+static uint16_t _snapfile_get16(const uint8_t* p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t _snapfile_get32(const uint8_t* p) {
+    return _snapfile_get16(p) | ((uint32_t)_snapfile_get16(p + 2) << 16);
+}
+
+// make room for size more bytes
+static bool _snapfile_reserve(snapfile_writer_t* w, size_t size) {
+    if (w->failed) {
+        return false;
+    }
+    if (w->size + size > w->capacity) {
+        size_t capacity = w->capacity ? w->capacity : (64 * 1024);
+        while (w->size + size > capacity) {
+            capacity *= 2;
+        }
+        uint8_t* ptr = (uint8_t*)realloc(w->ptr, capacity);
+        if (!ptr) {
+            w->failed = true;
+            return false;
+        }
+        w->ptr = ptr;
+        w->capacity = capacity;
+    }
+    return true;
+}
+
+void snapfile_writer_init(snapfile_writer_t* w, const char magic[4]) {
+    CHIPS_ASSERT(w && magic);
+    memset(w, 0, sizeof(*w));
+    if (_snapfile_reserve(w, SNAPFILE_HEADER_SIZE)) {
+        memcpy(w->ptr, magic, 4);
+        _snapfile_put32(w->ptr + 4, SNAPFILE_FORMAT_VERSION);
+        w->size = SNAPFILE_HEADER_SIZE;
+    }
+}
+
+void snapfile_write_chunk(snapfile_writer_t* w, const char id[4], uint16_t version, const void* data, size_t size) {
+    CHIPS_ASSERT(w && id && (data || !size));
+    CHIPS_ASSERT(size <= UINT32_MAX);
+    const size_t bound = lz_compress_bound(size);
+    if (!_snapfile_reserve(w, SNAPFILE_CHUNK_HEADER_SIZE + bound)) {
+        return;
+    }
+    uint8_t* hdr = w->ptr + w->size;
+    uint8_t* payload = hdr + SNAPFILE_CHUNK_HEADER_SIZE;
+    uint16_t flags = _SNAPFILE_FLAG_LZ;
+    size_t stored = lz_compress(data, size, payload, bound);
+    if ((stored == 0) || (stored >= size)) {
+        // incompressible, store as is
+        flags = 0;
+        stored = size;
+        if (size > 0) {
+            memcpy(payload, data, size);
+        }
+    }
+    memcpy(hdr, id, 4);
+    _snapfile_put16(hdr + 4, version);
+    _snapfile_put16(hdr + 6, flags);
+    _snapfile_put32(hdr + 8, (uint32_t)size);
+    _snapfile_put32(hdr + 12, (uint32_t)stored);
+    w->size += SNAPFILE_CHUNK_HEADER_SIZE + stored;
+}
+
+chips_range_t snapfile_writer_finish(snapfile_writer_t* w) {
+    CHIPS_ASSERT(w);
+    if (w->failed) {
+        free(w->ptr);
+        memset(w, 0, sizeof(*w));
+        return (chips_range_t){ 0 };
+    }
+    // give back the slack of the compression bound
+    uint8_t* ptr = (uint8_t*)realloc(w->ptr, w->size);
+    const chips_range_t res = { .ptr = ptr ? ptr : w->ptr, .size = w->size };
+    memset(w, 0, sizeof(*w));
+    return res;
+}
+
+bool snapfile_reader_init(snapfile_reader_t* r, const char magic[4], chips_range_t data) {
+    CHIPS_ASSERT(r && magic);
+    memset(r, 0, sizeof(*r));
+    if (!data.ptr || (data.size < SNAPFILE_HEADER_SIZE)) {
+        return false;
+    }
+    const uint8_t* ptr = (const uint8_t*)data.ptr;
+    if ((memcmp(ptr, magic, 4) != 0) || (_snapfile_get32(ptr + 4) != SNAPFILE_FORMAT_VERSION)) {
+        return false;
+    }
+    r->ptr = ptr;
+    r->size = data.size;
+    r->pos = SNAPFILE_HEADER_SIZE;
+    return true;
+}
+
+bool snapfile_next_chunk(snapfile_reader_t* r, snapfile_chunk_t* chunk) {
+    CHIPS_ASSERT(r && chunk);
+    if (!r->ptr || (r->size - r->pos) < SNAPFILE_CHUNK_HEADER_SIZE) {
+        return false;
+    }
+    const uint8_t* hdr = r->ptr + r->pos;
+    memcpy(chunk->id, hdr, 4);
+    chunk->version = _snapfile_get16(hdr + 4);
+    chunk->flags = _snapfile_get16(hdr + 6);
+    chunk->size = _snapfile_get32(hdr + 8);
+    chunk->stored_size = _snapfile_get32(hdr + 12);
+    if (chunk->stored_size > (r->size - r->pos - SNAPFILE_CHUNK_HEADER_SIZE)) {
+        // truncated
+        return false;
+    }
+    chunk->data = hdr + SNAPFILE_CHUNK_HEADER_SIZE;
+    r->pos += SNAPFILE_CHUNK_HEADER_SIZE + chunk->stored_size;
+    return true;
+}
+
+bool snapfile_chunk_is(const snapfile_chunk_t* chunk, const char id[4], uint16_t version) {
+    CHIPS_ASSERT(chunk && id);
+    return (memcmp(chunk->id, id, 4) == 0) && (chunk->version == version);
+}
+
+bool snapfile_read_chunk(const snapfile_chunk_t* chunk, void* dst, size_t size) {
+    CHIPS_ASSERT(chunk && (dst || !size));
+    if (chunk->size != size) {
+        return false;
+    }
+    if (chunk->flags & _SNAPFILE_FLAG_LZ) {
+        return lz_decompress(chunk->data, chunk->stored_size, dst, size) == size;
+    }
+    if (chunk->stored_size != size) {
+        return false;
+    }
+    if (size > 0) {
+        memcpy(dst, chunk->data, size);
+    }
+    return true;
+}
@@ -0,0 +1,85 @@
+#pragma once
+/*
+    snapfile.h -- chunked, compressed snapshot container
+
+    A snapshot file is a 4-character magic and a format version followed
+    by a list of chunks. Each chunk has a 4-character id, its own version
+    and the uncompressed size of its payload, so readers can skip chunks
+    they don't know or whose layout changed, instead of rejecting the
+    whole file. Payloads are compressed with lz.h, or stored as they are
+    if they don't compress. All header fields are little-endian.
+
+    ~~~C
+    snapfile_writer_t w;
+    snapfile_writer_init(&w, "X65S");
+    snapfile_write_chunk(&w, "CPU ", 1, &cpu, sizeof(cpu));
+    chips_range_t data = snapfile_writer_finish(&w);
+    ...
+    snapfile_reader_t r;
+    snapfile_chunk_t chunk;
+    if (snapfile_reader_init(&r, "X65S", data)) {
+        while (snapfile_next_chunk(&r, &chunk)) {
+            if (snapfile_chunk_is(&chunk, "CPU ", 1)) {
+                snapfile_read_chunk(&chunk, &cpu, sizeof(cpu));
+            }
+        }
+    }
+    free(data.ptr);
+    ~~~
+*/
+#include "chips/chips_common.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SNAPFILE_FORMAT_VERSION (1)
+// a file starts with the file header, each chunk with a chunk header
+#define SNAPFILE_HEADER_SIZE       (8)
+#define SNAPFILE_CHUNK_HEADER_SIZE (16)
+
+typedef struct {
+    uint8_t* ptr;
+    size_t size;
+    size_t capacity;
+    bool failed;  // out of memory
+} snapfile_writer_t;
+
+typedef struct {
+    char id[4];
+    uint16_t version;
+    uint16_t flags;
+    uint32_t size;  // uncompressed payload size
+    const uint8_t* data;
+    uint32_t stored_size;
+} snapfile_chunk_t;
+
+typedef struct {
+    const uint8_t* ptr;
+    size_t size;
+    size_t pos;
+} snapfile_reader_t;
+
+// start a new snapshot file
+void snapfile_writer_init(snapfile_writer_t* w, const char magic[4]);
+// append a chunk, the payload is compressed
+void snapfile_write_chunk(snapfile_writer_t* w, const char id[4], uint16_t version, const void* data, size_t size);
+// returns the snapshot file, release with free(), empty range if out of memory
+chips_range_t snapfile_writer_finish(snapfile_writer_t* w);
+
+// check magic and format version, data must stay valid while reading
+bool snapfile_reader_init(snapfile_reader_t* r, const char magic[4], chips_range_t data);
+// get next chunk, false at end of file or if the file is truncated
+bool snapfile_next_chunk(snapfile_reader_t* r, snapfile_chunk_t* chunk);
+// true if chunk has given id and version
+bool snapfile_chunk_is(const snapfile_chunk_t* chunk, const char id[4], uint16_t version);
+// decompress chunk payload, false if size doesn't match or data is corrupt
+bool snapfile_read_chunk(const snapfile_chunk_t* chunk, void* dst, size_t size);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
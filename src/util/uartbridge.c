@@ -0,0 +1,236 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+    #define _GNU_SOURCE  // posix_openpt(), ptsname(), cfmakeraw()
+#endif
+#include "./uartbridge.h"
+
+#include <stdlib.h>
+#include <string.h>
+#ifndef CHIPS_ASSERT
+    #include <assert.h>
+    #define CHIPS_ASSERT(c) assert(c)
+#endif
+
+#if defined(__EMSCRIPTEN__) || defined(_WIN32)
+
+uart_bridge_t* uart_bridge_open(const uart_bridge_desc_t* desc) {
+    (void)desc;
+    return NULL;
+}
+void uart_bridge_close(uart_bridge_t* bridge) {
+    (void)bridge;
+}
+const char* uart_bridge_name(const uart_bridge_t* bridge) {
+    (void)bridge;
+    return "";
+}
+void uart_bridge_service(uart_bridge_t* bridge, ring_buffer_t* rx, ring_buffer_t* tx) {
+    (void)bridge;
+    (void)rx;
+    (void)tx;
+}
+uart_bridge_stats_t uart_bridge_stats(const uart_bridge_t* bridge) {
+    (void)bridge;
+    return (uart_bridge_stats_t){ 0 };
+}
+
+#else  // POSIX platforms
+
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <termios.h>
+    #include <sys/socket.h>
+    #include <sys/un.h>
+
+    #define _UART_BRIDGE_CHUNK (4096)
+    #if !defined(MSG_NOSIGNAL)
+        #define MSG_NOSIGNAL (0)  // macOS, the client socket has SO_NOSIGPIPE set instead
+    #endif
+
+struct uart_bridge_t {
+    uart_bridge_type_t type;
+    int listen_fd;  // socket: listening socket
+    int fd;         // PTY master or connected socket client, -1 if none
+    char* name;
+    char* link;  // PTY: symlink to remove on close
+    uart_bridge_stats_t stats;
+};
+
+static bool _uart_bridge_nonblock(int fd) {
+    const int flags = fcntl(fd, F_GETFL);
+    return (flags >= 0) && (fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0);
+}
+
+static bool _uart_bridge_open_pty(uart_bridge_t* bridge, const char* link) {
+    const int fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (fd < 0) {
+        return false;
+    }
+    if (grantpt(fd) != 0 || unlockpt(fd) != 0 || !_uart_bridge_nonblock(fd)) {
+        close(fd);
+        return false;
+    }
+    // pass bytes through unmodified, the guest does its own line handling
+    struct termios tio;
+    if (tcgetattr(fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    const char* slave = ptsname(fd);
+    if (!slave) {
+        close(fd);
+        return false;
+    }
+    bridge->fd = fd;
+    bridge->name = strdup(slave);
+    if (link) {
+        unlink(link);
+        if (symlink(slave, link) == 0) {
+            bridge->link = strdup(link);
+        }
+    }
+    // the master reads EIO until a client opens the slave side
+    bridge->stats.connected = true;
+    return bridge->name != NULL;
+}
+
+static bool _uart_bridge_open_socket(uart_bridge_t* bridge, const char* path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (!path || strlen(path) >= sizeof(addr.sun_path)) {
+        return false;
+    }
+    strcpy(addr.sun_path, path);
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return false;
+    }
+    unlink(path);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 1) != 0 || !_uart_bridge_nonblock(fd)) {
+        close(fd);
+        return false;
+    }
+    bridge->listen_fd = fd;
+    bridge->name = strdup(path);
+    return bridge->name != NULL;
+}
+
+uart_bridge_t* uart_bridge_open(const uart_bridge_desc_t* desc) {
+    CHIPS_ASSERT(desc);
+    uart_bridge_t* bridge = (uart_bridge_t*)calloc(1, sizeof(uart_bridge_t));
+    if (!bridge) {
+        return NULL;
+    }
+    bridge->type = desc->type;
+    bridge->listen_fd = -1;
+    bridge->fd = -1;
+    const bool ok = (desc->type == UART_BRIDGE_PTY) ? _uart_bridge_open_pty(bridge, desc->path)
+                                                    : _uart_bridge_open_socket(bridge, desc->path);
+    if (!ok) {
+        uart_bridge_close(bridge);
+        return NULL;
+    }
+    return bridge;
+}
+
+void uart_bridge_close(uart_bridge_t* bridge) {
+    if (!bridge) {
+        return;
+    }
+    if (bridge->fd >= 0) {
+        close(bridge->fd);
+    }
+    if (bridge->listen_fd >= 0) {
+        close(bridge->listen_fd);
+        if (bridge->name) {
+            unlink(bridge->name);
+        }
+    }
+    if (bridge->link) {
+        unlink(bridge->link);
+        free(bridge->link);
+    }
+    free(bridge->name);
+    free(bridge);
+}
+
+const char* uart_bridge_name(const uart_bridge_t* bridge) {
+    CHIPS_ASSERT(bridge);
+    return bridge->name;
+}
+
+uart_bridge_stats_t uart_bridge_stats(const uart_bridge_t* bridge) {
+    CHIPS_ASSERT(bridge);
+    return bridge->stats;
+}
+
+// peer went away: sockets wait for the next client, a PTY stays open
+static void _uart_bridge_hangup(uart_bridge_t* bridge) {
+    if (bridge->type == UART_BRIDGE_SOCKET) {
+        close(bridge->fd);
+        bridge->fd = -1;
+        bridge->stats.connected = false;
+    }
+}
+
+void uart_bridge_service(uart_bridge_t* bridge, ring_buffer_t* rx, ring_buffer_t* tx) {
+    CHIPS_ASSERT(bridge && rx && tx);
+    if (bridge->fd < 0 && bridge->listen_fd >= 0) {
+        const int fd = accept(bridge->listen_fd, NULL, NULL);
+        if (fd < 0 || !_uart_bridge_nonblock(fd)) {
+            if (fd >= 0) close(fd);
+            return;
+        }
+    #if defined(SO_NOSIGPIPE)
+        const int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+    #endif
+        bridge->fd = fd;
+        bridge->stats.connected = true;
+    }
+    if (bridge->fd < 0) {
+        return;
+    }
+    uint8_t buf[_UART_BRIDGE_CHUNK];
+
+    // host -> guest, no more than the receive FIFO can take
+    size_t space;
+    while ((space = rb_free(rx)) > 0) {
+        const ssize_t n = read(bridge->fd, buf, space < sizeof(buf) ? space : sizeof(buf));
+        if (n > 0) {
+            rb_write(rx, buf, (size_t)n);
+            bridge->stats.bytes_in += (uint64_t)n;
+            continue;
+        }
+        if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && errno != EIO)) {
+            _uart_bridge_hangup(bridge);
+            return;
+        }
+        // nothing pending (EIO: PTY slave not opened yet)
+        break;
+    }
+
+    // guest -> host, bytes which are not accepted stay in the transmit FIFO
+    size_t count;
+    while ((count = rb_count(tx)) > 0) {
+        // peek, so nothing is lost on a short write
+        const size_t len = rb_peek(tx, buf, count < sizeof(buf) ? count : sizeof(buf));
+        // a client which went away must not raise SIGPIPE, it's an EPIPE or ECONNRESET hangup
+        const ssize_t n = (bridge->type == UART_BRIDGE_SOCKET) ? send(bridge->fd, buf, len, MSG_NOSIGNAL)
+                                                               : write(bridge->fd, buf, len);
+        if (n > 0) {
+            rb_skip(tx, (size_t)n);
+            bridge->stats.bytes_out += (uint64_t)n;
+            if ((size_t)n < len) break;
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            break;
+        }
+        _uart_bridge_hangup(bridge);
+        break;
+    }
+}
+
+#endif
@@ -0,0 +1,72 @@
+#pragma once
+/*
+    uartbridge.h -- connect an emulated UART to a host pseudo-terminal or Unix socket
+
+    The bridge moves data between the UART FIFOs of the emulated chip
+    and a host file descriptor in bulk, call uart_bridge_service() once
+    per frame:
+
+    ~~~C
+    uart_bridge_t* uart = uart_bridge_open(&(uart_bridge_desc_t){
+        .type = UART_BRIDGE_PTY,
+    });
+    printf("UART on %s\n", uart_bridge_name(uart));
+    ...
+    uart_bridge_service(uart, &sys->ria.uart_rx, &sys->ria.uart_tx);
+    ...
+    uart_bridge_close(uart);
+    ~~~
+
+    Flow control is preserved in both directions: only as many bytes are
+    read from the host as fit into the receive FIFO (the rest stays in the
+    kernel buffers), and bytes the host does not accept stay in the
+    transmit FIFO, so the guest sees it full through its ready flags.
+
+    A socket bridge listens on a Unix domain socket and serves a single
+    client at a time, data sent while no client is connected stays in the
+    transmit FIFO.
+
+    Not available on Windows and the web platform, uart_bridge_open()
+    returns NULL there.
+*/
+#include "util/ringbuffer.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    UART_BRIDGE_PTY,     // create a pseudo-terminal, connect with e.g. screen or picocom
+    UART_BRIDGE_SOCKET,  // listen on a Unix domain socket
+} uart_bridge_type_t;
+
+typedef struct {
+    uart_bridge_type_t type;
+    const char* path;  // socket path, for PTY an optional symlink to the slave device
+} uart_bridge_desc_t;
+
+typedef struct {
+    uint64_t bytes_in;   // bytes received from host
+    uint64_t bytes_out;  // bytes sent to host
+    bool connected;      // a peer is connected
+} uart_bridge_stats_t;
+
+typedef struct uart_bridge_t uart_bridge_t;
+
+// create PTY or listening socket, returns NULL on failure
+uart_bridge_t* uart_bridge_open(const uart_bridge_desc_t* desc);
+// close host side and free the bridge
+void uart_bridge_close(uart_bridge_t* bridge);
+// name of the device or socket to connect to
+const char* uart_bridge_name(const uart_bridge_t* bridge);
+// exchange data with the host, never blocks
+void uart_bridge_service(uart_bridge_t* bridge, ring_buffer_t* rx, ring_buffer_t* tx);
+// get bridge statistics
+uart_bridge_stats_t uart_bridge_stats(const uart_bridge_t* bridge);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
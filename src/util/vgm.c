@@ -0,0 +1,279 @@
+#include "./vgm.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#ifndef CHIPS_ASSERT
+    #include <assert.h>
+    #define CHIPS_ASSERT(c) assert(c)
+#endif
+
+#define _VGM_DEFAULT(val, def) (((val) != 0) ? (val) : (def))
+#define _VGM_FILE_BUFFER_SIZE  (64 * 1024)
+
+// VGM commands
+#define _VGM_CMD_YM3812      (0x5A)
+#define _VGM_CMD_YMF262_P0   (0x5E)
+#define _VGM_CMD_YMF262_P1   (0x5F)
+#define _VGM_CMD_WAIT        (0x61)
+#define _VGM_CMD_WAIT_735    (0x62)
+#define _VGM_CMD_WAIT_882    (0x63)
+#define _VGM_CMD_END         (0x66)
+#define _VGM_CMD_DATA_BLOCK  (0x67)
+#define _VGM_CMD_WAIT_SHORT  (0x70)  // 0x7n: wait n+1 samples
+#define _VGM_MAX_WAIT        (0xFFFF)
+#define _VGM_MAX_SHORT_WAIT  (16)
+
+struct vgm_writer_t {
+    FILE* fp;
+    char* file_buf;
+    int tick_hz;
+    uint32_t clock;
+    uint64_t last_tick;
+    uint64_t tick_frac;        // remainder of tick to sample conversion (in 1/tick_hz units)
+    uint64_t samples;          // total samples, including pending
+    uint64_t pending_samples;  // samples not yet emitted as wait commands
+    uint32_t data_size;        // size of command stream written so far
+    bool io_error;
+};
+
+static void _vgm_put_le32(uint8_t* p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static uint32_t _vgm_get_le32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static bool _vgm_write_header(vgm_writer_t* vgm) {
+    uint8_t hdr[VGM_HEADER_SIZE];
+    memset(hdr, 0, sizeof(hdr));
+    memcpy(&hdr[0x00], "Vgm ", 4);
+    _vgm_put_le32(&hdr[0x04], VGM_HEADER_SIZE + vgm->data_size - 0x04);  // EOF offset
+    _vgm_put_le32(&hdr[0x08], 0x151);                                     // version
+    _vgm_put_le32(&hdr[0x18], (uint32_t)vgm->samples);                    // total samples
+    _vgm_put_le32(&hdr[0x34], VGM_HEADER_SIZE - 0x34);                    // data offset
+    _vgm_put_le32(&hdr[0x5C], vgm->clock);                                // YMF262 clock
+    return fwrite(hdr, sizeof(hdr), 1, vgm->fp) == 1;
+}
+
+static void _vgm_emit(vgm_writer_t* vgm, const uint8_t* bytes, uint32_t len) {
+    if (fwrite(bytes, 1, len, vgm->fp) != len) {
+        vgm->io_error = true;
+    }
+    vgm->data_size += len;
+}
+
+// advance the log clock to tick, converting elapsed ticks to samples
+static void _vgm_advance(vgm_writer_t* vgm, uint64_t tick) {
+    if (tick <= vgm->last_tick) {
+        // tick counter went backwards (chip re-initialized, snapshot loaded), just resync
+        vgm->last_tick = tick;
+        return;
+    }
+    const uint64_t t = (tick - vgm->last_tick) * VGM_SAMPLE_RATE + vgm->tick_frac;
+    const uint64_t samples = t / (uint64_t)vgm->tick_hz;
+    vgm->tick_frac = t % (uint64_t)vgm->tick_hz;
+    vgm->last_tick = tick;
+    vgm->samples += samples;
+    vgm->pending_samples += samples;
+}
+
+// emit pending samples as wait commands
+static void _vgm_flush_wait(vgm_writer_t* vgm) {
+    while (vgm->pending_samples > 0) {
+        if (vgm->pending_samples == 735) {
+            _vgm_emit(vgm, (const uint8_t[]){ _VGM_CMD_WAIT_735 }, 1);
+            vgm->pending_samples = 0;
+        }
+        else if (vgm->pending_samples == 882) {
+            _vgm_emit(vgm, (const uint8_t[]){ _VGM_CMD_WAIT_882 }, 1);
+            vgm->pending_samples = 0;
+        }
+        else if (vgm->pending_samples <= _VGM_MAX_SHORT_WAIT) {
+            _vgm_emit(vgm, (const uint8_t[]){ (uint8_t)(_VGM_CMD_WAIT_SHORT + vgm->pending_samples - 1) }, 1);
+            vgm->pending_samples = 0;
+        }
+        else {
+            const uint32_t n = vgm->pending_samples > _VGM_MAX_WAIT ? _VGM_MAX_WAIT : (uint32_t)vgm->pending_samples;
+            _vgm_emit(vgm, (const uint8_t[]){ _VGM_CMD_WAIT, (uint8_t)n, (uint8_t)(n >> 8) }, 3);
+            vgm->pending_samples -= n;
+        }
+    }
+}
+
+vgm_writer_t* vgm_writer_open(const vgm_writer_desc_t* desc) {
+    CHIPS_ASSERT(desc && desc->path);
+    CHIPS_ASSERT(desc->tick_hz > 0);
+    vgm_writer_t* vgm = (vgm_writer_t*)calloc(1, sizeof(vgm_writer_t));
+    if (!vgm) {
+        return NULL;
+    }
+    vgm->tick_hz = desc->tick_hz;
+    vgm->clock = _VGM_DEFAULT(desc->clock, VGM_YMF262_CLOCK);
+    vgm->last_tick = UINT64_MAX;  // first write starts the log
+    vgm->file_buf = (char*)malloc(_VGM_FILE_BUFFER_SIZE);
+    vgm->fp = vgm->file_buf ? fopen(desc->path, "wb") : NULL;
+    if (!vgm->fp) {
+        free(vgm->file_buf);
+        free(vgm);
+        return NULL;
+    }
+    setvbuf(vgm->fp, vgm->file_buf, _IOFBF, _VGM_FILE_BUFFER_SIZE);
+    if (!_vgm_write_header(vgm)) {
+        fclose(vgm->fp);
+        free(vgm->file_buf);
+        free(vgm);
+        return NULL;
+    }
+    return vgm;
+}
+
+void vgm_writer_write(uint16_t reg, uint8_t data, uint64_t tick, void* user_data) {
+    vgm_writer_t* vgm = (vgm_writer_t*)user_data;
+    CHIPS_ASSERT(vgm);
+    _vgm_advance(vgm, tick);
+    _vgm_flush_wait(vgm);
+    const uint8_t cmd = (reg & 0x100) ? _VGM_CMD_YMF262_P1 : _VGM_CMD_YMF262_P0;
+    _vgm_emit(vgm, (const uint8_t[]){ cmd, (uint8_t)reg, data }, 3);
+}
+
+bool vgm_writer_close(vgm_writer_t* vgm, uint64_t tick) {
+    if (!vgm) {
+        return false;
+    }
+    if (vgm->last_tick != UINT64_MAX) {
+        _vgm_advance(vgm, tick);
+        _vgm_flush_wait(vgm);
+    }
+    _vgm_emit(vgm, (const uint8_t[]){ _VGM_CMD_END }, 1);
+    if ((0 != fseek(vgm->fp, 0, SEEK_SET)) || !_vgm_write_header(vgm)) {
+        vgm->io_error = true;
+    }
+    if (0 != fclose(vgm->fp)) {
+        vgm->io_error = true;
+    }
+    const bool ok = !vgm->io_error;
+    free(vgm->file_buf);
+    free(vgm);
+    return ok;
+}
+
+uint64_t vgm_writer_samples(const vgm_writer_t* vgm) {
+    CHIPS_ASSERT(vgm);
+    return vgm->samples;
+}
+
+bool vgm_reader_init(vgm_reader_t* reader, const uint8_t* ptr, size_t size) {
+    CHIPS_ASSERT(reader && ptr);
+    memset(reader, 0, sizeof(*reader));
+    if ((size < 0x40) || (0 != memcmp(ptr, "Vgm ", 4))) {
+        return false;
+    }
+    vgm_header_t* hdr = &reader->header;
+    hdr->version = _vgm_get_le32(&ptr[0x08]);
+    hdr->total_samples = _vgm_get_le32(&ptr[0x18]);
+    // data offset field is only valid since 1.50, older files start at 0x40
+    const uint32_t data_offset = (hdr->version >= 0x150) ? _vgm_get_le32(&ptr[0x34]) : 0;
+    hdr->data_offset = data_offset ? (0x34 + (size_t)data_offset) : 0x40;
+    if ((hdr->version >= 0x151) && (hdr->data_offset >= 0x60) && (size >= 0x60)) {
+        hdr->ym3812_clock = _vgm_get_le32(&ptr[0x50]);
+        hdr->ymf262_clock = _vgm_get_le32(&ptr[0x5C]);
+    }
+    const size_t eof = 0x04 + (size_t)_vgm_get_le32(&ptr[0x04]);
+    hdr->data_end = ((eof > size) || (eof < hdr->data_offset)) ? size : eof;
+    if (hdr->data_offset >= hdr->data_end) {
+        return false;
+    }
+    reader->ptr = ptr;
+    reader->pos = hdr->data_offset;
+    return true;
+}
+
+void vgm_reader_rewind(vgm_reader_t* reader) {
+    CHIPS_ASSERT(reader && reader->ptr);
+    reader->pos = reader->header.data_offset;
+}
+
+// number of operand bytes of commands for chips we don't care about
+static int _vgm_operand_len(uint8_t cmd) {
+    if (cmd >= 0x30 && cmd <= 0x3F) return 1;
+    if (cmd >= 0x40 && cmd <= 0x4E) return 2;
+    if (cmd == 0x4F || cmd == 0x50) return 1;
+    if (cmd >= 0x51 && cmd <= 0x5F) return 2;
+    if (cmd >= 0x80 && cmd <= 0x8F) return 0;
+    if (cmd == 0x90 || cmd == 0x91 || cmd == 0x95) return 4;
+    if (cmd == 0x92) return 5;
+    if (cmd == 0x93) return 10;
+    if (cmd == 0x94) return 1;
+    if (cmd >= 0xA0 && cmd <= 0xBF) return 2;
+    if (cmd >= 0xC0 && cmd <= 0xDF) return 3;
+    if (cmd >= 0xE0) return 4;
+    return -1;
+}
+
+bool vgm_reader_next(vgm_reader_t* reader, vgm_event_t* event) {
+    CHIPS_ASSERT(reader && reader->ptr && event);
+    const uint8_t* p = reader->ptr;
+    const size_t end = reader->header.data_end;
+    while (reader->pos < end) {
+        const uint8_t cmd = p[reader->pos];
+        switch (cmd) {
+            case _VGM_CMD_YM3812:
+            case _VGM_CMD_YMF262_P0:
+            case _VGM_CMD_YMF262_P1:
+                if (reader->pos + 3 > end) {
+                    goto done;
+                }
+                event->type = VGM_EVENT_WRITE;
+                event->reg = (uint16_t)(p[reader->pos + 1] | ((cmd == _VGM_CMD_YMF262_P1) ? 0x100 : 0));
+                event->data = p[reader->pos + 2];
+                reader->pos += 3;
+                return true;
+            case _VGM_CMD_WAIT:
+                if (reader->pos + 3 > end) {
+                    goto done;
+                }
+                event->type = VGM_EVENT_WAIT;
+                event->samples = (uint32_t)p[reader->pos + 1] | ((uint32_t)p[reader->pos + 2] << 8);
+                reader->pos += 3;
+                return true;
+            case _VGM_CMD_WAIT_735:
+            case _VGM_CMD_WAIT_882:
+                event->type = VGM_EVENT_WAIT;
+                event->samples = (cmd == _VGM_CMD_WAIT_735) ? 735 : 882;
+                reader->pos += 1;
+                return true;
+            case _VGM_CMD_END: goto done;
+            case _VGM_CMD_DATA_BLOCK:
+                // 0x67 0x66 tt ss ss ss ss (data)
+                if (reader->pos + 7 > end) {
+                    goto done;
+                }
+                reader->pos += 7 + (size_t)_vgm_get_le32(&p[reader->pos + 3]);
+                break;
+            default:
+                if ((cmd & 0xF0) == _VGM_CMD_WAIT_SHORT) {
+                    event->type = VGM_EVENT_WAIT;
+                    event->samples = (uint32_t)(cmd & 0x0F) + 1;
+                    reader->pos += 1;
+                    return true;
+                }
+                else {
+                    const int len = _vgm_operand_len(cmd);
+                    if (len < 0) {
+                        goto done;  // unknown command, can't continue
+                    }
+                    reader->pos += 1 + (size_t)len;
+                }
+                break;
+        }
+    }
+done:
+    reader->pos = end;
+    event->type = VGM_EVENT_END;
+    return false;
+}
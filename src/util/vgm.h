@@ -0,0 +1,99 @@
+#pragma once
+/*
+    vgm.h -- VGM (Video Game Music) log writer and reader for YMF262 (OPL3)
+
+    The writer logs register writes together with the time they happened
+    at, expressed in ticks of an arbitrary clock (tick_hz). Ticks are
+    converted to the VGM 44100 Hz sample clock without accumulating any
+    rounding error, so the resulting log is sample-accurate.
+
+    vgm_writer_write() has the same signature as ymf262_write_cb_t and
+    can be installed directly as a YMF262 register write hook:
+
+    ~~~C
+    vgm_writer_t* vgm = vgm_writer_open(&(vgm_writer_desc_t){
+        .path = "out.vgm",
+        .tick_hz = sys->opl3.tick_hz,
+    });
+    ymf262_set_write_cb(&sys->opl3, vgm_writer_write, vgm);
+    ...
+    vgm_writer_close(vgm, sys->opl3.ticks);
+    ~~~
+
+    The reader walks a VGM command stream in memory and reports chip
+    writes and waits, it understands YMF262 (0x5E/0x5F) and YM3812 (0x5A)
+    writes and skips commands for other chips.
+
+    ## 0BSD license
+
+    Copyright (c) 2025 Tomasz Sterna
+*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define VGM_SAMPLE_RATE  (44100)
+#define VGM_YMF262_CLOCK (14318180)
+#define VGM_HEADER_SIZE  (0x80)  // VGM 1.51 header
+
+typedef struct {
+    const char* path;  // output file path
+    int tick_hz;       // frequency of the tick counter passed to vgm_writer_write()
+    uint32_t clock;    // YMF262 clock written to VGM header (default VGM_YMF262_CLOCK)
+} vgm_writer_desc_t;
+
+typedef struct vgm_writer_t vgm_writer_t;
+
+// create VGM log file, returns NULL on failure
+vgm_writer_t* vgm_writer_open(const vgm_writer_desc_t* desc);
+// log a register write (reg bit 8 selects bank 1), user_data is the vgm_writer_t*
+void vgm_writer_write(uint16_t reg, uint8_t data, uint64_t tick, void* user_data);
+// pad the log to tick, finalize header and close file, returns false on I/O error
+bool vgm_writer_close(vgm_writer_t* vgm, uint64_t tick);
+// number of 44100 Hz samples logged so far
+uint64_t vgm_writer_samples(const vgm_writer_t* vgm);
+
+// parsed VGM header
+typedef struct {
+    uint32_t version;
+    uint32_t total_samples;
+    uint32_t ymf262_clock;
+    uint32_t ym3812_clock;
+    size_t data_offset;  // absolute offset of command stream
+    size_t data_end;     // absolute offset of end of command stream
+} vgm_header_t;
+
+// a single decoded VGM event
+typedef enum {
+    VGM_EVENT_END = 0,  // end of stream (or parse error)
+    VGM_EVENT_WRITE,    // YMF262/YM3812 register write
+    VGM_EVENT_WAIT,     // wait a number of 44100 Hz samples
+} vgm_event_type_t;
+
+typedef struct {
+    vgm_event_type_t type;
+    uint16_t reg;      // VGM_EVENT_WRITE: 9-bit register (bit 8 selects bank 1)
+    uint8_t data;      // VGM_EVENT_WRITE: register value
+    uint32_t samples;  // VGM_EVENT_WAIT: number of samples
+} vgm_event_t;
+
+typedef struct {
+    const uint8_t* ptr;
+    vgm_header_t header;
+    size_t pos;
+} vgm_reader_t;
+
+// validate VGM data and prepare reader, returns false if data is not a VGM file
+bool vgm_reader_init(vgm_reader_t* reader, const uint8_t* ptr, size_t size);
+// decode next event, returns false on end of stream
+bool vgm_reader_next(vgm_reader_t* reader, vgm_event_t* event);
+// restart reading from beginning of command stream
+void vgm_reader_rewind(vgm_reader_t* reader);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
@@ -0,0 +1,22 @@
+#pragma once
+/*
+    xex.h -- X65 .xex file segment markers
+
+    A .xex file starts with $FFFF, followed by segments of a start and end
+    address (little endian) and the bytes in between. Segments with these
+    markers as start and end address are not loaded as they are:
+
+    - $FFFE-$FFFE: its one byte selects the bank of the following segments
+    - $FFFD-$FFFC: an LZ4 block (see lz.h), followed by the start and end
+      address of the unpacked data and the size of the block
+
+    Shared by x65_quickload_xex() and src/tools/xexpack.
+*/
+
+// $FFFE-$FFFE segment, its byte selects the bank of the following segments
+#define X65_XEX_BANK   (0xFFFE)
+// $FFFD-$FFFC segment header, start, end and size of an LZ4 block follow
+#define X65_XEX_LZ     (0xFFFD)
+#define X65_XEX_LZ_END (0xFFFC)
+// start of the bank 0 I/O window, bytes from here are written to the registers one by one and can't be packed
+#define X65_XEX_IO     (0xFE00)
@@ -9,6 +9,10 @@
 #include "chips/beeper.h"
 #undef CHIPS_IMPL
 #include "systems/x65.h"
+#include "util/audiocapture.h"
+#include "util/vgm.h"
+#include "util/hostfs.h"
+#include "util/uartbridge.h"
 #if defined(CHIPS_USE_UI)
     #define UI_DBG_USE_W65C816S
     #define UI_DASM_USE_W65C816S
@@ -25,7 +29,10 @@
     #include "ui/ui_x65.h"
 #endif
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "icon.c"
@@ -42,23 +49,30 @@ extern ui_settings_t* settings_load(const char* imgui_ini_key);
 int window_width = 0;
 int window_height = 0;
 
-typedef struct {
-    uint32_t version;
-    x65_t x65;
-} x65_snapshot_t;
-
 static struct {
     x65_t x65;
     uint32_t frame_time_us;
     uint32_t ticks;
     double emu_time_ms;
+    audio_capture_t* audio_capture;
+    vgm_writer_t* vgm;
+    hostfs_t* fs;
+    uart_bridge_t* uart;
+    uint64_t rng_seed;
+    x65_rewind_t* rewind;
+    bool rewinding;  // rewind key held
 #ifdef CHIPS_USE_UI
     ui_x65_t ui;
     struct {
         uint32_t entry_addr;
         uint32_t exit_addr;
     } dbg;
-    x65_snapshot_t snapshots[UI_SNAPSHOT_MAX_SLOTS];
+    chips_range_t snapshots[UI_SNAPSHOT_MAX_SLOTS];  // encoded snapshots, owned
+    uint32_t snapshots_saving[UI_SNAPSHOT_MAX_SLOTS];  // saves still being encoded on the I/O thread
+    bool snapshots_fetching[UI_SNAPSHOT_MAX_SLOTS];    // slots only known by their thumbnail, being read for loading
+    // bumped by each save, a fetch started for an older generation is dropped
+    uint32_t snapshots_generation[UI_SNAPSHOT_MAX_SLOTS];
+    uint32_t snapshots_fetch_generation[UI_SNAPSHOT_MAX_SLOTS];
 #endif
 } state;
 
@@ -66,8 +80,10 @@ static struct {
 static void ui_draw_cb(const ui_draw_info_t* draw_info);
 static void ui_save_settings_cb(ui_settings_t* settings);
 static void ui_boot_cb(x65_t* sys);
+static bool ui_audio_capture_cb(bool start);
 static void ui_save_snapshot(size_t slot_index);
 static bool ui_load_snapshot(size_t slot_index);
+static void ui_set_snapshot(size_t slot_index, chips_range_t data);
 static void ui_load_snapshots_from_storage(void);
 static void web_boot(void);
 static void web_reset(void);
@@ -94,21 +110,92 @@ static void* labels = NULL;
 #else
     #define BORDER_TOP (8)
 #endif
-#define BORDER_LEFT       (8)
-#define BORDER_RIGHT      (8)
-#define BORDER_BOTTOM     (16)
-#define LOAD_DELAY_FRAMES (6)
-
-// audio-streaming callback
+#define BORDER_LEFT          (8)
+#define BORDER_RIGHT         (8)
+#define BORDER_BOTTOM        (16)
+#define LOAD_DELAY_FRAMES    (6)
+#define MAX_RUN_AHEAD_FRAMES (4)
+#define AUDIO_CAPTURE_FILE "x65_audio.wav"
+
+// audio-streaming callback, samples are interleaved stereo frames
 static void push_audio(const float* samples, int num_samples, void* user_data) {
     (void)user_data;
+    if (state.audio_capture) {
+        audio_capture_push(samples, num_samples, state.audio_capture);
+    }
     saudio_push(samples, num_samples);
 }
 
+// start capturing audio output to file, headerless PCM for .raw files
+static bool audio_capture_start(const char* path) {
+    const size_t len = strlen(path);
+    state.audio_capture = audio_capture_open(&(audio_capture_desc_t){
+        .path = path,
+        .format = arguments.audio_capture_f32 ? AUDIO_CAPTURE_FORMAT_F32 : AUDIO_CAPTURE_FORMAT_S16,
+        .raw = (len >= 4) && (0 == strcmp(path + len - 4, ".raw")),
+        .sample_rate = saudio_sample_rate(),
+        .num_channels = X65_AUDIO_CHANNELS,
+    });
+    if (!state.audio_capture) {
+        fprintf(stderr, "Cannot capture audio to %s\n", path);
+    }
+    return state.audio_capture != NULL;
+}
+
+static void audio_capture_stop(void) {
+    if (state.audio_capture) {
+        const audio_capture_stats_t stats = audio_capture_stats(state.audio_capture);
+        audio_capture_close(state.audio_capture);
+        state.audio_capture = NULL;
+        if (stats.blocks_dropped || stats.io_error) {
+            fprintf(
+                stderr,
+                "Audio capture: %llu frames written, %llu blocks dropped%s\n",
+                (unsigned long long)stats.frames_written,
+                (unsigned long long)stats.blocks_dropped,
+                stats.io_error ? ", write error" : "");
+        }
+    }
+}
+
+// start logging OPL3 register writes to a VGM file
+static void vgm_start(const char* path) {
+    state.vgm = vgm_writer_open(&(vgm_writer_desc_t){
+        .path = path,
+        .tick_hz = state.x65.opl3.tick_hz,
+    });
+    if (!state.vgm) {
+        fprintf(stderr, "Cannot log VGM to %s\n", path);
+    }
+}
+
+// (re-)attach VGM logger after system init
+static void vgm_attach(void) {
+    if (state.vgm) {
+        ymf262_set_write_cb(&state.x65.opl3, vgm_writer_write, state.vgm);
+    }
+}
+
+static void vgm_stop(void) {
+    if (state.vgm) {
+        ymf262_set_write_cb(&state.x65.opl3, NULL, NULL);
+        if (!vgm_writer_close(state.vgm, state.x65.opl3.ticks)) {
+            fprintf(stderr, "VGM log write error\n");
+        }
+        state.vgm = NULL;
+    }
+}
+
 // get x65_desc_t struct based on joystick type
 x65_desc_t x65_desc(x65_joystick_type_t joy_type) {
     return (x65_desc_t) {
         .joystick_type = joy_type,
+        .fm_thread = arguments.fm_thread,
+        .fs = state.fs,
+        .api_latency_us = (uint32_t)arguments.api_latency,
+        .uart_buffer_size = arguments.uart_buffer,
+        .rng_seed = state.rng_seed,
+        .huge_pages = arguments.huge_pages,
         .audio = {
             .callback = { .func = push_audio },
             .sample_rate = saudio_sample_rate(),
@@ -119,8 +206,17 @@ x65_desc_t x65_desc(x65_joystick_type_t joy_type) {
     };
 }
 
+// the emulator can't go on without guest RAM
+static void x65_init_or_exit(x65_t* sys, const x65_desc_t* desc) {
+    if (!x65_init(sys, desc)) {
+        fprintf(stderr, "Cannot allocate %d MB of guest RAM\n", X65_RAM_SIZE >> 20);
+        exit(1);
+    }
+}
+
 void app_init(void) {
     saudio_setup(&(saudio_desc){
+        .num_channels = X65_AUDIO_CHANNELS,
         .logger.func = slog_func,
     });
     x65_joystick_type_t joy_type = X65_JOYSTICKTYPE_NONE;
@@ -135,8 +231,51 @@ void app_init(void) {
             joy_type = X65_JOYSTICKTYPE_DIGITAL_12;
         }
     }
+    // without a given seed every run gets different random numbers
+    state.rng_seed = arguments.seed ? strtoull(arguments.seed, NULL, 0) : (uint64_t)time(NULL);
+    if (arguments.verbose) {
+        printf("RIA random number generator seed %llu\n", (unsigned long long)state.rng_seed);
+    }
+    if (arguments.fs_root) {
+        state.fs = hostfs_create(arguments.fs_root);
+        if (!state.fs) {
+            fprintf(stderr, "Cannot serve files from %s\n", arguments.fs_root);
+        }
+    }
+    if (arguments.uart_pty || arguments.uart_socket) {
+        state.uart = uart_bridge_open(&(uart_bridge_desc_t){
+            .type = arguments.uart_socket ? UART_BRIDGE_SOCKET : UART_BRIDGE_PTY,
+            .path = arguments.uart_socket,
+        });
+        if (state.uart) {
+            printf("RIA UART connected to %s\n", uart_bridge_name(state.uart));
+        }
+        else {
+            fprintf(stderr, "Cannot connect RIA UART to %s\n", arguments.uart_socket ? arguments.uart_socket : "PTY");
+        }
+    }
     x65_desc_t desc = x65_desc(joy_type);
-    x65_init(&state.x65, &desc);
+    x65_init_or_exit(&state.x65, &desc);
+    if (arguments.huge_pages && state.x65.mem.pages == GUESTMEM_PAGES_NORMAL) {
+        fprintf(stderr, "Huge pages are not available, guest RAM uses normal pages\n");
+    }
+    if (arguments.run_ahead > MAX_RUN_AHEAD_FRAMES) {
+        arguments.run_ahead = MAX_RUN_AHEAD_FRAMES;
+    }
+    if (arguments.rewind_mb > 0 || arguments.run_ahead > 0) {
+        // run-ahead only needs the last frame to go back to
+        state.rewind = x65_rewind_create(&state.x65, &(x65_rewind_desc_t){
+            .budget = (size_t)arguments.rewind_mb * 1024 * 1024,
+            .no_history = arguments.rewind_mb <= 0,
+        });
+        if (!state.rewind) {
+            fprintf(stderr, "Cannot allocate rewind buffer\n");
+        }
+    }
+    if (arguments.vgm_file) {
+        vgm_start(arguments.vgm_file);
+        vgm_attach();
+    }
     gfx_init(&(gfx_desc_t){
         .disable_speaker_icon = sargs_exists("disable-speaker-icon"),
 #ifdef CHIPS_USE_UI
@@ -163,6 +302,8 @@ void app_init(void) {
     ui_x65_init(&state.ui, &(ui_x65_desc_t){
         .x65 = &state.x65,
         .boot_cb = ui_boot_cb,
+        .audio_capture_cb = ui_audio_capture_cb,
+        .uart_bridged = state.uart != NULL,
         .dbg_texture = {
             .create_cb = ui_create_texture,
             .update_cb = ui_update_texture,
@@ -215,6 +356,12 @@ void app_init(void) {
         },
     });
 #endif
+    if (arguments.audio_capture_file) {
+        audio_capture_start(arguments.audio_capture_file);
+#ifdef CHIPS_USE_UI
+        state.ui.audio_capture = state.audio_capture != NULL;
+#endif
+    }
     bool delay_input = false;
     if (arguments.rom) {
         delay_input = true;
@@ -237,7 +384,34 @@ static void draw_status_bar(void);
 void app_frame(void) {
     state.frame_time_us = clock_frame_time();
     const uint64_t emu_start_time = stm_now();
-    state.ticks = x65_exec(&state.x65, state.frame_time_us);
+    if (state.rewind && state.rewinding && (arguments.rewind_mb > 0)) {
+        // step back one frame and run the frame after it again to show it
+        x65_rewind(state.rewind, 1);
+        state.ticks = x65_exec(&state.x65, state.frame_time_us);
+    }
+    else {
+        state.ticks = x65_exec(&state.x65, state.frame_time_us);
+        if (state.rewind) {
+            x65_rewind_capture(state.rewind);
+        }
+        if (state.rewind && (arguments.run_ahead > 0)) {
+            // timed in parts, for the budget of each run-ahead depth
+            const uint64_t run_ahead_start_time = stm_now();
+            x65_run_ahead_begin(state.rewind);
+            for (int i = 0; i < arguments.run_ahead; i++) {
+                const uint64_t frame_start_time = stm_now();
+                x65_exec(&state.x65, state.frame_time_us);
+                prof_push(PROF_RUNAHEAD_FRAME, (float)stm_ms(stm_since(frame_start_time)));
+            }
+            const uint64_t restore_start_time = stm_now();
+            x65_run_ahead_end(state.rewind);
+            prof_push(PROF_RUNAHEAD_RESTORE, (float)stm_ms(stm_since(restore_start_time)));
+            prof_push(PROF_RUNAHEAD, (float)stm_ms(stm_since(run_ahead_start_time)));
+        }
+    }
+    if (state.uart) {
+        uart_bridge_service(state.uart, &state.x65.ria.uart_rx, &state.x65.ria.uart_tx);
+    }
     state.emu_time_ms = stm_ms(stm_since(emu_start_time));
     draw_status_bar();
     gfx_draw(x65_display_info(&state.x65));
@@ -283,6 +457,10 @@ void app_input(const sapp_event* event) {
                     sapp_request_quit();
                 }
             }
+            if (event->key_code == SAPP_KEYCODE_F10) {
+                state.rewinding = event->type == SAPP_EVENTTYPE_KEY_DOWN;
+                break;
+            }
             switch (event->key_code) {
                 case SAPP_KEYCODE_SPACE: c = 0x20; break;
                 case SAPP_KEYCODE_LEFT: c = 0x08; break;
@@ -316,10 +494,19 @@ void app_input(const sapp_event* event) {
 }
 
 void app_cleanup(void) {
+    fs_shutdown();
+    audio_capture_stop();
+    vgm_stop();
+    x65_rewind_destroy(state.rewind);
     x65_discard(&state.x65);
+    hostfs_destroy(state.fs);
+    uart_bridge_close(state.uart);
 #ifdef CHIPS_USE_UI
     ui_x65_discard(&state.ui);
     ui_discard();
+    for (size_t slot = 0; slot < UI_SNAPSHOT_MAX_SLOTS; slot++) {
+        ui_set_snapshot(slot, (chips_range_t){ 0 });
+    }
 #endif
     saudio_shutdown();
     gfx_shutdown();
@@ -386,6 +573,17 @@ static void draw_status_bar(void) {
         emu_stats.min_val,
         emu_stats.max_val,
         state.ticks);
+    if (state.rewind && (arguments.run_ahead > 0)) {
+        // the cost of running 1 and 2 frames ahead, estimated from the average frame run ahead and restore
+        const float frame_ms = prof_stats(PROF_RUNAHEAD_FRAME).avg_val;
+        const float restore_ms = prof_stats(PROF_RUNAHEAD_RESTORE).avg_val;
+        sdtx_printf(
+            " ahead:%d (%.2fms) est. 1:%.2fms 2:%.2fms",
+            arguments.run_ahead,
+            prof_stats(PROF_RUNAHEAD).avg_val,
+            frame_ms + restore_ms,
+            2.0f * frame_ms + restore_ms);
+    }
 }
 
 #if defined(CHIPS_USE_UI)
@@ -406,57 +604,140 @@ static void ui_save_settings_cb(ui_settings_t* settings) {
 static void ui_boot_cb(x65_t* sys) {
     clock_init();
     x65_desc_t desc = x65_desc(sys->joystick_type);
-    x65_init(sys, &desc);
+    x65_discard(sys);
+    x65_init_or_exit(sys, &desc);
+    if (state.rewind) {
+        x65_rewind_reset(state.rewind);
+    }
+    vgm_attach();
     if (arguments.rom) {
         fs_load_file_async(FS_CHANNEL_IMAGES, arguments.rom);
     }
 }
 
-static void ui_update_snapshot_screenshot(size_t slot) {
-    ui_snapshot_screenshot_t screenshot = { .texture = ui_create_screenshot_texture(
-                                                x65_display_info(&state.snapshots[slot].x65)) };
+static bool ui_audio_capture_cb(bool start) {
+    if (start) {
+        return audio_capture_start(arguments.audio_capture_file ? arguments.audio_capture_file : AUDIO_CAPTURE_FILE);
+    }
+    audio_capture_stop();
+    return false;
+}
+
+static void ui_set_snapshot_screenshot(size_t slot, chips_display_info_t display_info) {
+    ui_snapshot_screenshot_t screenshot = { .texture = ui_create_screenshot_texture(display_info) };
     ui_snapshot_screenshot_t prev_screenshot = ui_snapshot_set_screenshot(&state.ui.snapshot, slot, screenshot);
     if (prev_screenshot.texture) {
         ui_destroy_texture(prev_screenshot.texture);
     }
 }
 
+static void ui_set_snapshot(size_t slot, chips_range_t data) {
+    free(state.snapshots[slot].ptr);
+    state.snapshots[slot] = data;
+}
+
+// runs on the I/O thread
+static chips_range_t ui_encode_snapshot(void* frozen) {
+    return x65_encode_snapshot((x65_frozen_snapshot_t*)frozen);
+}
+
+static void ui_saved_snapshot_callback(fs_snapshot_response_t* response) {
+    assert(response);
+    size_t slot = response->snapshot_index;
+    assert((slot < UI_SNAPSHOT_MAX_SLOTS) && (state.snapshots_saving[slot] > 0));
+    state.snapshots_saving[slot]--;
+    if (response->result != FS_RESULT_SUCCESS) {
+        fprintf(stderr, "Cannot save snapshot %zu\n", slot);
+    }
+    if (!response->data.ptr) {
+        return;
+    }
+    // keep the encoded data for loading, even if writing the file failed
+    ui_set_snapshot(slot, response->data);
+    response->data.ptr = 0;
+}
+
 static void ui_save_snapshot(size_t slot) {
     if (slot < UI_SNAPSHOT_MAX_SLOTS) {
-        state.snapshots[slot].version = x65_save_snapshot(&state.x65, &state.snapshots[slot].x65);
-        ui_update_snapshot_screenshot(slot);
-        fs_save_snapshot("x65", slot, (chips_range_t){ .ptr = &state.snapshots[slot], sizeof(x65_snapshot_t) });
+        // only the copy is done here, compression and writing happen on the I/O thread
+        x65_frozen_snapshot_t* frozen = x65_freeze_snapshot(&state.x65);
+        if (!frozen) {
+            fprintf(stderr, "Cannot save snapshot %zu\n", slot);
+            return;
+        }
+        ui_set_snapshot_screenshot(slot, x65_display_info(&state.x65));
+        state.snapshots_generation[slot]++;
+        state.snapshots_saving[slot]++;
+        if (!fs_save_snapshot_async("x65", slot, ui_encode_snapshot, frozen, ui_saved_snapshot_callback)) {
+            // no I/O thread, encode and write it here
+            state.snapshots_saving[slot]--;
+            chips_range_t data = x65_encode_snapshot(frozen);
+            if (!data.ptr || !fs_save_snapshot("x65", slot, data)) {
+                fprintf(stderr, "Cannot save snapshot %zu\n", slot);
+            }
+            ui_set_snapshot(slot, data);
+        }
+    }
+}
+
+static void ui_fetch_snapshot_callback(fs_snapshot_response_t* response) {
+    assert(response);
+    size_t slot = response->snapshot_index;
+    assert(slot < UI_SNAPSHOT_MAX_SLOTS);
+    state.snapshots_fetching[slot] = false;
+    if (state.snapshots_fetch_generation[slot] != state.snapshots_generation[slot]) {
+        // saved again in the meantime, the file is older than the snapshot in memory
+        return;
+    }
+    if (response->result != FS_RESULT_SUCCESS) {
+        fprintf(stderr, "Cannot read snapshot %zu\n", slot);
+        return;
+    }
+    ui_set_snapshot(slot, response->data);
+    response->data.ptr = 0;
+    if (!x65_load_snapshot(&state.x65, state.snapshots[slot])) {
+        fprintf(stderr, "Cannot load snapshot %zu\n", slot);
     }
 }
 
 static bool ui_load_snapshot(size_t slot) {
     bool success = false;
-    if ((slot < UI_SNAPSHOT_MAX_SLOTS) && (state.ui.snapshot.slots[slot].valid)) {
-        success = x65_load_snapshot(&state.x65, state.snapshots[slot].version, &state.snapshots[slot].x65);
+    if ((slot < UI_SNAPSHOT_MAX_SLOTS) && (state.ui.snapshot.slots[slot].valid) && !state.snapshots_saving[slot]) {
+        if (state.snapshots[slot].ptr) {
+            success = x65_load_snapshot(&state.x65, state.snapshots[slot]);
+        }
+        else {
+            // only the thumbnail was read at start-up, the snapshot is loaded when the file arrives
+            if (!state.snapshots_fetching[slot]) {
+                state.snapshots_fetch_generation[slot] = state.snapshots_generation[slot];
+                state.snapshots_fetching[slot] = fs_load_snapshot_async("x65", slot, ui_fetch_snapshot_callback);
+            }
+            success = state.snapshots_fetching[slot];
+        }
     }
     return success;
 }
 
-static void ui_fetch_snapshot_callback(const fs_snapshot_response_t* response) {
+static void ui_fetch_snapshot_preview_callback(fs_snapshot_response_t* response) {
     assert(response);
     if (response->result != FS_RESULT_SUCCESS) {
         return;
     }
-    if (response->data.size != sizeof(x65_snapshot_t)) {
+    size_t slot = response->snapshot_index;
+    assert(slot < UI_SNAPSHOT_MAX_SLOTS);
+    if (state.ui.snapshot.slots[slot].valid) {
+        // saved again in the meantime
         return;
     }
-    if (((x65_snapshot_t*)response->data.ptr)->version != X65_SNAPSHOT_VERSION) {
-        return;
+    static uint32_t thumb[X65_THUMBNAIL_SIZE_BYTES / 4];
+    if (x65_snapshot_thumbnail(response->data, (chips_range_t){ .ptr = thumb, .size = sizeof(thumb) })) {
+        ui_set_snapshot_screenshot(slot, x65_thumbnail_display_info(thumb));
     }
-    size_t snapshot_slot = response->snapshot_index;
-    assert(snapshot_slot < UI_SNAPSHOT_MAX_SLOTS);
-    memcpy(&state.snapshots[snapshot_slot], response->data.ptr, response->data.size);
-    ui_update_snapshot_screenshot(snapshot_slot);
 }
 
 static void ui_load_snapshots_from_storage(void) {
     for (size_t snapshot_slot = 0; snapshot_slot < UI_SNAPSHOT_MAX_SLOTS; snapshot_slot++) {
-        fs_load_snapshot_async("x65", snapshot_slot, ui_fetch_snapshot_callback);
+        fs_load_snapshot_preview_async("x65", snapshot_slot, X65_SNAPSHOT_PREVIEW_SIZE, ui_fetch_snapshot_preview_callback);
     }
 }
 
@@ -464,7 +745,12 @@ static void ui_load_snapshots_from_storage(void) {
 static void web_boot(void) {
     clock_init();
     x65_desc_t desc = x65_desc(state.x65.joystick_type);
-    x65_init(&state.x65, &desc);
+    x65_discard(&state.x65);
+    x65_init_or_exit(&state.x65, &desc);
+    if (state.rewind) {
+        x65_rewind_reset(state.rewind);
+    }
+    vgm_attach();
     ui_dbg_reboot(&state.ui.dbg);
 }
 